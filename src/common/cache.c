@@ -25,54 +25,116 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-// this implements a concurrent LRU cache
+// this implements a concurrent LRU cache.
+// keys are spread over DT_CACHE_SHARDS shards, each with its own lock, so
+// the lru order is only exact per shard while the cost quota is global.
+
+static inline dt_cache_shard_t *_get_shard(dt_cache_t *cache,
+                                           const uint32_t key)
+{
+  // fibonacci hashing, keys are often sequential image ids with some flag bits
+  const uint32_t h = key * 0x9E3779B1u;
+  return &cache->shard[h >> (32 - DT_CACHE_SHARDS_BITS)];
+}
+
+static inline void _lru_unlink(dt_cache_shard_t *shard,
+                               dt_cache_entry_t *entry)
+{
+  if(entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+  else                shard->lru = entry->lru_next;
+  if(entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+  else                shard->lru_last = entry->lru_prev;
+  entry->lru_prev = entry->lru_next = NULL;
+}
+
+static inline void _lru_append(dt_cache_shard_t *shard,
+                               dt_cache_entry_t *entry)
+{
+  entry->lru_next = NULL;
+  entry->lru_prev = shard->lru_last;
+  if(shard->lru_last) shard->lru_last->lru_next = entry;
+  else                shard->lru = entry;
+  shard->lru_last = entry;
+}
+
+// bubble up in lru list
+static inline void _lru_touch(dt_cache_shard_t *shard,
+                              dt_cache_entry_t *entry)
+{
+  if(shard->lru_last == entry) return;
+  _lru_unlink(shard, entry);
+  _lru_append(shard, entry);
+}
+
+static void _free_entry(dt_cache_t *cache,
+                        dt_cache_entry_t *entry)
+{
+  if(cache->cleanup)
+  {
+    assert(entry->data_size);
+    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
+
+    cache->cleanup(cache->cleanup_data, entry);
+  }
+  else
+    dt_free_align(entry->data);
+}
 
 void dt_cache_init(dt_cache_t *cache,
                    const size_t entry_size,
                    const size_t cost_quota)
 {
-  cache->cost = 0;
-  cache->lru = 0;
   cache->entry_size = entry_size;
   cache->cost_quota = cost_quota;
-  dt_pthread_mutex_init(&cache->lock, 0);
   cache->allocate = 0;
   cache->allocate_data = 0;
   cache->cleanup = 0;
   cache->cleanup_data = 0;
-  cache->hashtable = g_hash_table_new(0, 0);
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+  {
+    dt_cache_shard_t *shard = &cache->shard[k];
+    dt_pthread_mutex_init(&shard->lock, 0);
+    shard->cost = 0;
+    shard->lru = shard->lru_last = NULL;
+    shard->hashtable = g_hash_table_new(0, 0);
+  }
 }
 
 void dt_cache_cleanup(dt_cache_t *cache)
 {
-  g_hash_table_destroy(cache->hashtable);
-  for(GList *l = cache->lru; l; l = g_list_next(l))
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = l->data;
-
-    if(cache->cleanup)
+    dt_cache_shard_t *shard = &cache->shard[k];
+    g_hash_table_destroy(shard->hashtable);
+    dt_cache_entry_t *entry = shard->lru;
+    while(entry)
     {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
+      dt_cache_entry_t *next = entry->lru_next;
+      _free_entry(cache, entry);
+      dt_pthread_rwlock_destroy(&entry->lock);
+      g_slice_free1(sizeof(*entry), entry);
+      entry = next;
     }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+    shard->lru = shard->lru_last = NULL;
+    dt_pthread_mutex_destroy(&shard->lock);
   }
-  g_list_free(cache->lru);
-  dt_pthread_mutex_destroy(&cache->lock);
+}
+
+size_t dt_cache_get_cost(const dt_cache_t *cache)
+{
+  size_t cost = 0;
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
+    cost += cache->shard[k].cost;
+  return cost;
 }
 
 gboolean dt_cache_contains(dt_cache_t *cache,
                           const uint32_t key)
 {
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean result = g_hash_table_contains(cache->hashtable, GINT_TO_POINTER(key));
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_cache_shard_t *shard = _get_shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  const gboolean result = g_hash_table_contains(shard->hashtable, GINT_TO_POINTER(key));
+  dt_pthread_mutex_unlock(&shard->lock);
   return result;
 }
 
@@ -84,8 +146,9 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
 {
   gpointer orig_key, value;
   const double start = dt_get_debug_wtime();
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  dt_cache_shard_t *shard = _get_shard(cache, key);
+  dt_pthread_mutex_lock(&shard->lock);
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -99,13 +162,11 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       return NULL;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
     const double end = dt_get_debug_wtime();
     if(end - start > 0.1)
       dt_print(DT_DEBUG_ALWAYS, "try+ wait time %.06fs mode %c", end - start, mode);
@@ -120,13 +181,81 @@ dt_cache_entry_t *dt_cache_testget(dt_cache_t *cache,
 
     return entry;
   }
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "try- wait time %.06fs", end - start);
   return NULL;
 }
 
+// remove entries from the tip of the lru list of a locked shard until the
+// fill ratio of the whole cache is reached.
+static void _shard_gc(dt_cache_t *cache,
+                      dt_cache_shard_t *shard,
+                      const float fill_ratio)
+{
+  const size_t target = cache->cost_quota * fill_ratio;
+  dt_cache_entry_t *entry = shard->lru;
+  while(entry)
+  {
+    // we might remove this element, so walk to the next one while we
+    // still have the pointer..
+    dt_cache_entry_t *next = entry->lru_next;
+    if(dt_cache_get_cost(cache) < target)
+      break;
+
+    // if still locked by anyone else give up:
+    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+    {
+      entry = next;
+      continue;
+    }
+
+    if(entry->_lock_demoting)
+    {
+      // oops, we are currently demoting (rw -> r) lock to this entry
+      // in some thread. do not touch!
+      dt_pthread_rwlock_unlock(&entry->lock);
+      entry = next;
+      continue;
+    }
+
+    // delete!
+    g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(entry->key));
+    _lru_unlink(shard, entry);
+    shard->cost -= entry->cost;
+
+    _free_entry(cache, entry);
+
+    dt_pthread_rwlock_unlock(&entry->lock);
+    dt_pthread_rwlock_destroy(&entry->lock);
+    g_slice_free1(sizeof(*entry), entry);
+    entry = next;
+  }
+}
+
+// garbage collection while holding the lock of one shard. we start with our own
+// shard, other shards are only visited if their lock is free to avoid lock order
+// problems between threads.
+static void _gc_locked(dt_cache_t *cache,
+                       dt_cache_shard_t *locked,
+                       const float fill_ratio)
+{
+  _shard_gc(cache, locked, fill_ratio);
+
+  const int first = locked - cache->shard;
+  for(int k = 1; k < DT_CACHE_SHARDS; k++)
+  {
+    if(dt_cache_get_cost(cache) < cache->cost_quota * fill_ratio)
+      return;
+    dt_cache_shard_t *shard = &cache->shard[(first + k) & (DT_CACHE_SHARDS - 1)];
+    if(dt_pthread_mutex_trylock(&shard->lock))
+      continue;
+    _shard_gc(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
+  }
+}
+
 // if found, the data void* is returned. if not, it is set to be
 // the given *data and a new hash table entry is created, which can be
 // found using the given key later on.
@@ -138,9 +267,10 @@ dt_cache_entry_t *dt_cache_get_with_caller(dt_cache_t *cache,
 {
   gpointer orig_key, value;
   const double start = dt_get_debug_wtime();
+  dt_cache_shard_t *shard = _get_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  dt_pthread_mutex_lock(&shard->lock);
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
@@ -153,14 +283,12 @@ restart:
     if(result)
     { // need to give up mutex so other threads have a chance to get in between and
       // free the lock we're trying to acquire:
-      dt_pthread_mutex_unlock(&cache->lock);
+      dt_pthread_mutex_unlock(&shard->lock);
       g_usleep(5);
       goto restart;
     }
-    // bubble up in lru list:
-    cache->lru = g_list_remove_link(cache->lru, entry->link);
-    cache->lru = g_list_concat(cache->lru, entry->link);
-    dt_pthread_mutex_unlock(&cache->lock);
+    _lru_touch(shard, entry);
+    dt_pthread_mutex_unlock(&shard->lock);
 
 #ifdef _DEBUG
     const pthread_t writer = dt_pthread_rwlock_get_writer(&entry->lock);
@@ -189,10 +317,10 @@ restart:
 
   // first try to clean up.
   // also wait if we can't free more than the requested fill ratio.
-  if(cache->cost > 0.8f * cache->cost_quota)
+  if(dt_cache_get_cost(cache) > 0.8f * cache->cost_quota)
   {
     // need to roll back all the way to get a consistent lock state:
-    dt_cache_gc(cache, 0.8f);
+    _gc_locked(cache, shard, 0.8f);
   }
 
   // here dies your 32-bit system:
@@ -202,11 +330,11 @@ restart:
   entry->data = 0;
   entry->data_size = cache->entry_size;
   entry->cost = 1;
-  entry->link = g_list_append(0, entry);
+  entry->lru_prev = entry->lru_next = NULL;
   entry->key = key;
   entry->_lock_demoting = FALSE;
 
-  g_hash_table_insert(cache->hashtable, GINT_TO_POINTER(key), entry);
+  g_hash_table_insert(shard->hashtable, GINT_TO_POINTER(key), entry);
 
   assert(cache->allocate || entry->data_size);
 
@@ -226,12 +354,12 @@ restart:
   else
     dt_pthread_rwlock_rdlock_with_caller(&entry->lock, file, line);
 
-  cache->cost += entry->cost;
+  shard->cost += entry->cost;
 
   // put at end of lru list (most recently used):
-  cache->lru = g_list_concat(cache->lru, entry->link);
+  _lru_append(shard, entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   const double end = dt_get_debug_wtime();
   if(end - start > 0.1)
     dt_print(DT_DEBUG_ALWAYS, "wait time %.06fs", end - start);
@@ -246,23 +374,24 @@ gboolean dt_cache_remove(dt_cache_t *cache,
 {
   dt_cache_entry_t *entry;
   gpointer orig_key, value;
+  dt_cache_shard_t *shard = _get_shard(cache, key);
 restart:
-  dt_pthread_mutex_lock(&cache->lock);
+  dt_pthread_mutex_lock(&shard->lock);
 
-  const gboolean res = g_hash_table_lookup_extended(cache->hashtable,
+  const gboolean res = g_hash_table_lookup_extended(shard->hashtable,
                                                     GINT_TO_POINTER(key),
                                                     &orig_key,
                                                     &value);
   entry = (dt_cache_entry_t *)value;
   if(!res)
   { // not found in cache, not deleting.
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     return TRUE;
   }
   // need write lock to be able to delete:
   if(dt_pthread_rwlock_trywrlock(&entry->lock))
   {
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
@@ -272,32 +401,24 @@ restart:
     // oops, we are currently demoting (rw -> r) lock to this entry in
     // some thread. do not touch!
     dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_mutex_unlock(&cache->lock);
+    dt_pthread_mutex_unlock(&shard->lock);
     g_usleep(5);
     goto restart;
   }
 
-  const gboolean removed = g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(key));
+  const gboolean removed = g_hash_table_remove(shard->hashtable, GINT_TO_POINTER(key));
   (void)removed; // make non-assert compile happy
   assert(removed);
-  cache->lru = g_list_delete_link(cache->lru, entry->link);
+  _lru_unlink(shard, entry);
 
-  if(cache->cleanup)
-  {
-    assert(entry->data_size);
-    ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-    cache->cleanup(cache->cleanup_data, entry);
-  }
-  else
-    dt_free_align(entry->data);
+  _free_entry(cache, entry);
 
   dt_pthread_rwlock_unlock(&entry->lock);
   dt_pthread_rwlock_destroy(&entry->lock);
-  cache->cost -= entry->cost;
+  shard->cost -= entry->cost;
   g_slice_free1(sizeof(*entry), entry);
 
-  dt_pthread_mutex_unlock(&cache->lock);
+  dt_pthread_mutex_unlock(&shard->lock);
   return FALSE;
 }
 
@@ -306,47 +427,15 @@ restart:
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio)
 {
-  GList *l = cache->lru;
-  while(l)
+  for(int k = 0; k < DT_CACHE_SHARDS; k++)
   {
-    dt_cache_entry_t *entry = l->data;
-    assert(entry->link->data == entry);
-    l = g_list_next(l); // we might remove this element, so walk to
-                        // the next one while we still have the
-                        // pointer..
-    if(cache->cost < cache->cost_quota * fill_ratio)
-      break;
-
-    // if still locked by anyone else give up:
-    if(dt_pthread_rwlock_trywrlock(&entry->lock))
+    if(dt_cache_get_cost(cache) < cache->cost_quota * fill_ratio)
+      return;
+    dt_cache_shard_t *shard = &cache->shard[k];
+    if(dt_pthread_mutex_trylock(&shard->lock))
       continue;
-
-    if(entry->_lock_demoting)
-    {
-      // oops, we are currently demoting (rw -> r) lock to this entry
-      // in some thread. do not touch!
-      dt_pthread_rwlock_unlock(&entry->lock);
-      continue;
-    }
-
-    // delete!
-    g_hash_table_remove(cache->hashtable, GINT_TO_POINTER(entry->key));
-    cache->lru = g_list_delete_link(cache->lru, entry->link);
-    cache->cost -= entry->cost;
-
-    if(cache->cleanup)
-    {
-      assert(entry->data_size);
-      ASAN_UNPOISON_MEMORY_REGION(entry->data, entry->data_size);
-
-      cache->cleanup(cache->cleanup_data, entry);
-    }
-    else
-      dt_free_align(entry->data);
-
-    dt_pthread_rwlock_unlock(&entry->lock);
-    dt_pthread_rwlock_destroy(&entry->lock);
-    g_slice_free1(sizeof(*entry), entry);
+    _shard_gc(cache, shard, fill_ratio);
+    dt_pthread_mutex_unlock(&shard->lock);
   }
 }
 
@@ -23,12 +23,17 @@
 #include <inttypes.h>
 #include <stddef.h>
 
+// number of independently locked parts of the cache, must be a power of two
+#define DT_CACHE_SHARDS_BITS 4
+#define DT_CACHE_SHARDS (1 << DT_CACHE_SHARDS_BITS)
+
 typedef struct dt_cache_entry_t
 {
   void *data;
   size_t data_size;
   size_t cost;
-  GList *link;
+  struct dt_cache_entry_t *lru_prev; // intrusive lru list of the shard holding this entry
+  struct dt_cache_entry_t *lru_next;
   dt_pthread_rwlock_t lock;
   gboolean _lock_demoting;
   uint32_t key;
@@ -37,16 +42,24 @@ typedef struct dt_cache_entry_t
 typedef void((*dt_cache_allocate_t)(void *userdata, dt_cache_entry_t *entry));
 typedef void((*dt_cache_cleanup_t)(void *userdata, dt_cache_entry_t *entry));
 
+// the keys are distributed over the shards, every shard has its own lock,
+// hashtable and lru list so threads working on different keys rarely contend.
+typedef struct dt_cache_shard_t
+{
+  dt_pthread_mutex_t lock;
+
+  size_t cost;                // sum of the entries cost in this shard
+  GHashTable *hashtable;      // stores (key, entry) pairs
+  dt_cache_entry_t *lru;      // first element, is about to be kicked from cache.
+  dt_cache_entry_t *lru_last; // most recently used element
+} dt_cache_shard_t;
+
 typedef struct dt_cache_t
 {
-  dt_pthread_mutex_t lock; // big fat lock. we're only expecting a couple hand full of cpu threads to use this concurrently.
+  dt_cache_shard_t shard[DT_CACHE_SHARDS];
 
   size_t entry_size; // cache line allocation
-  size_t cost;       // user supplied cost per cache line (bytes?)
-  size_t cost_quota; // quota to try and meet. but don't use as hard limit.
-
-  GHashTable *hashtable; // stores (key, entry) pairs
-  GList *lru;            // last element is most recently used, first is about to be kicked from cache.
+  size_t cost_quota; // quota to try and meet for the whole cache. but don't use as hard limit.
 
   // callback functions for cache misses/garbage collection
   dt_cache_allocate_t allocate;
@@ -93,13 +106,16 @@ void dt_cache_release_with_caller(dt_cache_t *cache,
                                   const char *file,
                                   const int line);
 
+// user supplied cost of all entries. not locked so only a snapshot.
+size_t dt_cache_get_cost(const dt_cache_t *cache);
+
 // FALSE: not contained
 gboolean dt_cache_contains(dt_cache_t *cache, const uint32_t key);
 // returns FALSE on success, TRUE if the key was not found.
 gboolean dt_cache_remove(dt_cache_t *cache, const uint32_t key);
-// removes from the tip of the lru list, until the fill ratio of the hashtable
+// removes from the tip of the shards lru lists, until the fill ratio of the cache
 // goes below the given parameter, in terms of the user defined cost measure.
-// will never lock and never fail, but sometimes not free memory (in case all
+// will never block and never fail, but sometimes not free memory (in case all
 // is locked)
 void dt_cache_gc(dt_cache_t *cache,
                  const float fill_ratio);
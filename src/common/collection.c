@@ -17,6 +17,7 @@
 */
 
 #include "common/collection.h"
+#include "common/collection_index.h"
 #include "common/debug.h"
 #include "common/image.h"
 #include "common/image_cache.h"
@@ -2522,6 +2523,9 @@ void dt_collection_update_query(const dt_collection_t *collection,
                                 GList *list)
 {
   int next = -1;
+  // the image set of a where clause may have changed even if the text didn't
+  if(!collection->clone) dt_collection_index_invalidate_members();
+
   if(!collection->clone && query_change == DT_COLLECTION_CHANGE_NEW_QUERY
      && darktable.gui)
   {
@@ -0,0 +1,355 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/collection_index.h"
+#include "common/darktable.h"
+#include "common/database.h"
+#include "common/debug.h"
+#include "common/dtpthread.h"
+#include "common/ratings.h"
+
+#include <math.h>
+
+/* The range filters of the lighttable all group the images of the current
+   collection by one numeric column. Done in sql that is one GROUP BY query
+   over main.images per filter on every collection change. Here the image set
+   of the where clause is fetched once as a plain id list and shared by all
+   filters, the grouping is a scan of a dense column array.
+
+   Only these histograms and the min/max of the range filters are served from
+   here. The collection query itself (filter, sort and count) still runs in
+   sql, as do the date, color label and tag filters. */
+
+typedef struct dt_collection_index_t
+{
+  dt_pthread_mutex_t lock;
+  gboolean valid;
+
+  int32_t count;           // number of rows
+  int32_t capacity;        // allocated rows
+  int32_t max_id;
+  int32_t *row;            // image id -> row, -1 if not present
+  int32_t *id;             // row -> image id
+  double *col[DT_COLLECTION_INDEX_COLUMNS]; // NAN for sql NULL
+
+  // the image set of the last where clause
+  gchar *member_where;
+  uint8_t *member;
+} dt_collection_index_t;
+
+static dt_collection_index_t _index;
+
+static inline double _rating_from_flags(const int flags)
+{
+  return (flags & DT_IMAGE_REJECTED) ? -1.0 : (double)(flags & DT_VIEW_RATINGS_MASK);
+}
+
+static void _index_clear(void)
+{
+  g_free(_index.row);
+  _index.row = NULL;
+  g_free(_index.id);
+  _index.id = NULL;
+  for(int c = 0; c < DT_COLLECTION_INDEX_COLUMNS; c++)
+  {
+    g_free(_index.col[c]);
+    _index.col[c] = NULL;
+  }
+  g_free(_index.member);
+  _index.member = NULL;
+  g_free(_index.member_where);
+  _index.member_where = NULL;
+  _index.count = 0;
+  _index.capacity = 0;
+  _index.max_id = 0;
+  _index.valid = FALSE;
+}
+
+static void _index_load(void)
+{
+  const double start = dt_get_debug_wtime();
+  _index_clear();
+
+  sqlite3_stmt *stmt;
+  int32_t count = 0;
+  int32_t max_id = 0;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT COUNT(*), IFNULL(MAX(id), 0) FROM main.images",
+                              -1, &stmt, NULL);
+  if(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    count = sqlite3_column_int(stmt, 0);
+    max_id = sqlite3_column_int(stmt, 1);
+  }
+  sqlite3_finalize(stmt);
+
+  _index.row = g_new(int32_t, max_id + 1);
+  for(int32_t i = 0; i <= max_id; i++) _index.row[i] = -1;
+  _index.capacity = MAX(count, 1);
+  _index.id = g_new(int32_t, _index.capacity);
+  for(int c = 0; c < DT_COLLECTION_INDEX_COLUMNS; c++)
+    _index.col[c] = g_new(double, _index.capacity);
+  _index.member = g_new0(uint8_t, _index.capacity);
+
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT id, exposure, aperture, iso, focal_length,"
+                              "       exposure_bias, aspect_ratio, flags"
+                              " FROM main.images"
+                              " ORDER BY id",
+                              -1, &stmt, NULL);
+  // clang-format on
+  int32_t r = 0;
+  while(sqlite3_step(stmt) == SQLITE_ROW && r < count)
+  {
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    if(id <= 0 || id > max_id) continue;
+    _index.row[id] = r;
+    _index.id[r] = id;
+    for(int c = 0; c < DT_COLLECTION_INDEX_RATING; c++)
+      _index.col[c][r] = sqlite3_column_type(stmt, c + 1) == SQLITE_NULL
+                         ? NAN
+                         : sqlite3_column_double(stmt, c + 1);
+    _index.col[DT_COLLECTION_INDEX_RATING][r] = _rating_from_flags(sqlite3_column_int(stmt, 7));
+    r++;
+  }
+  sqlite3_finalize(stmt);
+
+  _index.count = r;
+  _index.max_id = max_id;
+  _index.valid = TRUE;
+
+  dt_print(DT_DEBUG_PERF, "[collection_index] loaded %d images in %.3fs",
+           r, dt_get_debug_wtime() - start);
+}
+
+void dt_collection_index_init(void)
+{
+  memset(&_index, 0, sizeof(_index));
+  dt_pthread_mutex_init(&_index.lock, NULL);
+}
+
+void dt_collection_index_cleanup(void)
+{
+  dt_pthread_mutex_lock(&_index.lock);
+  _index_clear();
+  dt_pthread_mutex_unlock(&_index.lock);
+  dt_pthread_mutex_destroy(&_index.lock);
+}
+
+// add a row for an image written after the snapshot was loaded
+static int32_t _index_append(const int32_t id)
+{
+  if(id > _index.max_id)
+  {
+    const int32_t max_id = MAX(id, 2 * _index.max_id);
+    _index.row = g_renew(int32_t, _index.row, max_id + 1);
+    for(int32_t i = _index.max_id + 1; i <= max_id; i++) _index.row[i] = -1;
+    _index.max_id = max_id;
+  }
+  if(_index.count == _index.capacity)
+  {
+    const int32_t capacity = MAX(2 * _index.capacity, 64);
+    _index.id = g_renew(int32_t, _index.id, capacity);
+    for(int c = 0; c < DT_COLLECTION_INDEX_COLUMNS; c++)
+      _index.col[c] = g_renew(double, _index.col[c], capacity);
+    _index.member = g_renew(uint8_t, _index.member, capacity);
+    _index.capacity = capacity;
+  }
+  const int32_t r = _index.count++;
+  _index.row[id] = r;
+  _index.id[r] = id;
+  _index.member[r] = 0;
+  return r;
+}
+
+void dt_collection_index_update_image(const dt_image_t *img)
+{
+  dt_pthread_mutex_lock(&_index.lock);
+  if(_index.valid && img->id > 0)
+  {
+    int32_t r = img->id <= _index.max_id ? _index.row[img->id] : -1;
+    if(r < 0) r = _index_append(img->id);
+
+    _index.col[DT_COLLECTION_INDEX_EXPOSURE][r] = img->exif_exposure;
+    _index.col[DT_COLLECTION_INDEX_APERTURE][r] = img->exif_aperture;
+    _index.col[DT_COLLECTION_INDEX_ISO][r] = img->exif_iso;
+    _index.col[DT_COLLECTION_INDEX_FOCAL_LENGTH][r] = img->exif_focal_length;
+    _index.col[DT_COLLECTION_INDEX_EXPOSURE_BIAS][r] = img->exif_exposure_bias;
+    _index.col[DT_COLLECTION_INDEX_ASPECT_RATIO][r] = img->aspect_ratio;
+    _index.col[DT_COLLECTION_INDEX_RATING][r] = _rating_from_flags(img->flags);
+    // the where clause might depend on any of these
+    g_free(_index.member_where);
+    _index.member_where = NULL;
+  }
+  dt_pthread_mutex_unlock(&_index.lock);
+}
+
+void dt_collection_index_remove_image(const dt_imgid_t imgid)
+{
+  dt_pthread_mutex_lock(&_index.lock);
+  const int32_t r = _index.valid && imgid > 0 && imgid <= _index.max_id ? _index.row[imgid] : -1;
+  if(r >= 0)
+  {
+    // move the last row into the gap to keep the columns dense
+    const int32_t last = --_index.count;
+    if(r != last)
+    {
+      for(int c = 0; c < DT_COLLECTION_INDEX_COLUMNS; c++)
+        _index.col[c][r] = _index.col[c][last];
+      _index.id[r] = _index.id[last];
+      _index.row[_index.id[r]] = r;
+    }
+    _index.row[imgid] = -1;
+    g_free(_index.member_where);
+    _index.member_where = NULL;
+  }
+  dt_pthread_mutex_unlock(&_index.lock);
+}
+
+void dt_collection_index_invalidate_members(void)
+{
+  dt_pthread_mutex_lock(&_index.lock);
+  g_free(_index.member_where);
+  _index.member_where = NULL;
+  dt_pthread_mutex_unlock(&_index.lock);
+}
+
+// fill the member flags for the where clause, returns FALSE if the
+// query returned an image the snapshot doesn't know yet
+static gboolean _index_members(const char *where)
+{
+  if(_index.member_where && !g_strcmp0(_index.member_where, where))
+    return TRUE;
+
+  memset(_index.member, 0, MAX(_index.count, 1));
+  g_free(_index.member_where);
+  _index.member_where = NULL;
+
+  gchar *query = g_strdup_printf("SELECT id FROM main.images AS mi WHERE %s", where);
+  sqlite3_stmt *stmt;
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  g_free(query);
+
+  gboolean known = TRUE;
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+  {
+    const int32_t id = sqlite3_column_int(stmt, 0);
+    const int32_t r = id > 0 && id <= _index.max_id ? _index.row[id] : -1;
+    if(r < 0)
+    {
+      known = FALSE;
+      break;
+    }
+    _index.member[r] = 1;
+  }
+  sqlite3_finalize(stmt);
+
+  if(known) _index.member_where = g_strdup(where);
+  return known;
+}
+
+static int _compare_double(const void *a, const void *b)
+{
+  const double x = *(const double *)a;
+  const double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+int dt_collection_index_histogram(const char *where,
+                                  const dt_collection_index_column_t column,
+                                  const int digits,
+                                  dt_collection_index_bin_t **bins)
+{
+  *bins = NULL;
+  dt_pthread_mutex_lock(&_index.lock);
+
+  if(!_index.valid) _index_load();
+  if(!_index_members(where))
+  {
+    // images were added behind our back, one reload is enough
+    _index_load();
+    _index_members(where);
+  }
+
+  const int32_t count = _index.count;
+  const double *const restrict col = _index.col[column];
+  const uint8_t *const restrict member = _index.member;
+  const double scale = digits >= 0 ? pow(10.0, digits) : 1.0;
+
+  double *values = g_new(double, MAX(count, 1));
+  int32_t nvalues = 0;
+  int32_t nnull = 0;
+  for(int32_t r = 0; r < count; r++)
+  {
+    if(!member[r]) continue;
+    const double v = col[r];
+    if(isnan(v))
+      nnull++;
+    else
+      values[nvalues++] = digits >= 0 ? round(v * scale) / scale : v;
+  }
+  dt_pthread_mutex_unlock(&_index.lock);
+
+  qsort(values, nvalues, sizeof(double), _compare_double);
+
+  dt_collection_index_bin_t *out = g_new(dt_collection_index_bin_t, nvalues + 1);
+  int nbins = 0;
+  if(nnull)
+    out[nbins++] = (dt_collection_index_bin_t){ 0.0, nnull };
+  for(int32_t k = 0; k < nvalues;)
+  {
+    int32_t e = k + 1;
+    while(e < nvalues && values[e] == values[k]) e++;
+    out[nbins++] = (dt_collection_index_bin_t){ values[k], e - k };
+    k = e;
+  }
+  g_free(values);
+
+  *bins = out;
+  return nbins;
+}
+
+void dt_collection_index_range(const dt_collection_index_column_t column,
+                               double *min,
+                               double *max)
+{
+  dt_pthread_mutex_lock(&_index.lock);
+  if(!_index.valid) _index_load();
+
+  double lo = INFINITY;
+  double hi = -INFINITY;
+  const double *const restrict col = _index.col[column];
+  for(int32_t r = 0; r < _index.count; r++)
+  {
+    // comparisons with NAN are false, missing values are skipped
+    if(col[r] < lo) lo = col[r];
+    if(col[r] > hi) hi = col[r];
+  }
+  dt_pthread_mutex_unlock(&_index.lock);
+
+  *min = lo <= hi ? lo : 0.0;
+  *max = lo <= hi ? hi : 0.0;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
+
@@ -0,0 +1,82 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/image.h"
+
+G_BEGIN_DECLS
+
+// In-memory column snapshot of the numeric image attributes used by the
+// range filters, it only serves their histograms and min/max. The database
+// stays the source of truth: the snapshot is loaded lazily with a single
+// query, kept current by the image cache write-through and image removal,
+// and reloaded if a query returns an image it doesn't know anyway.
+typedef enum dt_collection_index_column_t
+{
+  DT_COLLECTION_INDEX_EXPOSURE = 0,
+  DT_COLLECTION_INDEX_APERTURE,
+  DT_COLLECTION_INDEX_ISO,
+  DT_COLLECTION_INDEX_FOCAL_LENGTH,
+  DT_COLLECTION_INDEX_EXPOSURE_BIAS,
+  DT_COLLECTION_INDEX_ASPECT_RATIO,
+  DT_COLLECTION_INDEX_RATING,   // -1 for rejected, 0..5 otherwise
+  DT_COLLECTION_INDEX_COLUMNS
+} dt_collection_index_column_t;
+
+typedef struct dt_collection_index_bin_t
+{
+  double value;
+  int count;
+} dt_collection_index_bin_t;
+
+void dt_collection_index_init(void);
+void dt_collection_index_cleanup(void);
+
+// keep the snapshot in sync with an image written back to the database,
+// images not in the snapshot yet are added
+void dt_collection_index_update_image(const dt_image_t *img);
+// drop an image removed from the database
+void dt_collection_index_remove_image(const dt_imgid_t imgid);
+// forget the cached image set of the last where clause
+void dt_collection_index_invalidate_members(void);
+
+// count the images matching the where clause (evaluated against
+// main.images AS mi) per value of the column, rounded to the given
+// number of digits like sqlite ROUND() or not at all if digits < 0.
+// bins are sorted by value, missing values come first as 0.0 like
+// an sql GROUP BY would return them. returns the number of bins,
+// *bins has to be freed with g_free().
+int dt_collection_index_histogram(const char *where,
+                                  const dt_collection_index_column_t column,
+                                  const int digits,
+                                  dt_collection_index_bin_t **bins);
+
+// min and max of the column over the whole library, 0.0 if no image has a value
+void dt_collection_index_range(const dt_collection_index_column_t column,
+                               double *min,
+                               double *max);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
+
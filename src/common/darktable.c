@@ -26,6 +26,7 @@
 #endif
 
 #include "common/collection.h"
+#include "common/collection_index.h"
 #include "common/colorspaces.h"
 #include "common/darktable.h"
 #include "common/datetime.h"
@@ -1839,9 +1840,13 @@ int dt_init(int argc,
   // must come before mipmap_cache, because that one will need to access
   // image dimensions stored in here:
   dt_image_cache_init();
+  dt_collection_index_init();
 
   dt_mipmap_cache_init();
 
+  dt_dev_pixelpipe_cache_disk_init();
+  dt_masks_raster_cache_init();
+
   // set up the list of exiv2 metadata
   dt_exif_set_exiv2_taglist();
 
@@ -2019,6 +2024,10 @@ int dt_init(int argc,
   // fire up a background job to perform sidecar writes
   dt_control_sidecar_synch_start();
 
+  // finish bulk imports interrupted by quitting or a crash, needs the caches
+  if(init_gui)
+    dt_image_import_resume();
+
 #if defined(WIN32)
   dt_capabilities_add("windows");
   dt_capabilities_add("nonapple");
@@ -2179,7 +2188,10 @@ void dt_cleanup()
 
 
   dt_image_cache_cleanup();
+  dt_collection_index_cleanup();
   dt_mipmap_cache_cleanup();
+  dt_dev_pixelpipe_cache_disk_cleanup();
+  dt_masks_raster_cache_cleanup();
 
   dt_colorspaces_cleanup(darktable.color_profiles);
   dt_conf_cleanup(darktable.conf);
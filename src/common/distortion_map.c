@@ -0,0 +1,95 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/distortion_map.h"
+
+dt_distortion_map_t *dt_distortion_map_new(const dt_iop_roi_t *const roi,
+                                           const int step,
+                                           const int values,
+                                           dt_distortion_map_eval_t eval,
+                                           const void *data)
+{
+  dt_distortion_map_t *map = g_malloc0(sizeof(dt_distortion_map_t));
+  map->roi = *roi;
+  map->step = MAX(1, step);
+  map->values = values;
+  map->gwidth = (roi->width - 1) / map->step + 2;
+  map->gheight = (roi->height - 1) / map->step + 2;
+  map->grid = dt_alloc_align_float((size_t)map->gwidth * map->gheight * values);
+  if(!map->grid)
+  {
+    g_free(map);
+    return NULL;
+  }
+
+  const int gwidth = map->gwidth;
+  const int mstep = map->step;
+  float *const grid = map->grid;
+  DT_OMP_FOR(collapse(2))
+  for(int j = 0; j < map->gheight; j++)
+    for(int i = 0; i < gwidth; i++)
+      eval(roi->x + i * mstep, roi->y + j * mstep,
+           grid + ((size_t)j * gwidth + i) * values, data);
+
+  return map;
+}
+
+void dt_distortion_map_free(dt_distortion_map_t *map)
+{
+  if(!map) return;
+  dt_free_align(map->grid);
+  g_free(map);
+}
+
+void dt_distortion_map_row(const dt_distortion_map_t *const map,
+                           const int x0,
+                           const int y,
+                           const int width,
+                           float *const out)
+{
+  const int step = map->step;
+  const int values = map->values;
+  const size_t gstride = (size_t)map->gwidth * values;
+  const int j = y / step;
+  const float fy = (float)(y - j * step) / step;
+  const float *const g0 = map->grid + j * gstride;
+  const float *const g1 = g0 + gstride;
+
+  for(int k = 0; k < width; k++)
+  {
+    const int x = x0 + k;
+    const int i = x / step;
+    const float fx = (float)(x - i * step) / step;
+    const float *const a = g0 + (size_t)i * values;
+    const float *const b = g1 + (size_t)i * values;
+    float *const o = out + (size_t)k * values;
+    for(int c = 0; c < values; c++)
+    {
+      const float top = a[c] + fx * (a[c + values] - a[c]);
+      const float bottom = b[c] + fx * (b[c + values] - b[c]);
+      o[c] = top + fy * (bottom - top);
+    }
+  }
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
+
@@ -0,0 +1,71 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/darktable.h"
+#include "develop/pixelpipe.h"
+
+G_BEGIN_DECLS
+
+// Coordinate map of a smooth distortion. The source coordinates are
+// evaluated on a sparse grid over the output area and bilinearly
+// interpolated in between. A module builds it over the whole output at
+// the current scale and keeps it as long as its parameters and the scale
+// don't change, any roi within is read by offset.
+typedef struct dt_distortion_map_t
+{
+  dt_hash_t hash;      // set by the owner to what the map was built for
+  dt_iop_roi_t roi;    // output area covered
+  int step;            // grid spacing in pixels
+  int gwidth, gheight; // number of grid points
+  int values;          // floats per point
+  float *grid;
+} dt_distortion_map_t;
+
+// write the `values` source coordinates of output position (x, y) to out
+typedef void (*dt_distortion_map_eval_t)(const float x,
+                                         const float y,
+                                         float *out,
+                                         const void *data);
+
+// build the map for roi, the grid reaches one step beyond the right and
+// bottom border so every pixel has four grid neighbours
+dt_distortion_map_t *dt_distortion_map_new(const dt_iop_roi_t *const roi,
+                                           const int step,
+                                           const int values,
+                                           dt_distortion_map_eval_t eval,
+                                           const void *data);
+void dt_distortion_map_free(dt_distortion_map_t *map);
+
+// interpolate width pixels of row y starting at x0 (both relative to map->roi)
+// into out, width * values floats. the span has to be within map->roi.
+void dt_distortion_map_row(const dt_distortion_map_t *const map,
+                           const int x0,
+                           const int y,
+                           const int width,
+                           float *const out);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
+
@@ -5991,6 +5991,15 @@ gboolean dt_exif_xmp_attach_export(const dt_imgid_t imgid,
 }
 
 // Write XMP sidecar file: returns TRUE in case of errors.
+//
+// Only the exiv2 parsing and serialization run under the exiv2 lock,
+// reading the old sidecar and writing the new one are done outside of
+// it so that several sidecars can be written in parallel. The new
+// content goes to a temporary file next to the sidecar which is then
+// renamed over it, a crash or a full disk never leaves a truncated XMP.
+// The temporary file gets the permissions of the old sidecar. Symlinked
+// or hardlinked sidecars are overwritten in place as before, the rename
+// would replace the link by a plain file.
 gboolean dt_exif_xmp_write(const dt_imgid_t imgid,
                            const char *filename,
                            const gboolean force_write)
@@ -6004,7 +6013,6 @@ gboolean dt_exif_xmp_write(const dt_imgid_t imgid,
 
   try
   {
-    Lock lock;
     Exiv2::XmpData xmpData;
     std::string xmpPacket;
     char *checksum_old = NULL;
@@ -6017,40 +6025,45 @@ gboolean dt_exif_xmp_write(const dt_imgid_t imgid,
       // to find changed sidecars.
       errno = 0;
       size_t end;
-      unsigned char *content = (unsigned char*)dt_read_file(filename, &end);
+      char *content = dt_read_file(filename, &end);
       if(content)
       {
-        checksum_old = g_compute_checksum_for_data(G_CHECKSUM_MD5, content, end);
+        checksum_old = g_compute_checksum_for_data(G_CHECKSUM_MD5,
+                                                   (unsigned char*)content, end);
+        xmpPacket.assign(content, end);
         free(content);
       }
       else
       {
+        // don't replace what we couldn't read by our data only
         dt_print(DT_DEBUG_ALWAYS,
                  "cannot read XMP file '%s': '%s'", filename, strerror(errno));
         dt_control_log(_("cannot read XMP file '%s': '%s'"), filename, strerror(errno));
+        return TRUE;
       }
+    }
 
-      Exiv2::DataBuf buf = Exiv2::readFile(WIDEN(filename));
-#if EXIV2_TEST_VERSION(0,28,0)
-      xmpPacket.assign(buf.c_str(), buf.size());
-#else
-      xmpPacket.assign(reinterpret_cast<char *>(buf.pData_), buf.size_);
-#endif
-      Exiv2::XmpParser::decode(xmpData, xmpPacket);
+    {
+      Lock lock;
+      if(!xmpPacket.empty())
+      {
+        Exiv2::XmpParser::decode(xmpData, xmpPacket);
 
-      // Because XmpSeq or XmpBag are added to the list, we first have to
-      // remove these so that we don't end up with a string of duplicates.
-      _remove_known_keys(xmpData);
-    }
+        // Because XmpSeq or XmpBag are added to the list, we first have to
+        // remove these so that we don't end up with a string of duplicates.
+        _remove_known_keys(xmpData);
+      }
 
-    // Initialize xmp data:
-    _exif_xmp_read_data(xmpData, imgid, "dt_exif_xmp_write");
+      // Initialize xmp data:
+      _exif_xmp_read_data(xmpData, imgid, "dt_exif_xmp_write");
 
-    // Serialize the xmp data and output the xmp packet.
-    if(Exiv2::XmpParser::encode(xmpPacket, xmpData,
-       Exiv2::XmpParser::useCompactFormat | Exiv2::XmpParser::omitPacketWrapper) != 0)
-    {
-      throw Exiv2::Error(Exiv2::ErrorCode::kerErrorMessage, "[xmp_write] failed to serialize xmp data");
+      // Serialize the xmp data and output the xmp packet.
+      if(Exiv2::XmpParser::encode(xmpPacket, xmpData,
+         Exiv2::XmpParser::useCompactFormat | Exiv2::XmpParser::omitPacketWrapper) != 0)
+      {
+        g_free(checksum_old);
+        throw Exiv2::Error(Exiv2::ErrorCode::kerErrorMessage, "[xmp_write] failed to serialize xmp data");
+      }
     }
 
     // Hash the new data and compare it to the old hash (if applicable).
@@ -6074,15 +6087,43 @@ gboolean dt_exif_xmp_write(const dt_imgid_t imgid,
     {
       // Using std::ofstream isn't possible here -- on Windows it
       // doesn't support Unicode filenames with mingw.
+      // The temporary name is unique per writer, a concurrent write of
+      // the same sidecar (bulk job and sidecar service) just wins the
+      // last rename instead of interleaving.
+      GStatBuf st;
+      const gboolean exists = g_lstat(filename, &st) == 0;
+#ifdef _WIN32
+      const gboolean in_place = FALSE;
+#else
+      const gboolean in_place = exists && (S_ISLNK(st.st_mode) || st.st_nlink > 1);
+#endif
+      gchar *tmpname = in_place
+        ? g_strdup(filename)
+        : g_strdup_printf("%s.%08x.tmp", filename, g_random_int());
       errno = 0;
-      FILE *fout = g_fopen(filename, "wb");
+      gboolean failed = TRUE;
+      FILE *fout = g_fopen(tmpname, "wb");
       if(fout)
       {
-        fprintf(fout, "%s", xml_header);
-        fprintf(fout, "%s", xmpPacket.c_str());
-        fclose(fout);
+        failed = fputs(xml_header, fout) < 0
+                 || fputs(xmpPacket.c_str(), fout) < 0
+                 || fflush(fout) != 0;
+        failed = (fclose(fout) != 0) || failed;
+        if(!failed && !in_place)
+        {
+          if(exists) g_chmod(tmpname, st.st_mode & 07777);
+          failed = g_rename(tmpname, filename) != 0;
+        }
+        if(failed && !in_place)
+        {
+          const int err = errno;
+          g_unlink(tmpname);
+          errno = err;
+        }
       }
-      else
+      g_free(tmpname);
+
+      if(failed)
       {
         dt_print(DT_DEBUG_ALWAYS,
                  "cannot write XMP file '%s': '%s'", filename, strerror(errno));
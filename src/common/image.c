@@ -18,6 +18,7 @@
 
 #include "common/image.h"
 #include "common/collection.h"
+#include "common/collection_index.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
@@ -1590,6 +1591,8 @@ void dt_image_remove(const dt_imgid_t imgid)
   sqlite3_step(stmt);
   sqlite3_finalize(stmt);
 
+  dt_collection_index_remove_image(imgid);
+
   // also clear all thumbnails in mipmap_cache.
   dt_mipmap_cache_remove(imgid);
 
@@ -1793,11 +1796,38 @@ static int _image_read_duplicates(const uint32_t id,
   return count_xmps_processed;
 }
 
+// the non-essential part of an import: lightroom data, the format tag and the sidecar
+static void _image_import_sidecars(const dt_imgid_t id,
+                                   const char *filename,
+                                   const char *ext,
+                                   const gboolean no_xmp)
+{
+  if(no_xmp)
+  {
+    // Search for Lightroom sidecar file, import tags if found
+    const gboolean lr_xmp = dt_lightroom_import(id, NULL, TRUE);
+    // Make sure that lightroom xmp data (label in particular) are saved in dt xmp
+    if(lr_xmp)
+      dt_image_synch_xmp(id);
+  }
+
+  // add a tag with the file extension
+  guint tagid = 0;
+  char tagname[512];
+  snprintf(tagname, sizeof(tagname), "darktable|format|%s", ext);
+  dt_tag_new(tagname, &tagid);
+  dt_tag_attach(tagid, id, FALSE, FALSE);
+
+  // Always keep write timestamp in database and possibly write xmp
+  dt_image_synch_all_xmp(filename);
+}
+
 static dt_imgid_t _image_import_internal(const dt_filmid_t film_id,
                                          const char *filename,
                                          const gboolean override_ignore_nonraws,
                                          const gboolean lua_locking,
-                                         const gboolean raise_signals)
+                                         const gboolean raise_signals,
+                                         const gboolean deferred)
 {
   char *normalized_filename = dt_util_normalize_path(filename);
   if(!normalized_filename || !dt_util_test_image_file(normalized_filename))
@@ -2019,6 +2049,8 @@ static dt_imgid_t _image_import_internal(const dt_filmid_t film_id,
   if(img)
   {
     img->group_id = group_id;
+    // persisted with the image, see dt_image_import_resume()
+    if(deferred) img->flags |= DT_IMAGE_IMPORT_PENDING;
 
     // read dttags and exif for database queries!
     if(dt_exif_read(img, normalized_filename))
@@ -2036,29 +2068,14 @@ static dt_imgid_t _image_import_internal(const dt_filmid_t film_id,
   // read all sidecar files
   const int nb_xmp = _image_read_duplicates(id, normalized_filename, raise_signals);
 
-  if(res && (nb_xmp == 0))
-  {
-    // Search for Lightroom sidecar file, import tags if found
-    const gboolean lr_xmp = dt_lightroom_import(id, NULL, TRUE);
-    // Make sure that lightroom xmp data (label in particular) are saved in dt xmp
-    if(lr_xmp)
-      dt_image_synch_xmp(id);
-  }
-
-  // add a tag with the file extension
-  guint tagid = 0;
-  char tagname[512];
-  snprintf(tagname, sizeof(tagname), "darktable|format|%s", ext);
+  // the bulk import leaves the rest to dt_image_import_finish()
+  if(!deferred)
+    _image_import_sidecars(id, normalized_filename, ext, res && (nb_xmp == 0));
   g_free(ext);
-  dt_tag_new(tagname, &tagid);
-  dt_tag_attach(tagid, id, FALSE, FALSE);
 
   // make sure that there are no stale thumbnails left
   dt_mipmap_cache_remove(id);
 
-  // Always keep write timestamp in database and possibly write xmp
-  dt_image_synch_all_xmp(normalized_filename);
-
   g_free(imgfname);
   g_free(basename);
   g_free(sql_pattern);
@@ -2143,14 +2160,195 @@ dt_imgid_t dt_image_import(const dt_filmid_t film_id,
                            const gboolean raise_signals)
 {
   return _image_import_internal(film_id, filename, override_ignore_nonraws,
-                                TRUE, raise_signals);
+                                TRUE, raise_signals, FALSE);
 }
 
 dt_imgid_t dt_image_import_lua(const dt_filmid_t film_id,
                                const char *filename,
                                const gboolean override_ignore_nonraws)
 {
-  return _image_import_internal(film_id, filename, override_ignore_nonraws, FALSE, TRUE);
+  return _image_import_internal(film_id, filename, override_ignore_nonraws, FALSE, TRUE, FALSE);
+}
+
+/* Bulk import.
+   The images are inserted in large transactions, a pool of threads reads the files
+   ahead of the import so exiv2 finds the metadata in the page cache. Looking for
+   lightroom sidecars, the format tag and writing our sidecars is done afterwards
+   by a background job, the images are in the collection before that.
+*/
+#define DT_IMPORT_BULK_BATCH 256
+#define DT_IMPORT_PREFETCH_SIZE (1 << 20)
+
+struct dt_image_import_bulk_t
+{
+  GThreadPool *prefetch;
+  GList *ahead;
+  GList *imported;
+  int pending;
+};
+
+static void _import_prefetch(gpointer data, gpointer user_data)
+{
+  gchar *filename = data;
+  FILE *f = g_fopen(filename, "rb");
+  if(f)
+  {
+    // the metadata of all supported formats is close to the start of the file
+    char buf[65536];
+    size_t total = 0;
+    size_t n;
+    while(total < DT_IMPORT_PREFETCH_SIZE && (n = fread(buf, 1, sizeof(buf), f)) > 0)
+      total += n;
+    fclose(f);
+  }
+  g_free(filename);
+}
+
+static void _import_bulk_push(dt_image_import_bulk_t *bulk)
+{
+  if(!bulk->ahead) return;
+  if(bulk->prefetch)
+    g_thread_pool_push(bulk->prefetch, g_strdup(bulk->ahead->data), NULL);
+  bulk->ahead = g_list_next(bulk->ahead);
+}
+
+dt_image_import_bulk_t *dt_image_import_bulk_new(GList *files)
+{
+  dt_image_import_bulk_t *bulk = g_malloc0(sizeof(dt_image_import_bulk_t));
+  const int threads = CLAMP(dt_get_num_threads(), 2, 8);
+  bulk->prefetch = g_thread_pool_new(_import_prefetch, NULL, threads, FALSE, NULL);
+  bulk->ahead = files;
+  for(int k = 0; k < 4 * threads; k++)
+    _import_bulk_push(bulk);
+  return bulk;
+}
+
+dt_imgid_t dt_image_import_bulk(dt_image_import_bulk_t *bulk,
+                                const dt_filmid_t film_id,
+                                const char *filename,
+                                const gboolean override_ignore_nonraws)
+{
+  _import_bulk_push(bulk);
+
+  if(bulk->pending == 0)
+    dt_database_start_transaction(darktable.db);
+
+  const dt_imgid_t id = _image_import_internal(film_id, filename, override_ignore_nonraws,
+                                               TRUE, FALSE, TRUE);
+  if(dt_is_valid_imgid(id))
+    bulk->imported = g_list_prepend(bulk->imported, GINT_TO_POINTER(id));
+
+  if(++bulk->pending >= DT_IMPORT_BULK_BATCH)
+    dt_image_import_bulk_commit(bulk);
+  return id;
+}
+
+void dt_image_import_bulk_commit(dt_image_import_bulk_t *bulk)
+{
+  if(bulk->pending == 0) return;
+  dt_database_release_transaction(darktable.db);
+  bulk->pending = 0;
+}
+
+static int32_t _import_finish_job_run(dt_job_t *job)
+{
+  GList *imgs = dt_control_job_get_params(job);
+  const guint total = g_list_length(imgs);
+  dt_control_job_set_progress_message(job, ngettext("finishing import of %d image",
+                                                    "finishing import of %d images", total), total);
+  int count = 0;
+  for(GList *l = imgs; l && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED; l = g_list_next(l))
+  {
+    if(count % DT_IMPORT_BULK_BATCH == 0)
+      dt_database_start_transaction(darktable.db);
+
+    dt_image_import_finish(GPOINTER_TO_INT(l->data));
+
+    if(++count % DT_IMPORT_BULK_BATCH == 0)
+    {
+      dt_database_release_transaction(darktable.db);
+      dt_control_job_set_progress(job, (double)count / total);
+    }
+  }
+  if(count % DT_IMPORT_BULK_BATCH)
+    dt_database_release_transaction(darktable.db);
+
+  DT_CONTROL_SIGNAL_RAISE(DT_SIGNAL_TAG_CHANGED);
+  return 0;
+}
+
+static void _import_finish_job_cleanup(void *p)
+{
+  g_list_free(p);
+}
+
+// takes ownership of imgs. whatever doesn't get done stays flagged for the next start.
+static void _import_finish_queue(GList *imgs)
+{
+  if(!imgs) return;
+  dt_job_t *job = dt_control_job_create(&_import_finish_job_run, "finish import");
+  if(job)
+  {
+    dt_control_job_set_params(job, imgs, _import_finish_job_cleanup);
+    dt_control_add_job(DT_JOB_QUEUE_SYSTEM_BG, job);
+  }
+  else
+    g_list_free(imgs);
+}
+
+void dt_image_import_bulk_free(dt_image_import_bulk_t *bulk)
+{
+  if(!bulk) return;
+  dt_image_import_bulk_commit(bulk);
+  // drop what hasn't been read ahead yet
+  g_thread_pool_free(bulk->prefetch, TRUE, TRUE);
+
+  _import_finish_queue(g_list_reverse(bulk->imported));
+  g_free(bulk);
+}
+
+void dt_image_import_resume(void)
+{
+  GList *imgs = NULL;
+  sqlite3_stmt *stmt;
+  // clang-format off
+  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
+                              "SELECT id FROM main.images"
+                              " WHERE (flags & ?1) = ?1"
+                              " ORDER BY id DESC",
+                              -1, &stmt, NULL);
+  // clang-format on
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, DT_IMAGE_IMPORT_PENDING);
+  while(sqlite3_step(stmt) == SQLITE_ROW)
+    imgs = g_list_prepend(imgs, GINT_TO_POINTER(sqlite3_column_int(stmt, 0)));
+  sqlite3_finalize(stmt);
+
+  if(imgs)
+    dt_print(DT_DEBUG_ALWAYS, "[image_import] finishing the import of %d images of an earlier session",
+             g_list_length(imgs));
+  _import_finish_queue(imgs);
+}
+
+void dt_image_import_finish(const dt_imgid_t imgid)
+{
+  char filename[PATH_MAX] = { 0 };
+  dt_image_full_path(imgid, filename, sizeof(filename), NULL);
+  if(!filename[0]) return;
+
+  const char *cc = filename + strlen(filename);
+  for(; *cc != '.' && cc > filename; cc--)
+    ;
+  gchar *ext = g_ascii_strdown(cc + 1, -1);
+
+  // same as at import time, the lightroom data is only used if there was no sidecar of ours
+  GList *xmps = dt_image_find_duplicates(filename);
+  _image_import_sidecars(imgid, filename, ext, xmps == NULL);
+  g_list_free_full(xmps, g_free);
+  g_free(ext);
+
+  dt_image_t *img = dt_image_cache_get(imgid, 'w');
+  if(img) img->flags &= ~DT_IMAGE_IMPORT_PENDING;
+  dt_image_cache_write_release(img, DT_IMAGE_CACHE_RELAXED);
 }
 
 void dt_image_init(dt_image_t *img)
@@ -101,6 +101,9 @@ typedef enum
   DT_IMAGE_MONOCHROME_BAYER = 1 << 19,
   // image has a flag set to use the monochrome workflow in the modules supporting it
   DT_IMAGE_MONOCHROME_WORKFLOW = 1 << 20,
+  // set by the bulk import until dt_image_import_finish() has been run,
+  // an interrupted session finishes these on the next start
+  DT_IMAGE_IMPORT_PENDING = 1 << 21,
 } dt_image_flags_t;
 
 typedef enum dt_image_colorspace_t
@@ -453,6 +456,25 @@ dt_imgid_t dt_image_import(dt_filmid_t film_id,
 dt_imgid_t dt_image_import_lua(const dt_filmid_t film_id,
                                const char *filename,
                                const gboolean override_ignore_nonraws);
+/** bulk import of many files, see dt_image_import_bulk_new() */
+typedef struct dt_image_import_bulk_t dt_image_import_bulk_t;
+/** start a bulk import of the given list of filenames, the files are read ahead in that order.
+ * the list must stay valid until dt_image_import_bulk_free() */
+dt_image_import_bulk_t *dt_image_import_bulk_new(GList *files);
+/** like dt_image_import() without raising signals. the database writes are batched into
+ * transactions, lightroom data, the format tag and the sidecar are left to a background job */
+dt_imgid_t dt_image_import_bulk(dt_image_import_bulk_t *bulk,
+                                const dt_filmid_t film_id,
+                                const char *filename,
+                                const gboolean override_ignore_nonraws);
+/** commit the pending transaction, call before updating the collection */
+void dt_image_import_bulk_commit(dt_image_import_bulk_t *bulk);
+/** commit and start the background job finishing the imported images */
+void dt_image_import_bulk_free(dt_image_import_bulk_t *bulk);
+/** the part of an import deferred by dt_image_import_bulk() */
+void dt_image_import_finish(const dt_imgid_t imgid);
+/** finish the imports left over by an earlier session in the background */
+void dt_image_import_resume(void);
 /** removes the given image from the database. */
 void dt_image_remove(const dt_imgid_t imgid);
 /** duplicates the given image in the database with the duplicate
@@ -17,6 +17,7 @@
 */
 
 #include "common/image_cache.h"
+#include "common/collection_index.h"
 #include "common/darktable.h"
 #include "common/debug.h"
 #include "common/exif.h"
@@ -234,9 +235,9 @@ void dt_image_cache_cleanup()
   if(!cache) return;
   dt_print(DT_DEBUG_CACHE,
            "[image cache cleaup report] fill %.2f/%.2f MB (%.2f%%)",
-           cache->cache.cost / (1024.0 * 1024.0),
+           dt_cache_get_cost(&cache->cache) / (1024.0 * 1024.0),
            cache->cache.cost_quota / (1024.0 * 1024.0),
-           (float)cache->cache.cost / (float)cache->cache.cost_quota);
+           (float)dt_cache_get_cost(&cache->cache) / (float)cache->cache.cost_quota);
   dt_cache_cleanup(&cache->cache);
   free(cache);
   darktable.image_cache = NULL;
@@ -425,6 +426,8 @@ void dt_image_cache_write_release_info(dt_image_t *img,
              img->id);
   sqlite3_finalize(stmt);
 
+  dt_collection_index_update_image(img);
+
   if(mode == DT_IMAGE_CACHE_SAFE)
     dt_image_synch_xmp(img->id);
 
@@ -1008,6 +1008,63 @@ static gboolean _prepare_resampling_plan(const dt_interpolation_t *itor,
   return FALSE;
 }
 
+/** The kernels are separable, so the output is computed line by line in two passes:
+ *  the input lines contributing to an output line are first combined into one line
+ *  holding only the columns the horizontal plan refers to, this streams through
+ *  contiguous memory and vectorizes. The horizontal plan is then applied to that
+ *  line which stays in cache. Compared to applying the full 2D kernel per output
+ *  pixel this reduces the work for a downscale by factor f from (2wf)^2 to about
+ *  2wf(f + 1) multiply-adds per output pixel and channel.
+ */
+
+// range of input columns referenced by a horizontal plan
+static void _plan_index_range(const int *const length,
+                              const int *const index,
+                              const int out,
+                              int *first,
+                              int *last)
+{
+  size_t n = 0;
+  for(int x = 0; x < out; x++)
+    n += length[x];
+
+  int lo = INT_MAX;
+  int hi = INT_MIN;
+  for(size_t k = 0; k < n; k++)
+  {
+    lo = MIN(lo, index[k]);
+    hi = MAX(hi, index[k]);
+  }
+  *first = lo;
+  *last = hi;
+}
+
+// vertical pass: weighted sum of the lines of a vertical plan entry
+static inline void _resample_lines(float *const restrict line,
+                                   const float *const restrict in,
+                                   const size_t in_stride_floats,
+                                   const size_t offset,
+                                   const size_t nfloats,
+                                   const int *const restrict vindex,
+                                   const float *const restrict vkernel,
+                                   const int vl)
+{
+  const float *const restrict first = in + (size_t)vindex[0] * in_stride_floats + offset;
+  const float tap0 = vkernel[0];
+  DT_OMP_SIMD(aligned(line:64))
+  for(size_t k = 0; k < nfloats; k++)
+    line[k] = first[k] * tap0;
+
+  for(int iy = 1; iy < vl; iy++)
+  {
+    const float *const restrict src = in + (size_t)vindex[iy] * in_stride_floats + offset;
+    const float tap = vkernel[iy];
+    DT_OMP_SIMD(aligned(line:64))
+    for(size_t k = 0; k < nfloats; k++)
+      line[k] += src[k] * tap;
+  }
+}
+
 /** Applies resampling (re-scaling) on *full* input and output buffers.
  *  roi_in and roi_out define the part of the buffers that is affected.
  */
@@ -1086,78 +1143,55 @@ void dt_interpolation_resample(const dt_interpolation_t *itor,
                               &vlength, &vkernel, &vindex, &vmeta))
     goto exit;
 
+  int xfirst, xlast;
+  _plan_index_range(hlength, hindex, roi_out->width, &xfirst, &xlast);
+  const size_t line_floats = (size_t)4 * (xlast - xfirst + 1);
+  size_t padded_line;
+  float *const lines = dt_alloc_perthread_float(line_floats, &padded_line);
+  if(!lines)
+    goto exit;
+
   dt_get_perf_times(&mid);
 
   // Process each output line
   DT_OMP_FOR()
-  for(size_t oy = 0; oy < (size_t)roi_out->height; oy++)
+  for(int oy = 0; oy < roi_out->height; oy++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
+    float *const restrict line = dt_get_perthread(lines, padded_line);
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
+    // Combine the input lines contributing to this output line
+    _resample_lines(line, in, in_stride_floats, (size_t)4 * xfirst, line_floats,
+                    vindex + vmeta[3 * oy + 2], vkernel + vmeta[3 * oy + 1],
+                    vlength[vmeta[3 * oy + 0]]);
 
-    // Process each output column
-    for(size_t ox = 0; ox < (size_t)roi_out->width; ox++)
+    // and resample it horizontally
+    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
+    float *const restrict o = out + (size_t)oy * out_stride_floats;
+    for(int ox = 0; ox < roi_out->width; ox++)
     {
       // This will hold the resulting pixel
       dt_aligned_pixel_t vs = { 0.0f, 0.0f, 0.0f, 0.0f };
 
       // Number of horizontal samples contributing to the output
-      int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(size_t iy = 0; iy < vl; iy++)
+      const int hl = hlength[ox];
+      for(int ix = 0; ix < hl; ix++, hkidx++)
       {
-        // This is our input line
-        size_t baseidx_vindex = (size_t)vindex[viidx++] * in_stride_floats;
-
-        dt_aligned_pixel_t vhs = { 0.0f, 0.0f, 0.0f, 0.0f };
-
-        for(size_t ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          const size_t baseidx = baseidx_vindex + (size_t)hindex[hkidx] * 4;
-          const float htap = hkernel[hkidx++];
-          dt_aligned_pixel_t tmp;
-          copy_pixel(tmp, in + baseidx);
-          for_each_channel(c, aligned(tmp,vhs:16))
-            vhs[c] += tmp[c] * htap;
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        for_each_channel(c, aligned(vhs,vs:16)) vs[c] += vhs[c] * vtap;
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
+        const float *const px = line + (size_t)4 * (hindex[hkidx] - xfirst);
+        const float htap = hkernel[hkidx];
+        for_each_channel(c, aligned(vs:16))
+          vs[c] += px[c] * htap;
       }
 
-      // Output pixel is ready
-      const size_t baseidx = (size_t)oy * out_stride_floats + (size_t)ox * 4;
-
       // Clip negative RGB that may be produced by Lanczos undershooting
       // Negative RGB are invalid values no matter the RGB space (light is positive)
       dt_aligned_pixel_t pixel;
       for_each_channel(c, aligned(vs:16))
         pixel[c] = MAX(vs[c], 0.f);
-      copy_pixel_nontemporal(out + baseidx, pixel);
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hkidx += hl;
+      copy_pixel_nontemporal(o + (size_t)4 * ox, pixel);
     }
   }
   dt_omploop_sfence();
+  dt_free_align(lines);
 
 exit:
   /* Free the resampling plans. It's nasty to optimize allocs like that, but
@@ -1510,72 +1544,43 @@ void dt_interpolation_resample_1c(const dt_interpolation_t *itor,
     goto exit;
   }
 
+  int xfirst, xlast;
+  _plan_index_range(hlength, hindex, roi_out->width, &xfirst, &xlast);
+  const size_t line_floats = xlast - xfirst + 1;
+  size_t padded_line;
+  float *const lines = dt_alloc_perthread_float(line_floats, &padded_line);
+  if(!lines)
+  {
+    error = TRUE;
+    goto exit;
+  }
+
   dt_get_perf_times(&mid);
 
   // Process each output line
   DT_OMP_FOR()
   for(int oy = 0; oy < roi_out->height; oy++)
   {
-    // Initialize column resampling indexes
-    int vlidx = vmeta[3 * oy + 0]; // V(ertical) L(ength) I(n)d(e)x
-    int vkidx = vmeta[3 * oy + 1]; // V(ertical) K(ernel) I(n)d(e)x
-    int viidx = vmeta[3 * oy + 2]; // V(ertical) I(ndex) I(n)d(e)x
-
-    // Initialize row resampling indexes
-    int hlidx = 0; // H(orizontal) L(ength) I(n)d(e)x
-    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
-    int hiidx = 0; // H(orizontal) I(ndex) I(n)d(e)x
+    float *const restrict line = dt_get_perthread(lines, padded_line);
 
-    // Number of lines contributing to the output line
-    int vl = vlength[vlidx++]; // V(ertical) L(ength)
+    // Combine the input lines contributing to this output line
+    _resample_lines(line, in, roi_in->width, xfirst, line_floats,
+                    vindex + vmeta[3 * oy + 2], vkernel + vmeta[3 * oy + 1],
+                    vlength[vmeta[3 * oy + 0]]);
 
-    // Process each output column
+    // and resample it horizontally
+    int hkidx = 0; // H(orizontal) K(ernel) I(n)d(e)x
+    float *const restrict o = (float *)((char *)out + (size_t)oy * out_stride);
     for(int ox = 0; ox < roi_out->width; ox++)
     {
-      // This will hold the resulting pixel
       float vs = 0.0f;
-
-      // Number of horizontal samples contributing to the output
-      const int hl = hlength[hlidx++]; // H(orizontal) L(ength)
-
-      for(int iy = 0; iy < vl; iy++)
-      {
-        // This is our input line
-        const float *i = (float *)((char *)in + in_stride * vindex[viidx++]);
-
-        float vhs = 0.0f;
-
-        for(int ix = 0; ix < hl; ix++)
-        {
-          // Apply the precomputed filter kernel
-          const size_t baseidx = (size_t)hindex[hiidx++];
-          const float htap = hkernel[hkidx++];
-          vhs += i[baseidx] * htap;
-        }
-
-        // Accumulate contribution from this line
-        const float vtap = vkernel[vkidx++];
-        vs += vhs * vtap;
-
-        // Reset horizontal resampling context
-        hkidx -= hl;
-        hiidx -= hl;
-      }
-
-      // Output pixel is ready
-      float *o = (float *)((char *)out + (size_t)oy * out_stride
-                           + (size_t)ox * sizeof(float));
-      *o = vs;
-
-      // Reset vertical resampling context
-      viidx -= vl;
-      vkidx -= vl;
-
-      // Progress in horizontal context
-      hiidx += hl;
-      hkidx += hl;
+      const int hl = hlength[ox];
+      for(int ix = 0; ix < hl; ix++, hkidx++)
+        vs += line[hindex[hkidx] - xfirst] * hkernel[hkidx];
+      o[ox] = vs;
     }
   }
+  dt_free_align(lines);
 
   exit:
   if(error)
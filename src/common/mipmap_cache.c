@@ -23,6 +23,7 @@
 #include "common/file_location.h"
 #include "common/grealpath.h"
 #include "common/image_cache.h"
+#include "common/mipmap_pack.h"
 #include "control/conf.h"
 #include "control/jobs.h"
 #include "develop/imageop_math.h"
@@ -63,7 +64,10 @@ typedef enum dt_mipmap_buffer_dsc_flags
 {
   DT_MIPMAP_BUFFER_DSC_FLAG_NONE = 0,
   DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE = 1 << 0,
-  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1
+  DT_MIPMAP_BUFFER_DSC_FLAG_INVALIDATE = 1 << 1,
+  // embedded preview standing in until the processed thumbnail is ready,
+  // never written to the disk backend
+  DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL = 1 << 2
 } dt_mipmap_buffer_dsc_flags;
 
 // the embedded Exif data to tag thumbnails as sRGB or AdobeRGB
@@ -389,7 +393,15 @@ static void _init_8(uint8_t *buf,
                     float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space,
                     const dt_imgid_t imgid,
-                    const dt_mipmap_size_t size);
+                    const dt_mipmap_size_t size,
+                    gboolean *provisional);
+static gboolean _init_8_pipe(uint8_t *buf,
+                             uint32_t *width,
+                             uint32_t *height,
+                             float *iscale,
+                             dt_colorspaces_color_profile_type_t *color_space,
+                             const dt_imgid_t imgid,
+                             const dt_mipmap_size_t size);
 
 // callback for the imageio core to allocate memory.
 // only needed for _F and _FULL buffers, as they change size
@@ -455,6 +467,14 @@ void *dt_mipmap_cache_alloc(dt_mipmap_buffer_t *buf, const dt_image_t *img)
   return dsc + 1;
 }
 
+static inline gboolean _disk_backend_enabled(const dt_mipmap_cache_t *cache,
+                                            const dt_mipmap_size_t mip)
+{
+  return cache->cachedir[0]
+    && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
+        || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8));
+}
+
 // callback for the cache backend to initialize payload pointers
 static void _mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
 {
@@ -518,8 +538,26 @@ static void _mipmap_cache_allocate_dynamic(void *data, dt_cache_entry_t *entry)
   int loaded_from_disk = 0;
   if(mip < DT_MIPMAP_F)
   {
-    if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                              || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+    if(_disk_backend_enabled(cache, mip) && cache->pack)
+    {
+      int width = 0, height = 0;
+      dt_colorspaces_color_profile_type_t color_space = DT_COLORSPACE_NONE;
+      if(dt_mipmap_pack_read(cache->pack, _get_imgid(entry->key), mip,
+                             (uint8_t *)entry->data + sizeof(*dsc),
+                             cache->max_width[mip], cache->max_height[mip],
+                             &width, &height, &color_space))
+      {
+        dt_print(DT_DEBUG_CACHE,
+                 "[mipmap_cache] grab mip %d for ID=%d from pack", mip,
+                 _get_imgid(entry->key));
+        dsc->width = width;
+        dsc->height = height;
+        dsc->iscale = 1.0f;
+        dsc->color_space = color_space;
+        loaded_from_disk = 1;
+      }
+    }
+    else if(_disk_backend_enabled(cache, mip))
     {
       // try and load from disk, if successful set flag
       char filename[PATH_MAX] = {0};
@@ -597,6 +635,62 @@ static void _mipmap_cache_unlink_ondisk_thumbnail(void *data,
     snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
     g_unlink(filename);
   }
+  if(cache->pack)
+    dt_mipmap_pack_remove(cache->pack, imgid, mip);
+}
+
+static int32_t _mipmap_cache_compact_job_run(dt_job_t *job)
+{
+  dt_mipmap_pack_t *pack = dt_control_job_get_params(job);
+  // don't hold up quitting
+  if(dt_control_running())
+    dt_mipmap_pack_compact(pack);
+  else
+    dt_mipmap_pack_compaction_skipped(pack);
+  return 0;
+}
+
+static void _mipmap_cache_write_pack(dt_mipmap_cache_t *cache,
+                                     const dt_imgid_t imgid,
+                                     const dt_mipmap_size_t mip,
+                                     const dt_mipmap_buffer_dsc_t *dsc)
+{
+  // lossless, so unlike the jpg files there is no quality loss in rewriting it
+  // but it's still pointless work
+  if(dt_mipmap_pack_contains(cache->pack, imgid, mip)) return;
+
+  // first check the disk isn't full
+  struct statvfs vfsbuf;
+  char packdir[PATH_MAX] = { 0 };
+  snprintf(packdir, sizeof(packdir), "%s.pack", cache->cachedir);
+  if(statvfs(packdir, &vfsbuf))
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[mipmap_cache] aborting thumbnail write since couldn't determine free space available in %s",
+             packdir);
+    return;
+  }
+  const int64_t free_mb = ((vfsbuf.f_frsize * vfsbuf.f_bavail) >> 20);
+  if(free_mb < 100)
+  {
+    dt_print(DT_DEBUG_ALWAYS,
+             "[mipmap_cache] aborting thumbnail write as only %" PRId64 " MB free in %s",
+             free_mb, packdir);
+    return;
+  }
+
+  dt_mipmap_pack_write(cache->pack, imgid, mip, (const uint8_t *)(dsc + 1),
+                       dsc->width, dsc->height, dsc->color_space);
+
+  // reclaim the space of replaced and removed thumbnails in the background.
+  // not while the cache is flushed on cleanup, the next session does it.
+  if(dt_control_running() && dt_mipmap_pack_needs_compaction(cache->pack))
+  {
+    dt_job_t *job = dt_control_job_create(&_mipmap_cache_compact_job_run, "%s", "compact thumbnail pack");
+    if(job) dt_control_job_set_params(job, cache->pack, NULL);
+    if(!job || dt_control_add_job(DT_JOB_QUEUE_SYSTEM_BG, job))
+      dt_mipmap_pack_compaction_skipped(cache->pack);
+  }
 }
 
 static void _mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry)
@@ -613,8 +707,15 @@ static void _mipmap_cache_deallocate_dynamic(void *data, dt_cache_entry_t *entry
       {
         _mipmap_cache_unlink_ondisk_thumbnail(data, _get_imgid(entry->key), mip);
       }
-      else if(cache->cachedir[0] && ((dt_conf_get_bool("cache_disk_backend") && mip < DT_MIPMAP_8)
-                                     || (dt_conf_get_bool("cache_disk_backend_full") && mip == DT_MIPMAP_8)))
+      else if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL)
+      {
+        // the processed thumbnail will be generated again next time
+      }
+      else if(_disk_backend_enabled(cache, mip) && cache->pack)
+      {
+        _mipmap_cache_write_pack(cache, _get_imgid(entry->key), mip, dsc);
+      }
+      else if(_disk_backend_enabled(cache, mip))
       {
         // serialize to disk
         char filename[PATH_MAX] = {0};
@@ -689,6 +790,17 @@ void dt_mipmap_cache_init()
   darktable.mipmap_cache = cache;
 
   _mipmap_cache_get_filename(cache->cachedir, sizeof(cache->cachedir));
+  const char *store = dt_conf_get_string_const("cache_disk_backend_store");
+  if(cache->cachedir[0] && g_str_has_prefix(store, "pack"))
+  {
+    char packdir[PATH_MAX] = { 0 };
+    snprintf(packdir, sizeof(packdir), "%s.pack", cache->cachedir);
+    cache->pack = dt_mipmap_pack_open(packdir, !g_strcmp0(store, "pack uncompressed")
+                                               ? DT_MIPMAP_PACK_RAW
+                                               : DT_MIPMAP_PACK_QOI);
+  }
+  dt_pthread_mutex_init(&cache->upgrade_mutex, NULL);
+
   // make sure static memory is initialized
   dt_mipmap_buffer_dsc_t *dsc = (dt_mipmap_buffer_dsc_t *)_mipmap_cache_static_dead_image;
   _dead_image_f((dt_mipmap_buffer_t *)(dsc + 1));
@@ -773,9 +885,19 @@ void dt_mipmap_cache_cleanup()
   dt_mipmap_cache_t *cache = darktable.mipmap_cache;
   if(!cache) return;
 
+  // the pending upgrade timeout would start a job on the freed cache
+  dt_pthread_mutex_lock(&cache->upgrade_mutex);
+  if(cache->upgrade_timeout) g_source_remove(cache->upgrade_timeout);
+  cache->upgrade_timeout = 0;
+  dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+
   dt_cache_cleanup(&cache->mip_thumbs.cache);
   dt_cache_cleanup(&cache->mip_full.cache);
   dt_cache_cleanup(&cache->mip_f.cache);
+  // after the caches, their cleanup writes the evicted thumbnails
+  dt_mipmap_pack_close(cache->pack);
+  g_list_free(cache->upgrade_pending);
+  dt_pthread_mutex_destroy(&cache->upgrade_mutex);
   darktable.mipmap_cache = NULL;
   free(cache);
 }
@@ -785,15 +907,15 @@ void dt_mipmap_cache_print()
   dt_mipmap_cache_t *cache = darktable.mipmap_cache;
   if(!cache) return;
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] thumbs fill %.2f/%.2f MB (%.2f%%)",
-           cache->mip_thumbs.cache.cost / (1024.0 * 1024.0),
+           dt_cache_get_cost(&cache->mip_thumbs.cache) / (1024.0 * 1024.0),
            cache->mip_thumbs.cache.cost_quota / (1024.0 * 1024.0),
-           100.0f * (float)cache->mip_thumbs.cache.cost / (float)cache->mip_thumbs.cache.cost_quota);
+           100.0f * (float)dt_cache_get_cost(&cache->mip_thumbs.cache) / (float)cache->mip_thumbs.cache.cost_quota);
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] float fill %"PRIu32"/%"PRIu32" slots (%.2f%%)",
-           (uint32_t)cache->mip_f.cache.cost, (uint32_t)cache->mip_f.cache.cost_quota,
-           100.0f * (float)cache->mip_f.cache.cost / (float)cache->mip_f.cache.cost_quota);
+           (uint32_t)dt_cache_get_cost(&cache->mip_f.cache), (uint32_t)cache->mip_f.cache.cost_quota,
+           100.0f * (float)dt_cache_get_cost(&cache->mip_f.cache) / (float)cache->mip_f.cache.cost_quota);
   dt_print(DT_DEBUG_ALWAYS,"[mipmap_cache] full  fill %"PRIu32"/%"PRIu32" slots (%.2f%%)",
-           (uint32_t)cache->mip_full.cache.cost, (uint32_t)cache->mip_full.cache.cost_quota,
-           100.0f * (float)cache->mip_full.cache.cost / (float)cache->mip_full.cache.cost_quota);
+           (uint32_t)dt_cache_get_cost(&cache->mip_full.cache), (uint32_t)cache->mip_full.cache.cost_quota,
+           100.0f * (float)dt_cache_get_cost(&cache->mip_full.cache) / (float)cache->mip_full.cache.cost_quota);
 
   uint64_t sum = 0;
   uint64_t sum_fetches = 0;
@@ -848,6 +970,139 @@ static dt_mipmap_cache_one_t *_get_cache(dt_mipmap_cache_t *cache,
   }
 }
 
+static gboolean _is_provisional(dt_mipmap_cache_t *cache,
+                                const dt_imgid_t imgid,
+                                const dt_mipmap_size_t mip)
+{
+  dt_cache_entry_t *entry = dt_cache_testget(&_get_cache(cache, mip)->cache, _get_key(imgid, mip), 'r');
+  if(!entry) return FALSE;
+  const dt_mipmap_buffer_dsc_t *dsc = (dt_mipmap_buffer_dsc_t *)entry->data;
+  const gboolean provisional = (dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL) != 0;
+  dt_cache_release(&_get_cache(cache, mip)->cache, entry);
+  return provisional;
+}
+
+// replace a provisional thumbnail by the processed one. returns FALSE if the
+// entry is busy and the upgrade should be retried later.
+static gboolean _upgrade_one(dt_mipmap_cache_t *cache,
+                             const dt_imgid_t imgid,
+                             const dt_mipmap_size_t mip)
+{
+  if(!_is_provisional(cache, imgid, mip)) return TRUE;
+
+  uint32_t width = cache->max_width[mip];
+  uint32_t height = cache->max_height[mip];
+  float iscale = 1.0f;
+  dt_colorspaces_color_profile_type_t color_space = DT_COLORSPACE_NONE;
+  uint8_t *buf = dt_alloc_align_uint8((size_t)width * height * 4);
+  if(!buf) return TRUE;
+
+  gboolean done = TRUE;
+  if(!_init_8_pipe(buf, &width, &height, &iscale, &color_space, imgid, mip))
+  {
+    dt_cache_entry_t *entry = dt_cache_testget(&_get_cache(cache, mip)->cache, _get_key(imgid, mip), 'w');
+    if(entry)
+    {
+      ASAN_UNPOISON_MEMORY_REGION(entry->data, dt_mipmap_buffer_dsc_size);
+      dt_mipmap_buffer_dsc_t *dsc = (dt_mipmap_buffer_dsc_t *)entry->data;
+      // the entry might have been removed and generated for real meanwhile
+      if(dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL)
+      {
+        ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(dt_mipmap_buffer_dsc_t));
+        memcpy(dsc + 1, buf, (size_t)width * height * 4);
+        dsc->width = width;
+        dsc->height = height;
+        dsc->iscale = iscale;
+        dsc->color_space = color_space;
+        dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL;
+        dt_print(DT_DEBUG_CACHE, "[mipmap_cache] upgraded mip %d for ID=%d", mip, imgid);
+        g_idle_add(_raise_signal_mipmap_updated, GINT_TO_POINTER(imgid));
+      }
+      dt_cache_release(&_get_cache(cache, mip)->cache, entry);
+    }
+    else
+      done = !_is_provisional(cache, imgid, mip);
+  }
+  dt_free_align(buf);
+  return done;
+}
+
+static int32_t _upgrade_job_run(dt_job_t *job);
+
+// queue a job upgrading the next pending thumbnail, also used as timeout callback
+static gboolean _upgrade_job_start(gpointer data)
+{
+  dt_mipmap_cache_t *cache = data;
+  dt_pthread_mutex_lock(&cache->upgrade_mutex);
+  cache->upgrade_timeout = 0;
+  dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+
+  dt_job_t *job = dt_control_running()
+    ? dt_control_job_create(&_upgrade_job_run, "%s", "upgrade thumbnails")
+    : NULL;
+  if(job) dt_control_job_set_params(job, cache, NULL);
+  if(!job || dt_control_add_job(DT_JOB_QUEUE_SYSTEM_BG, job))
+  {
+    dt_pthread_mutex_lock(&cache->upgrade_mutex);
+    cache->upgrade_running = FALSE;
+    dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+// each job upgrades a single thumbnail so the worker is free for others in between
+static int32_t _upgrade_job_run(dt_job_t *job)
+{
+  dt_mipmap_cache_t *cache = dt_control_job_get_params(job);
+
+  dt_pthread_mutex_lock(&cache->upgrade_mutex);
+  if(!cache->upgrade_pending || !dt_control_running())
+  {
+    cache->upgrade_running = FALSE;
+    dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+    return 0;
+  }
+  const uint32_t key = GPOINTER_TO_UINT(cache->upgrade_pending->data);
+  cache->upgrade_pending = g_list_delete_link(cache->upgrade_pending, cache->upgrade_pending);
+  dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+
+  const double start = dt_get_wtime();
+  if(!_upgrade_one(cache, _get_imgid(key), _get_size(key)))
+  {
+    // still locked by a reader, try again after the others
+    dt_pthread_mutex_lock(&cache->upgrade_mutex);
+    cache->upgrade_pending = g_list_append(cache->upgrade_pending, GUINT_TO_POINTER(key));
+    dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+  }
+
+  // stay within the configured share of one core by queueing the next
+  // job only after an idle time in proportion to the one the pipe just took
+  const int budget = CLAMP(dt_conf_get_int("plugins/lighttable/thumbnail_raw_upgrade_budget"), 1, 100);
+  const double idle = (dt_get_wtime() - start) * (100 - budget) / budget;
+  dt_pthread_mutex_lock(&cache->upgrade_mutex);
+  cache->upgrade_timeout = g_timeout_add(MAX(1, (guint)(idle * 1000.0)), _upgrade_job_start, cache);
+  dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+  return 0;
+}
+
+static void _upgrade_queue(dt_mipmap_cache_t *cache,
+                           const dt_imgid_t imgid,
+                           const dt_mipmap_size_t mip)
+{
+  const uint32_t key = _get_key(imgid, mip);
+  dt_pthread_mutex_lock(&cache->upgrade_mutex);
+  // the latest request is the most likely one to be on screen
+  cache->upgrade_pending = g_list_remove(cache->upgrade_pending, GUINT_TO_POINTER(key));
+  cache->upgrade_pending = g_list_prepend(cache->upgrade_pending, GUINT_TO_POINTER(key));
+  const gboolean start = !cache->upgrade_running && dt_control_running();
+  if(start) cache->upgrade_running = TRUE;
+  dt_pthread_mutex_unlock(&cache->upgrade_mutex);
+
+  // a chain of low priority jobs works through the list one by one
+  if(start)
+    _upgrade_job_start(cache);
+}
+
 void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
                                     const dt_imgid_t imgid,
                                     const dt_mipmap_size_t mip,
@@ -914,10 +1169,8 @@ void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
     if(!cache->cachedir[0]) return;
     if(mip > DT_MIPMAP_FULL || mip < DT_MIPMAP_0)
       return;
-    char filename[PATH_MAX] = {0};
-    snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
     // don't attempt to load if disk cache doesn't exist
-    if(!g_file_test(filename, G_FILE_TEST_EXISTS)) return;
+    if(!dt_mipmap_cache_disk_thumbnail_exists(imgid, mip)) return;
     dt_control_add_job(DT_JOB_QUEUE_SYSTEM_FG, dt_image_load_job_create(imgid, mip));
   }
   else if(flags == DT_MIPMAP_BLOCKING)
@@ -1006,7 +1259,14 @@ void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
       {
         // 8-bit thumbs
         ASAN_UNPOISON_MEMORY_REGION(dsc + 1, dsc->size - sizeof(dt_mipmap_buffer_dsc_t));
-        _init_8((uint8_t *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &buf->color_space, imgid, mip);
+        gboolean provisional = FALSE;
+        _init_8((uint8_t *)(dsc + 1), &dsc->width, &dsc->height, &dsc->iscale, &buf->color_space, imgid, mip,
+                &provisional);
+        if(provisional)
+        {
+          dsc->flags |= DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL;
+          _upgrade_queue(cache, imgid, mip);
+        }
       }
       dsc->color_space = buf->color_space;
       dsc->flags &= ~DT_MIPMAP_BUFFER_DSC_FLAG_GENERATE;
@@ -1144,13 +1404,8 @@ void dt_mipmap_cache_get_with_caller(dt_mipmap_buffer_t *buf,
     __sync_fetch_and_add(&(_get_cache(cache, mip)->stats_misses), 1);
     // in case we don't even have a disk cache for our requested thumbnail,
     // prefetch at least mip0, in case we have that in the disk caches:
-    if(cache->cachedir[0])
-    {
-      char filename[PATH_MAX] = {0};
-      snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, key);
-      if(g_file_test(filename, G_FILE_TEST_EXISTS))
-        dt_mipmap_cache_get(0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
-    }
+    if(dt_mipmap_cache_disk_thumbnail_exists(imgid, mip))
+      dt_mipmap_cache_get(0, imgid, DT_MIPMAP_0, DT_MIPMAP_PREFETCH_DISK, 0);
     // nothing found :(
     buf->buf = NULL;
     buf->imgid = NO_IMGID;
@@ -1431,15 +1686,134 @@ static int _write_image(dt_imageio_module_data_t *data,
   return 0;
 }
 
+// load the embedded jpeg of a raw (or the jpeg itself) into the
+// thumbnail. when check_size is set the embedded preview is rejected
+// if it is too small for the requested mip. returns TRUE on failure.
+static gboolean _init_8_embedded(uint8_t *buf,
+                                 uint32_t *width,
+                                 uint32_t *height,
+                                 dt_colorspaces_color_profile_type_t *color_space,
+                                 const dt_imgid_t imgid,
+                                 const dt_mipmap_size_t size,
+                                 const gboolean check_size)
+{
+  const uint32_t wd = *width, ht = *height;
+  gboolean res = TRUE;
+  const dt_image_orientation_t orientation = dt_image_get_orientation(imgid);
+
+  // try to load the embedded thumbnail in raw
+  gboolean from_cache = TRUE;
+  char filename[PATH_MAX] = { 0 };
+  dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
+
+  const char *c = filename + strlen(filename);
+  while(*c != '.' && c > filename) c--;
+  if(!strcasecmp(c, ".jpg"))
+  {
+    // try to load jpg
+    dt_imageio_jpeg_t jpg;
+    if(!dt_imageio_jpeg_read_header(filename, &jpg))
+    {
+      uint8_t *tmp = dt_alloc_align_uint8((size_t)jpg.width * jpg.height * 4);
+      *color_space = dt_imageio_jpeg_read_color_space(&jpg);
+      if(!dt_imageio_jpeg_read(&jpg, tmp))
+      {
+        // scale to fit
+        dt_print(DT_DEBUG_CACHE,
+                 "[mipmap_cache] generate mip %d for ID=%d from jpeg", size, imgid);
+        dt_iop_flip_and_zoom_8(tmp, jpg.width, jpg.height, buf, wd, ht, orientation, width, height);
+        res = FALSE;
+      }
+      dt_free_align(tmp);
+    }
+  }
+  else
+  {
+    uint8_t *tmp = 0;
+    int32_t thumb_width, thumb_height;
+    res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
+    if(!res)
+    {
+      // if the thumbnail is not large enough, we compute one
+      const dt_image_t *img2 = dt_image_cache_get(imgid, 'r');
+      const int imgwd = img2->width;
+      const int imght = img2->height;
+      dt_image_cache_read_release(img2);
+      if(check_size
+         && thumb_width < wd
+         && thumb_height < ht
+         && thumb_width < imgwd - 4
+         && thumb_height < imght - 4)
+      {
+        res = TRUE;
+      }
+      else
+      {
+        // scale to fit
+        dt_print(DT_DEBUG_CACHE,
+                 "[mipmap_cache] generate mip %d for ID=%d from embedded jpeg",
+                 size, imgid);
+        dt_iop_flip_and_zoom_8(tmp, thumb_width, thumb_height,
+                               buf, wd, ht, orientation, width, height);
+      }
+      dt_free_align(tmp);
+    }
+  }
+  return res;
+}
+
+// run the full pixelpipe into the thumbnail. returns TRUE on failure.
+static gboolean _init_8_pipe(uint8_t *buf,
+                             uint32_t *width,
+                             uint32_t *height,
+                             float *iscale,
+                             dt_colorspaces_color_profile_type_t *color_space,
+                             const dt_imgid_t imgid,
+                             const dt_mipmap_size_t size)
+{
+  const uint32_t wd = *width, ht = *height;
+  // try the real thing: rawspeed + pixelpipe
+  dt_imageio_module_format_t format;
+  _dummy_data_t dat;
+  format.bpp = _bpp;
+  format.write_image = _write_image;
+  format.levels = _levels;
+  dat.head.max_width = wd;
+  dat.head.max_height = ht;
+  dat.buf = buf;
+  // export with flags: ignore exif(don't load from disk), don't
+  // swap byte order, don't do hq processing, no upscaling and
+  // signal we want thumbnail export
+  const gboolean res = dt_imageio_export_with_flags(imgid, "unused", &format, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE,
+                                     FALSE, FALSE, 1.0, TRUE, NULL, FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL,
+                                     NULL, 1, 1, NULL, -1);
+  if(!res)
+  {
+    dt_print(DT_DEBUG_CACHE,
+             "[mipmap_cache] generate mip %d for ID=%d from scratch",
+             size, imgid);
+    // might be smaller, or have a different aspect than what we got as input.
+    *width = dat.head.width;
+    *height = dat.head.height;
+    *iscale = 1.0f;
+    *color_space = dt_mipmap_cache_get_colorspace();
+  }
+  dt_print(DT_DEBUG_PIPE, "[mipmap init 8] export ID=%d finished (sizes %d %d => %d %d)",
+    imgid, wd, ht, dat.head.width, dat.head.height);
+  return res;
+}
+
 static void _init_8(uint8_t *buf,
                     uint32_t *width,
                     uint32_t *height,
                     float *iscale,
                     dt_colorspaces_color_profile_type_t *color_space,
                     const dt_imgid_t imgid,
-                    const dt_mipmap_size_t size)
+                    const dt_mipmap_size_t size,
+                    gboolean *provisional)
 {
   *iscale = 1.0f;
+  *provisional = FALSE;
   const uint32_t wd = *width, ht = *height;
   char filename[PATH_MAX] = { 0 };
   gboolean from_cache = TRUE;
@@ -1468,67 +1842,7 @@ static void _init_8(uint8_t *buf,
   const gboolean use_embedded = (size <= min_s);
 
   if(!altered && use_embedded && !incompatible)
-  {
-    const dt_image_orientation_t orientation = dt_image_get_orientation(imgid);
-
-    // try to load the embedded thumbnail in raw
-    from_cache = TRUE;
-    memset(filename, 0, sizeof(filename));
-    dt_image_full_path(imgid, filename, sizeof(filename), &from_cache);
-
-    const char *c = filename + strlen(filename);
-    while(*c != '.' && c > filename) c--;
-    if(!strcasecmp(c, ".jpg"))
-    {
-      // try to load jpg
-      dt_imageio_jpeg_t jpg;
-      if(!dt_imageio_jpeg_read_header(filename, &jpg))
-      {
-        uint8_t *tmp = dt_alloc_align_uint8((size_t)jpg.width * jpg.height * 4);
-        *color_space = dt_imageio_jpeg_read_color_space(&jpg);
-        if(!dt_imageio_jpeg_read(&jpg, tmp))
-        {
-          // scale to fit
-          dt_print(DT_DEBUG_CACHE,
-                   "[mipmap_cache] generate mip %d for ID=%d from jpeg", size, imgid);
-          dt_iop_flip_and_zoom_8(tmp, jpg.width, jpg.height, buf, wd, ht, orientation, width, height);
-          res = FALSE;
-        }
-        dt_free_align(tmp);
-      }
-    }
-    else
-    {
-      uint8_t *tmp = 0;
-      int32_t thumb_width, thumb_height;
-      res = dt_imageio_large_thumbnail(filename, &tmp, &thumb_width, &thumb_height, color_space);
-      if(!res)
-      {
-        // if the thumbnail is not large enough, we compute one
-        const dt_image_t *img2 = dt_image_cache_get(imgid, 'r');
-        const int imgwd = img2->width;
-        const int imght = img2->height;
-        dt_image_cache_read_release(img2);
-        if(thumb_width < wd
-           && thumb_height < ht
-           && thumb_width < imgwd - 4
-           && thumb_height < imght - 4)
-        {
-          res = TRUE;
-        }
-        else
-        {
-          // scale to fit
-          dt_print(DT_DEBUG_CACHE,
-                   "[mipmap_cache] generate mip %d for ID=%d from embedded jpeg",
-                   size, imgid);
-          dt_iop_flip_and_zoom_8(tmp, thumb_width, thumb_height,
-                                 buf, wd, ht, orientation, width, height);
-        }
-        dt_free_align(tmp);
-      }
-    }
-  }
+    res = _init_8_embedded(buf, width, height, color_space, imgid, size, TRUE);
 
   if(res)
   {
@@ -1546,44 +1860,34 @@ static void _init_8(uint8_t *buf,
       // downsample
       dt_iop_flip_and_zoom_8(tmp.buf, tmp.width, tmp.height, buf, wd, ht, ORIENTATION_NONE, width, height);
 
+      // a stand-in made from a stand-in is no better than its source
+      const dt_mipmap_buffer_dsc_t *tmp_dsc = (dt_mipmap_buffer_dsc_t *)tmp.cache_entry->data;
+      *provisional = (tmp_dsc->flags & DT_MIPMAP_BUFFER_DSC_FLAG_PROVISIONAL) != 0;
+
       dt_mipmap_cache_release(&tmp);
       res = FALSE;
       break;
     }
   }
 
-  if(res)
+  // two-phase thumbnails: show the embedded preview right away and
+  // let the background upgrade run the pixelpipe later on. only for
+  // the gui, generate-cache and the cli want the final thumbnails.
+  if(res
+     && !altered
+     && !incompatible
+     && size < DT_MIPMAP_8
+     && darktable.gui
+     && dt_control_running()
+     && dt_conf_get_bool("plugins/lighttable/thumbnail_raw_upgrade"))
   {
-    // try the real thing: rawspeed + pixelpipe
-    dt_imageio_module_format_t format;
-    _dummy_data_t dat;
-    format.bpp = _bpp;
-    format.write_image = _write_image;
-    format.levels = _levels;
-    dat.head.max_width = wd;
-    dat.head.max_height = ht;
-    dat.buf = buf;
-    // export with flags: ignore exif(don't load from disk), don't
-    // swap byte order, don't do hq processing, no upscaling and
-    // signal we want thumbnail export
-    res = dt_imageio_export_with_flags(imgid, "unused", &format, (dt_imageio_module_data_t *)&dat, TRUE, FALSE, FALSE,
-                                       FALSE, FALSE, 1.0, TRUE, NULL, FALSE, FALSE, DT_COLORSPACE_NONE, NULL, DT_INTENT_LAST, NULL,
-                                       NULL, 1, 1, NULL, -1);
-    if(!res)
-    {
-      dt_print(DT_DEBUG_CACHE,
-               "[mipmap_cache] generate mip %d for ID=%d from scratch",
-               size, imgid);
-      // might be smaller, or have a different aspect than what we got as input.
-      *width = dat.head.width;
-      *height = dat.head.height;
-      *iscale = 1.0f;
-      *color_space = dt_mipmap_cache_get_colorspace();
-    }
-    dt_print(DT_DEBUG_PIPE, "[mipmap init 8] export ID=%d finished (sizes %d %d => %d %d)",
-      imgid, wd, ht, dat.head.width, dat.head.height);
+    res = _init_8_embedded(buf, width, height, color_space, imgid, size, FALSE);
+    *provisional = !res;
   }
 
+  if(res)
+    res = _init_8_pipe(buf, width, height, iscale, color_space, imgid, size);
+
   // any errors?
   if(res)
   {
@@ -1620,6 +1924,11 @@ void dt_mipmap_cache_copy_thumbnails(const dt_imgid_t dst_imgid,
   {
     for(dt_mipmap_size_t mip = DT_MIPMAP_0; mip < DT_MIPMAP_F; mip++)
     {
+      if(cache->pack)
+      {
+        dt_mipmap_pack_copy(cache->pack, dst_imgid, src_imgid, mip);
+        continue;
+      }
       // try and load from disk, if successful set flag
       char srcpath[PATH_MAX] = {0};
       char dstpath[PATH_MAX] = {0};
@@ -1637,6 +1946,20 @@ void dt_mipmap_cache_copy_thumbnails(const dt_imgid_t dst_imgid,
   }
 }
 
+gboolean dt_mipmap_cache_disk_thumbnail_exists(const dt_imgid_t imgid,
+                                               const dt_mipmap_size_t mip)
+{
+  dt_mipmap_cache_t *cache = darktable.mipmap_cache;
+  if(!cache || !cache->cachedir[0] || mip >= DT_MIPMAP_F) return FALSE;
+
+  if(cache->pack)
+    return dt_mipmap_pack_contains(cache->pack, imgid, mip);
+
+  char filename[PATH_MAX] = { 0 };
+  snprintf(filename, sizeof(filename), "%s.d/%d/%"PRIu32".jpg", cache->cachedir, (int)mip, imgid);
+  return dt_util_test_image_file(filename);
+}
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
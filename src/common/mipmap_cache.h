@@ -102,6 +102,13 @@ typedef struct dt_mipmap_cache_t
   dt_mipmap_cache_one_t mip_f;
   dt_mipmap_cache_one_t mip_full;
   char cachedir[PATH_MAX]; // cached sha1sum filename for faster access
+  struct dt_mipmap_pack_t *pack; // pack-file disk backend, NULL for jpg files
+
+  // provisional thumbnails waiting for the background upgrade, newest first
+  dt_pthread_mutex_t upgrade_mutex;
+  GList *upgrade_pending;
+  gboolean upgrade_running;
+  guint upgrade_timeout;        // source of the delayed next job, 0 if none
 } dt_mipmap_cache_t;
 
 // dynamic memory allocation interface for imageio backend: a write locked
@@ -150,9 +157,12 @@ dt_mipmap_size_t dt_mipmap_cache_get_matching_size(const int32_t width, const in
 dt_colorspaces_color_profile_type_t dt_mipmap_cache_get_colorspace(void);
 
 // copy over thumbnails. used by file operation that copies raw files, to speed up thumbnail generation.
-// only copies over the jpg backend on disk, doesn't directly affect the in-memory cache.
+// only copies over the disk backend, doesn't directly affect the in-memory cache.
 void dt_mipmap_cache_copy_thumbnails(const dt_imgid_t dst_imgid, const dt_imgid_t src_imgid);
 
+// returns TRUE if the disk backend holds a thumbnail of this size, whichever storage is in use
+gboolean dt_mipmap_cache_disk_thumbnail_exists(const dt_imgid_t imgid, const dt_mipmap_size_t mip);
+
 // return the mipmap corresponding to text value saved in prefs
 dt_mipmap_size_t dt_mipmap_cache_get_min_mip_from_pref(const char *value);
 
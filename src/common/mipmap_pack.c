@@ -0,0 +1,657 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "common/mipmap_pack.h"
+#include "common/darktable.h"
+#include "common/dtpthread.h"
+#include "imageio/qoi.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DT_PACK_RECORD_MAGIC 0x4b505444u // "DTPK"
+#define DT_PACK_INDEX_MAGIC 0x49505444u  // "DTPI"
+#define DT_PACK_VERSION 1
+#define DT_PACK_SEGMENT_SIZE ((uint64_t)256 << 20)
+#define DT_PACK_MAX_SEGMENTS 100000
+
+// header in front of every payload in a segment
+typedef struct dt_pack_record_t
+{
+  uint32_t magic;
+  uint32_t key;
+  uint32_t width;
+  uint32_t height;
+  uint32_t color_space;
+  uint32_t codec;
+  uint32_t length; // payload length, 0 marks a removed thumbnail
+  uint32_t reserved;
+} dt_pack_record_t;
+
+typedef struct dt_pack_location_t
+{
+  uint32_t segment;
+  uint32_t length;
+  uint64_t offset; // of the record header
+} dt_pack_location_t;
+
+typedef struct dt_pack_segment_t
+{
+  uint64_t size;    // bytes written
+  uint64_t live;    // bytes of records referenced by the index
+  GMappedFile *map; // read-only mapping, possibly shorter than size
+} dt_pack_segment_t;
+
+struct dt_mipmap_pack_t
+{
+  dt_pthread_mutex_t lock;
+  char dir[PATH_MAX];
+  dt_mipmap_pack_codec_t codec;
+  GHashTable *index; // key -> dt_pack_location_t
+  dt_pack_segment_t *segment;
+  uint32_t nsegments;
+  FILE *active;      // append handle of the last segment
+  gboolean dirty;    // index changed since it was saved
+  gboolean compacting;
+};
+
+// same layout as the mipmap cache keys
+static inline uint32_t _key(const dt_imgid_t imgid,
+                            const int mip)
+{
+  return (((uint32_t)mip & 0xf) << 28) | ((imgid - 1) & 0xfffffff);
+}
+
+static inline uint64_t _record_size(const uint32_t length)
+{
+  return sizeof(dt_pack_record_t) + length;
+}
+
+static void _segment_filename(const dt_mipmap_pack_t *pack,
+                              const uint32_t segment,
+                              char *filename,
+                              const size_t size)
+{
+  snprintf(filename, size, "%s/%05" PRIu32 ".seg", pack->dir, segment);
+}
+
+static void _grow_segments(dt_mipmap_pack_t *pack,
+                           const uint32_t nsegments)
+{
+  if(nsegments <= pack->nsegments) return;
+  pack->segment = g_renew(dt_pack_segment_t, pack->segment, nsegments);
+  memset(pack->segment + pack->nsegments, 0,
+         sizeof(dt_pack_segment_t) * (nsegments - pack->nsegments));
+  pack->nsegments = nsegments;
+}
+
+// drop the index entry for key and account the garbage
+static void _index_remove(dt_mipmap_pack_t *pack,
+                          const uint32_t key)
+{
+  dt_pack_location_t *loc = g_hash_table_lookup(pack->index, GUINT_TO_POINTER(key));
+  if(!loc) return;
+  dt_pack_segment_t *seg = &pack->segment[loc->segment];
+  seg->live -= MIN(seg->live, _record_size(loc->length));
+  g_hash_table_remove(pack->index, GUINT_TO_POINTER(key));
+}
+
+static void _index_insert(dt_mipmap_pack_t *pack,
+                          const uint32_t key,
+                          const uint32_t segment,
+                          const uint64_t offset,
+                          const uint32_t length)
+{
+  _index_remove(pack, key);
+  if(!length) return;
+  dt_pack_location_t *loc = g_new(dt_pack_location_t, 1);
+  loc->segment = segment;
+  loc->offset = offset;
+  loc->length = length;
+  g_hash_table_insert(pack->index, GUINT_TO_POINTER(key), loc);
+  pack->segment[segment].live += _record_size(length);
+}
+
+// apply all records of a segment starting at offset to the index
+static void _replay_segment(dt_mipmap_pack_t *pack,
+                            const uint32_t segment,
+                            uint64_t offset)
+{
+  char filename[PATH_MAX] = { 0 };
+  _segment_filename(pack, segment, filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return;
+
+  fseek(f, 0, SEEK_END);
+  const uint64_t filesize = ftell(f);
+  fseek(f, offset, SEEK_SET);
+
+  int replayed = 0;
+  dt_pack_record_t rec;
+  while(offset + sizeof(rec) <= filesize
+        && fread(&rec, sizeof(rec), 1, f) == 1
+        && rec.magic == DT_PACK_RECORD_MAGIC
+        && offset + _record_size(rec.length) <= filesize)
+  {
+    _index_insert(pack, rec.key, segment, offset, rec.length);
+    offset += _record_size(rec.length);
+    fseek(f, offset, SEEK_SET);
+    replayed++;
+  }
+  fclose(f);
+
+  // a torn record at the end is ignored and will be overwritten by the next append
+  pack->segment[segment].size = offset;
+  if(replayed)
+    dt_print(DT_DEBUG_CACHE, "[mipmap_pack] replayed %d records of segment %" PRIu32,
+             replayed, segment);
+}
+
+static gboolean _load_index(dt_mipmap_pack_t *pack)
+{
+  gchar *filename = g_build_filename(pack->dir, "index", NULL);
+  FILE *f = g_fopen(filename, "rb");
+  g_free(filename);
+  if(!f) return FALSE;
+
+  gboolean ok = FALSE;
+  uint32_t header[3] = { 0 };
+  if(fread(header, sizeof(header), 1, f) == 1
+     && header[0] == DT_PACK_INDEX_MAGIC
+     && header[1] == DT_PACK_VERSION
+     && header[2] <= DT_PACK_MAX_SEGMENTS)
+  {
+    _grow_segments(pack, header[2]);
+    ok = TRUE;
+    for(uint32_t s = 0; s < header[2] && ok; s++)
+      ok = fread(&pack->segment[s].size, sizeof(uint64_t), 1, f) == 1;
+
+    uint32_t key;
+    dt_pack_location_t loc;
+    while(ok && fread(&key, sizeof(key), 1, f) == 1 && fread(&loc, sizeof(loc), 1, f) == 1)
+    {
+      if(loc.segment < pack->nsegments
+         && loc.offset + _record_size(loc.length) <= pack->segment[loc.segment].size)
+        _index_insert(pack, key, loc.segment, loc.offset, loc.length);
+    }
+  }
+  fclose(f);
+
+  if(!ok)
+  {
+    g_hash_table_remove_all(pack->index);
+    for(uint32_t s = 0; s < pack->nsegments; s++)
+      pack->segment[s].size = pack->segment[s].live = 0;
+  }
+  return ok;
+}
+
+static void _save_index(dt_mipmap_pack_t *pack)
+{
+  gchar *filename = g_build_filename(pack->dir, "index", NULL);
+  gchar *tmpname = g_strconcat(filename, ".tmp", NULL);
+  FILE *f = g_fopen(tmpname, "wb");
+  gboolean ok = f != NULL;
+  if(f)
+  {
+    const uint32_t header[3] = { DT_PACK_INDEX_MAGIC, DT_PACK_VERSION, pack->nsegments };
+    ok = fwrite(header, sizeof(header), 1, f) == 1;
+    for(uint32_t s = 0; s < pack->nsegments && ok; s++)
+      ok = fwrite(&pack->segment[s].size, sizeof(uint64_t), 1, f) == 1;
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, pack->index);
+    while(ok && g_hash_table_iter_next(&iter, &key, &value))
+    {
+      const uint32_t k = GPOINTER_TO_UINT(key);
+      ok = fwrite(&k, sizeof(k), 1, f) == 1
+        && fwrite(value, sizeof(dt_pack_location_t), 1, f) == 1;
+    }
+    ok = !fclose(f) && ok;
+  }
+  if(ok && !g_rename(tmpname, filename))
+    pack->dirty = FALSE;
+  else
+  {
+    g_unlink(tmpname);
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] failed to write index `%s'", filename);
+  }
+  g_free(tmpname);
+  g_free(filename);
+}
+
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *directory,
+                                      const dt_mipmap_pack_codec_t codec)
+{
+  if(g_mkdir_with_parents(directory, 0750))
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] can't create directory `%s'", directory);
+    return NULL;
+  }
+
+  const double start = dt_get_debug_wtime();
+  dt_mipmap_pack_t *pack = g_new0(dt_mipmap_pack_t, 1);
+  dt_pthread_mutex_init(&pack->lock, NULL);
+  g_strlcpy(pack->dir, directory, sizeof(pack->dir));
+  pack->codec = codec;
+  pack->index = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+  // find the existing segments
+  uint32_t nsegments = 0;
+  GDir *dir = g_dir_open(directory, 0, NULL);
+  if(dir)
+  {
+    const gchar *name;
+    while((name = g_dir_read_name(dir)))
+    {
+      if(!g_str_has_suffix(name, ".seg")) continue;
+      const uint32_t seg = strtoul(name, NULL, 10);
+      if(seg < DT_PACK_MAX_SEGMENTS) nsegments = MAX(nsegments, seg + 1);
+    }
+    g_dir_close(dir);
+  }
+
+  const gboolean indexed = _load_index(pack);
+  _grow_segments(pack, nsegments);
+
+  // bring the index up to date with everything appended after it was saved.
+  // segments removed by a compaction lose their entries.
+  for(uint32_t s = 0; s < pack->nsegments; s++)
+  {
+    char filename[PATH_MAX] = { 0 };
+    _segment_filename(pack, s, filename, sizeof(filename));
+    if(g_file_test(filename, G_FILE_TEST_EXISTS))
+      _replay_segment(pack, s, pack->segment[s].size);
+    else if(pack->segment[s].live)
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, pack->index);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+        if(((dt_pack_location_t *)value)->segment == s)
+          g_hash_table_iter_remove(&iter);
+      pack->segment[s].size = pack->segment[s].live = 0;
+    }
+  }
+  pack->dirty = !indexed;
+
+  dt_print(DT_DEBUG_CACHE,
+           "[mipmap_pack] opened `%s' with %u thumbnails in %u segments%s in %.3fs",
+           directory, g_hash_table_size(pack->index), pack->nsegments,
+           indexed ? "" : " (rebuilt index)", dt_get_debug_wtime() - start);
+  return pack;
+}
+
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack)
+{
+  if(!pack) return;
+  if(pack->active) fclose(pack->active);
+  if(pack->dirty) _save_index(pack);
+  for(uint32_t s = 0; s < pack->nsegments; s++)
+    if(pack->segment[s].map) g_mapped_file_unref(pack->segment[s].map);
+  g_free(pack->segment);
+  g_hash_table_destroy(pack->index);
+  dt_pthread_mutex_destroy(&pack->lock);
+  g_free(pack);
+}
+
+// append a record to the active segment. must be called with the lock held.
+static gboolean _append(dt_mipmap_pack_t *pack,
+                        const dt_pack_record_t *rec,
+                        const void *payload)
+{
+  const uint32_t last = pack->nsegments ? pack->nsegments - 1 : 0;
+  if(!pack->nsegments || pack->segment[last].size >= DT_PACK_SEGMENT_SIZE || !pack->active)
+  {
+    if(pack->active) fclose(pack->active);
+    pack->active = NULL;
+    // continue the last segment after a restart unless it's full
+    const uint32_t seg = (pack->nsegments && pack->segment[last].size < DT_PACK_SEGMENT_SIZE)
+                       ? last
+                       : pack->nsegments;
+    if(seg >= DT_PACK_MAX_SEGMENTS) return FALSE;
+    _grow_segments(pack, seg + 1);
+    char filename[PATH_MAX] = { 0 };
+    _segment_filename(pack, seg, filename, sizeof(filename));
+    pack->active = g_fopen(filename, "r+b");
+    if(!pack->active) pack->active = g_fopen(filename, "w+b");
+    if(!pack->active) return FALSE;
+  }
+
+  const uint32_t seg = pack->nsegments - 1;
+  dt_pack_segment_t *segment = &pack->segment[seg];
+  // overwrite a possibly torn record from a crash
+  const uint64_t offset = segment->size;
+  fseek(pack->active, offset, SEEK_SET);
+  const gboolean ok = fwrite(rec, sizeof(*rec), 1, pack->active) == 1
+                   && (!rec->length || fwrite(payload, 1, rec->length, pack->active) == rec->length)
+                   && !fflush(pack->active);
+  if(!ok)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] failed to append to segment %" PRIu32, seg);
+    return FALSE;
+  }
+  segment->size = offset + _record_size(rec->length);
+  _index_insert(pack, rec->key, seg, offset, rec->length);
+  pack->dirty = TRUE;
+  return TRUE;
+}
+
+// a reference to a mapping covering the record at loc. must be called with the lock held.
+static GMappedFile *_map_record(dt_mipmap_pack_t *pack,
+                                const dt_pack_location_t *loc)
+{
+  dt_pack_segment_t *seg = &pack->segment[loc->segment];
+  const uint64_t end = loc->offset + _record_size(loc->length);
+  if(!seg->map || g_mapped_file_get_length(seg->map) < end)
+  {
+    // the segment has grown since mapping, readers keep their own reference
+    if(seg->map) g_mapped_file_unref(seg->map);
+    char filename[PATH_MAX] = { 0 };
+    _segment_filename(pack, loc->segment, filename, sizeof(filename));
+    seg->map = g_mapped_file_new(filename, FALSE, NULL);
+    if(!seg->map || g_mapped_file_get_length(seg->map) < end) return NULL;
+  }
+  return g_mapped_file_ref(seg->map);
+}
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack,
+                                 const dt_imgid_t imgid,
+                                 const int mip)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const gboolean found = g_hash_table_contains(pack->index, GUINT_TO_POINTER(_key(imgid, mip)));
+  dt_pthread_mutex_unlock(&pack->lock);
+  return found;
+}
+
+gboolean dt_mipmap_pack_read(dt_mipmap_pack_t *pack,
+                             const dt_imgid_t imgid,
+                             const int mip,
+                             uint8_t *out,
+                             const int max_width,
+                             const int max_height,
+                             int *width,
+                             int *height,
+                             dt_colorspaces_color_profile_type_t *color_space)
+{
+  const uint32_t key = _key(imgid, mip);
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_pack_location_t *loc = g_hash_table_lookup(pack->index, GUINT_TO_POINTER(key));
+  dt_pack_location_t where = { 0 };
+  GMappedFile *map = NULL;
+  if(loc)
+  {
+    where = *loc;
+    map = _map_record(pack, loc);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  if(!map) return FALSE;
+
+  const uint8_t *base = (const uint8_t *)g_mapped_file_get_contents(map) + where.offset;
+  dt_pack_record_t rec;
+  memcpy(&rec, base, sizeof(rec));
+  const uint8_t *payload = base + sizeof(rec);
+
+  gboolean ok = rec.magic == DT_PACK_RECORD_MAGIC
+             && rec.key == key
+             && rec.length == where.length
+             && rec.width <= (uint32_t)max_width
+             && rec.height <= (uint32_t)max_height;
+  if(ok && rec.codec == DT_MIPMAP_PACK_RAW)
+  {
+    ok = (size_t)rec.width * rec.height * 4 == rec.length;
+    if(ok) memcpy(out, payload, rec.length);
+  }
+  else if(ok && rec.codec == DT_MIPMAP_PACK_QOI)
+  {
+    qoi_desc desc;
+    void *pixels = qoi_decode(payload, rec.length, &desc, 4);
+    ok = pixels && desc.width == rec.width && desc.height == rec.height;
+    if(ok) memcpy(out, pixels, (size_t)rec.width * rec.height * 4);
+    free(pixels);
+  }
+  else
+    ok = FALSE;
+  g_mapped_file_unref(map);
+
+  if(!ok)
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[mipmap_pack] broken thumbnail for ID=%d mip=%d", imgid, mip);
+    dt_mipmap_pack_remove(pack, imgid, mip);
+    return FALSE;
+  }
+
+  *width = rec.width;
+  *height = rec.height;
+  *color_space = rec.color_space;
+  return TRUE;
+}
+
+gboolean dt_mipmap_pack_write(dt_mipmap_pack_t *pack,
+                              const dt_imgid_t imgid,
+                              const int mip,
+                              const uint8_t *in,
+                              const int width,
+                              const int height,
+                              const dt_colorspaces_color_profile_type_t color_space)
+{
+  dt_pack_record_t rec = { 0 };
+  rec.magic = DT_PACK_RECORD_MAGIC;
+  rec.key = _key(imgid, mip);
+  rec.width = width;
+  rec.height = height;
+  rec.color_space = color_space;
+  rec.codec = pack->codec;
+
+  // encoding is done without holding the lock
+  void *encoded = NULL;
+  const void *payload = in;
+  if(pack->codec == DT_MIPMAP_PACK_QOI)
+  {
+    const qoi_desc desc = { .width = width, .height = height, .channels = 4, .colorspace = QOI_SRGB };
+    int length = 0;
+    payload = encoded = qoi_encode(in, &desc, &length);
+    rec.length = length;
+    if(!encoded) return FALSE;
+  }
+  else
+    rec.length = (uint32_t)width * height * 4;
+
+  dt_pthread_mutex_lock(&pack->lock);
+  const gboolean ok = _append(pack, &rec, payload);
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  free(encoded);
+  return ok;
+}
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack,
+                           const dt_imgid_t imgid,
+                           const int mip)
+{
+  const uint32_t key = _key(imgid, mip);
+  dt_pthread_mutex_lock(&pack->lock);
+  if(g_hash_table_contains(pack->index, GUINT_TO_POINTER(key)))
+  {
+    // write a tombstone so the removal survives an index replay
+    dt_pack_record_t rec = { 0 };
+    rec.magic = DT_PACK_RECORD_MAGIC;
+    rec.key = key;
+    if(!_append(pack, &rec, NULL))
+      _index_remove(pack, key);
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+// copy the record at loc to the active segment as key. must be called with the lock held.
+static gboolean _copy_record(dt_mipmap_pack_t *pack,
+                             const dt_pack_location_t *loc,
+                             const uint32_t key)
+{
+  GMappedFile *map = _map_record(pack, loc);
+  if(!map) return FALSE;
+
+  const uint8_t *base = (const uint8_t *)g_mapped_file_get_contents(map) + loc->offset;
+  dt_pack_record_t rec;
+  memcpy(&rec, base, sizeof(rec));
+  rec.key = key;
+  const gboolean ok = rec.magic == DT_PACK_RECORD_MAGIC
+                   && rec.length == loc->length
+                   && _append(pack, &rec, base + sizeof(rec));
+  g_mapped_file_unref(map);
+  return ok;
+}
+
+gboolean dt_mipmap_pack_copy(dt_mipmap_pack_t *pack,
+                             const dt_imgid_t dst_imgid,
+                             const dt_imgid_t src_imgid,
+                             const int mip)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  const dt_pack_location_t *loc = g_hash_table_lookup(pack->index,
+                                                      GUINT_TO_POINTER(_key(src_imgid, mip)));
+  // _append might free loc while replacing the index entry
+  const dt_pack_location_t src = loc ? *loc : (dt_pack_location_t){ 0 };
+  const gboolean ok = loc && _copy_record(pack, &src, _key(dst_imgid, mip));
+  dt_pthread_mutex_unlock(&pack->lock);
+  return ok;
+}
+
+// a segment is worth compacting if at least half of it is garbage
+static inline gboolean _sparse_segment(const dt_mipmap_pack_t *pack,
+                                       const uint32_t s)
+{
+  const dt_pack_segment_t *seg = &pack->segment[s];
+  return s + 1 < pack->nsegments && seg->size && seg->live < seg->size / 2;
+}
+
+gboolean dt_mipmap_pack_needs_compaction(dt_mipmap_pack_t *pack)
+{
+  gboolean needed = FALSE;
+  dt_pthread_mutex_lock(&pack->lock);
+  if(!pack->compacting)
+  {
+    for(uint32_t s = 0; s < pack->nsegments && !needed; s++)
+      needed = _sparse_segment(pack, s);
+    pack->compacting = needed;
+  }
+  dt_pthread_mutex_unlock(&pack->lock);
+  return needed;
+}
+
+void dt_mipmap_pack_compaction_skipped(dt_mipmap_pack_t *pack)
+{
+  dt_pthread_mutex_lock(&pack->lock);
+  pack->compacting = FALSE;
+  dt_pthread_mutex_unlock(&pack->lock);
+}
+
+size_t dt_mipmap_pack_compact(dt_mipmap_pack_t *pack)
+{
+  const double start = dt_get_debug_wtime();
+  size_t reclaimed = 0;
+  int moved = 0;
+
+  dt_pthread_mutex_lock(&pack->lock);
+  const uint32_t nsegments = pack->nsegments;
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  for(uint32_t s = 0; s < nsegments; s++)
+  {
+    // collect the keys living in this segment
+    GArray *keys = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    dt_pthread_mutex_lock(&pack->lock);
+    if(_sparse_segment(pack, s))
+    {
+      GHashTableIter iter;
+      gpointer key, value;
+      g_hash_table_iter_init(&iter, pack->index);
+      while(g_hash_table_iter_next(&iter, &key, &value))
+      {
+        if(((dt_pack_location_t *)value)->segment == s)
+        {
+          const uint32_t k = GPOINTER_TO_UINT(key);
+          g_array_append_val(keys, k);
+        }
+      }
+    }
+    dt_pthread_mutex_unlock(&pack->lock);
+
+    if(!keys->len)
+    {
+      g_array_free(keys, TRUE);
+      continue;
+    }
+
+    // move them one by one so readers and writers are not blocked for long
+    gboolean all_moved = TRUE;
+    for(guint i = 0; i < keys->len; i++)
+    {
+      const uint32_t key = g_array_index(keys, uint32_t, i);
+      dt_pthread_mutex_lock(&pack->lock);
+      const dt_pack_location_t *loc = g_hash_table_lookup(pack->index, GUINT_TO_POINTER(key));
+      if(loc && loc->segment == s)
+      {
+        const dt_pack_location_t src = *loc;
+        if(_copy_record(pack, &src, key))
+          moved++;
+        else
+          all_moved = FALSE;
+      }
+      dt_pthread_mutex_unlock(&pack->lock);
+    }
+    g_array_free(keys, TRUE);
+
+    if(all_moved)
+    {
+      dt_pthread_mutex_lock(&pack->lock);
+      dt_pack_segment_t *seg = &pack->segment[s];
+      if(seg->map) g_mapped_file_unref(seg->map);
+      seg->map = NULL;
+      // the index must not point to the segment once it's gone
+      _save_index(pack);
+      char filename[PATH_MAX] = { 0 };
+      _segment_filename(pack, s, filename, sizeof(filename));
+      if(!g_unlink(filename))
+      {
+        reclaimed += seg->size;
+        seg->size = seg->live = 0;
+      }
+      dt_pthread_mutex_unlock(&pack->lock);
+    }
+  }
+
+  dt_pthread_mutex_lock(&pack->lock);
+  if(pack->dirty) _save_index(pack);
+  pack->compacting = FALSE;
+  dt_pthread_mutex_unlock(&pack->lock);
+
+  dt_print(DT_DEBUG_CACHE, "[mipmap_pack] compaction moved %d thumbnails, reclaimed %zuMB in %.3fs",
+           moved, reclaimed >> 20, dt_get_debug_wtime() - start);
+  return reclaimed;
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,101 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "common/colorspaces.h"
+#include "common/image.h"
+
+#include <glib.h>
+#include <inttypes.h>
+
+G_BEGIN_DECLS
+
+/**
+ * pack-file store for the 8-bit thumbnails of the mipmap cache.
+ *
+ * Instead of one jpg file per image and mip level, thumbnails are appended to a few
+ * large segment files. An in-memory index maps (imgid, mip) to the record position,
+ * it is saved on close and updated from the segment tails on open so a crash only
+ * costs a short replay. Reads are served from read-only memory mappings.
+ * Removed or replaced thumbnails leave garbage behind which is reclaimed by
+ * dt_mipmap_pack_compact() copying the live records of sparse segments.
+ */
+
+typedef enum dt_mipmap_pack_codec_t
+{
+  DT_MIPMAP_PACK_RAW = 0, // uncompressed 4 channel 8-bit
+  DT_MIPMAP_PACK_QOI = 1, // lossless QOI
+} dt_mipmap_pack_codec_t;
+
+typedef struct dt_mipmap_pack_t dt_mipmap_pack_t;
+
+/** open or create the store in directory, NULL on failure */
+dt_mipmap_pack_t *dt_mipmap_pack_open(const char *directory, const dt_mipmap_pack_codec_t codec);
+/** save the index and free all resources */
+void dt_mipmap_pack_close(dt_mipmap_pack_t *pack);
+
+gboolean dt_mipmap_pack_contains(dt_mipmap_pack_t *pack,
+                                 const dt_imgid_t imgid,
+                                 const int mip);
+
+/** decode the thumbnail into out, fails if it doesn't fit into max_width x max_height */
+gboolean dt_mipmap_pack_read(dt_mipmap_pack_t *pack,
+                             const dt_imgid_t imgid,
+                             const int mip,
+                             uint8_t *out,
+                             const int max_width,
+                             const int max_height,
+                             int *width,
+                             int *height,
+                             dt_colorspaces_color_profile_type_t *color_space);
+
+/** append a 4 channel 8-bit thumbnail, replacing an existing one */
+gboolean dt_mipmap_pack_write(dt_mipmap_pack_t *pack,
+                              const dt_imgid_t imgid,
+                              const int mip,
+                              const uint8_t *in,
+                              const int width,
+                              const int height,
+                              const dt_colorspaces_color_profile_type_t color_space);
+
+void dt_mipmap_pack_remove(dt_mipmap_pack_t *pack,
+                           const dt_imgid_t imgid,
+                           const int mip);
+
+/** copy the stored thumbnail without decoding */
+gboolean dt_mipmap_pack_copy(dt_mipmap_pack_t *pack,
+                             const dt_imgid_t dst_imgid,
+                             const dt_imgid_t src_imgid,
+                             const int mip);
+
+/** returns TRUE once if enough garbage has been collected to make a compaction worthwhile.
+    the caller is expected to run dt_mipmap_pack_compact() afterwards. */
+gboolean dt_mipmap_pack_needs_compaction(dt_mipmap_pack_t *pack);
+/** the compaction announced by dt_mipmap_pack_needs_compaction() won't run, ask again later */
+void dt_mipmap_pack_compaction_skipped(dt_mipmap_pack_t *pack);
+/** rewrite the live records of sparse segments, returns the number of reclaimed bytes */
+size_t dt_mipmap_pack_compact(dt_mipmap_pack_t *pack);
+
+G_END_DECLS
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -193,6 +193,12 @@ typedef struct dt_control_t
   GList *queues[DT_JOB_QUEUE_MAX];
   size_t queue_length[DT_JOB_QUEUE_MAX];
 
+  // per worker deques of child jobs for work stealing. the last one takes
+  // the children added from threads which are not workers.
+  GQueue *deque;
+  dt_pthread_mutex_t *deque_mutex;
+  dt_pthread_mutex_t dependency_mutex;
+
   dt_pthread_mutex_t res_mutex;
   dt_job_t *job_res[DT_CTL_WORKER_RESERVED];
   uint8_t new_res[DT_CTL_WORKER_RESERVED];
@@ -54,6 +54,16 @@ typedef struct _dt_job_t
   char description[DT_CONTROL_DESCRIPTION_LEN];
   dt_view_type_flags_t view_creator;
   gboolean is_synchronous;
+
+  // fan out: children run on all workers, a job is only finished once they are
+  struct _dt_job_t *parent;
+  dt_atomic_int children;
+
+  // protected by control->dependency_mutex
+  int dependencies;   // unfinished jobs this one has to wait for
+  GList *dependents;  // jobs waiting for this one
+  gboolean parked;    // added to a queue but waiting for its dependencies
+  gboolean failed_dependency; // one of the dependencies failed, the job won't run
 } _dt_job_t;
 
 /** check if two jobs are to be considered equal. a simple memcmp won't work since the mutexes probably won't
@@ -99,6 +109,12 @@ dt_job_state_t dt_control_job_get_state(_dt_job_t *job)
   dt_pthread_mutex_lock(&job->state_mutex);
   dt_job_state_t state = job->state;
   dt_pthread_mutex_unlock(&job->state_mutex);
+  // children are cancelled together with their parent. the parent is
+  // guaranteed to outlive them as it waits for all of them to finish.
+  if((state == DT_JOB_STATE_QUEUED || state == DT_JOB_STATE_RUNNING)
+     && job->parent
+     && dt_control_job_get_state(job->parent) == DT_JOB_STATE_CANCELLED)
+    state = DT_JOB_STATE_CANCELLED;
   return state;
 }
 
@@ -160,13 +176,56 @@ gboolean dt_control_job_is_synchronous(const dt_job_t *job)
   return job && job->is_synchronous;
 }
 
+static void _control_job_release_dependents(_dt_job_t *job,
+                                            const gboolean succeeded)
+{
+  dt_control_t *control = darktable.control;
+  if(!control->deque) return; // scheduler is not running
+
+  GList *ready = NULL;
+  dt_pthread_mutex_lock(&control->dependency_mutex);
+  for(GList *iter = job->dependents; iter; iter = g_list_next(iter))
+  {
+    _dt_job_t *other = iter->data;
+    // remembered for dependents not queued yet, dt_control_add_job() discards them
+    if(!succeeded) other->failed_dependency = TRUE;
+    if(--other->dependencies == 0 && other->parked)
+    {
+      other->parked = FALSE;
+      ready = g_list_prepend(ready, other);
+    }
+  }
+  g_list_free(job->dependents);
+  job->dependents = NULL;
+  dt_pthread_mutex_unlock(&control->dependency_mutex);
+
+  for(GList *iter = ready; iter; iter = g_list_next(iter))
+  {
+    _dt_job_t *other = iter->data;
+    dt_atomic_sub_int(&control->pending_jobs, 1); // counted again when queued
+    if(!other->failed_dependency && dt_control_job_get_state(other) == DT_JOB_STATE_QUEUED)
+      dt_control_add_job(other->queue, other);
+    else
+    {
+      // a failed dependency takes the jobs depending on it down as well
+      _control_job_set_state(other, DT_JOB_STATE_DISCARDED);
+      dt_control_job_dispose(other);
+    }
+  }
+  g_list_free(ready);
+}
+
 void dt_control_job_dispose(_dt_job_t *job)
 {
   if(!job) return;
   if(job->progress)
     dt_control_progress_destroy(job->progress);
   job->progress = NULL;
+  // only jobs running to completion without error satisfy their dependents
+  const gboolean succeeded = job->state == DT_JOB_STATE_FINISHED && job->result == 0;
   _control_job_set_state(job, DT_JOB_STATE_DISPOSED);
+  if(job->dependents)
+    _control_job_release_dependents(job, succeeded);
   if(job->params_destroy)
     job->params_destroy(job->params);
   dt_pthread_mutex_destroy(&job->state_mutex);
@@ -239,6 +298,7 @@ static gboolean _control_run_job_res(dt_control_t *control, int32_t res)
 
     /* execute job */
     job->result = job->execute(job);
+    dt_control_job_wait_children(job);
 
     _control_job_set_state(job, DT_JOB_STATE_FINISHED);
     _control_job_print(job, "run_job-", "", res);
@@ -248,7 +308,8 @@ static gboolean _control_run_job_res(dt_control_t *control, int32_t res)
   return FALSE;
 }
 
-static _dt_job_t *_control_schedule_job(dt_control_t *control)
+static _dt_job_t *_control_schedule_job(dt_control_t *control,
+                                         const gboolean foreground_only)
 {
   /*
    * job scheduling works like this:
@@ -259,6 +320,9 @@ static _dt_job_t *_control_schedule_job(dt_control_t *control)
    *   * user background
    *   * system background
    * - the jobs that didn't get picked this round get their priority incremented
+   * - with foreground_only the job is only picked if it won from one of the
+   *   foreground queues, so child jobs run before aged background work
+   *   but never delay the gui.
    */
 
   dt_pthread_mutex_lock(&control->queue_mutex);
@@ -280,7 +344,10 @@ static _dt_job_t *_control_schedule_job(dt_control_t *control)
     }
   }
 
-  if(!job)
+  if(!job
+     || (foreground_only
+         && winner_queue != DT_JOB_QUEUE_USER_FG
+         && winner_queue != DT_JOB_QUEUE_SYSTEM_FG))
   {
     dt_pthread_mutex_unlock(&control->queue_mutex);
     return NULL;
@@ -311,6 +378,76 @@ static _dt_job_t *_control_schedule_job(dt_control_t *control)
   return job;
 }
 
+// take a child job, newest first from our own deque, otherwise steal the oldest from another worker
+static _dt_job_t *_control_take_child(dt_control_t *control,
+                                      const int32_t self)
+{
+  const int32_t deques = control->num_threads + 1;
+  if(!control->deque) return NULL;
+
+  for(int32_t k = 0; k < deques; k++)
+  {
+    const int32_t victim = (self + k) % deques;
+    dt_pthread_mutex_lock(&control->deque_mutex[victim]);
+    _dt_job_t *job = k == 0 ? g_queue_pop_tail(&control->deque[victim])
+                            : g_queue_pop_head(&control->deque[victim]);
+    dt_pthread_mutex_unlock(&control->deque_mutex[victim]);
+    if(job) return job;
+  }
+  return NULL;
+}
+
+static void _control_job_execute(_dt_job_t *job);
+
+static void _control_run_child(dt_control_t *control,
+                               _dt_job_t *job)
+{
+  _dt_job_t *parent = job->parent;
+
+  dt_pthread_mutex_lock(&job->wait_mutex);
+  if(dt_control_job_get_state(job) == DT_JOB_STATE_QUEUED)
+    _control_job_execute(job);
+  else
+    _control_job_print(job, "run_child", "cancelled", -1);
+  dt_pthread_mutex_unlock(&job->wait_mutex);
+
+  dt_control_job_dispose(job);
+  dt_atomic_sub_int(&control->pending_jobs, 1);
+
+  // wake up the parent if it's waiting for us
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  dt_atomic_sub_int(&parent->children, 1);
+  pthread_cond_broadcast(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+}
+
+gboolean dt_control_job_help_children(void)
+{
+  dt_control_t *control = darktable.control;
+  _dt_job_t *child = _control_take_child(control, _control_get_threadid());
+  if(!child) return FALSE;
+  _control_run_child(control, child);
+  return TRUE;
+}
+
+void dt_control_job_wait_children(_dt_job_t *job)
+{
+  dt_control_t *control = darktable.control;
+  if(!job) return;
+
+  // instead of blocking a worker, help with the children (or whatever else is in the deques)
+  while(dt_atomic_get_int(&job->children) > 0)
+  {
+    if(dt_control_job_help_children())
+      continue;
+    // all remaining children are running on other workers
+    dt_pthread_mutex_lock(&control->cond_mutex);
+    if(dt_atomic_get_int(&job->children) > 0)
+      dt_pthread_cond_wait(&control->cond, &control->cond_mutex);
+    dt_pthread_mutex_unlock(&control->cond_mutex);
+  }
+}
+
 static void _control_job_execute(_dt_job_t *job)
 {
   _control_job_print(job, "run_job+", "", DT_CTL_WORKER_RESERVED + _control_get_threadid());
@@ -320,13 +457,28 @@ static void _control_job_execute(_dt_job_t *job)
   /* execute job */
   job->result = job->execute(job);
 
+  // the job is only done once all of its children are
+  dt_control_job_wait_children(job);
+
   _control_job_set_state(job, DT_JOB_STATE_FINISHED);
   _control_job_print(job, "run_job-", "", DT_CTL_WORKER_RESERVED + _control_get_threadid());
 }
 
 static gboolean _control_run_job(dt_control_t *control)
 {
-  _dt_job_t *job = _control_schedule_job(control);
+  // foreground jobs first to keep the gui responsive, then child jobs
+  // fanned out by running jobs, then everything else
+  _dt_job_t *job = _control_schedule_job(control, TRUE);
+  if(!job)
+  {
+    _dt_job_t *child = _control_take_child(control, _control_get_threadid());
+    if(child)
+    {
+      _control_run_child(control, child);
+      return FALSE;
+    }
+    job = _control_schedule_job(control, FALSE);
+  }
 
   if(!job) return TRUE;
 
@@ -350,6 +502,53 @@ static gboolean _control_run_job(dt_control_t *control)
   return FALSE;
 }
 
+gboolean dt_control_add_child_job(_dt_job_t *parent, _dt_job_t *job)
+{
+  dt_control_t *control = darktable.control;
+  if(!job) return TRUE;
+
+  job->parent = parent;
+  if(!parent || !control->deque || !dt_control_running())
+    return dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, job);
+
+  job->queue = parent->queue;
+  job->priority = parent->priority;
+  _control_job_print(job, "add_child", parent->description, _control_get_threadid());
+
+  dt_atomic_add_int(&parent->children, 1);
+  dt_atomic_add_int(&control->pending_jobs, 1);
+  _control_job_set_state(job, DT_JOB_STATE_QUEUED);
+
+  // the worker running the parent will likely pick it up itself, idle ones steal it
+  const int32_t self = MIN(_control_get_threadid(), control->num_threads);
+  dt_pthread_mutex_lock(&control->deque_mutex[self]);
+  g_queue_push_tail(&control->deque[self], job);
+  dt_pthread_mutex_unlock(&control->deque_mutex[self]);
+
+  dt_pthread_mutex_lock(&control->cond_mutex);
+  pthread_cond_broadcast(&control->cond);
+  dt_pthread_mutex_unlock(&control->cond_mutex);
+
+  return FALSE;
+}
+
+void dt_control_job_add_dependency(_dt_job_t *job, _dt_job_t *dependency)
+{
+  dt_control_t *control = darktable.control;
+  if(!job || !dependency || !control->deque) return;
+  if(dt_control_job_get_state(job) != DT_JOB_STATE_INITIALIZED
+     || dt_control_job_get_state(dependency) != DT_JOB_STATE_INITIALIZED)
+  {
+    _control_job_print(job, "add_dependency", "jobs must not be queued yet", -1);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&control->dependency_mutex);
+  job->dependencies++;
+  dependency->dependents = g_list_prepend(dependency->dependents, job);
+  dt_pthread_mutex_unlock(&control->dependency_mutex);
+}
+
 gboolean dt_control_add_job_res(_dt_job_t *job, const int32_t res)
 {
   dt_control_t *control = darktable.control;
@@ -393,6 +592,19 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
     return TRUE;
   }
 
+  // a dependency failed before the job got queued. while others are still pending it's
+  // parked below and discarded once they are done, as they still refer to it.
+  dt_pthread_mutex_lock(&control->dependency_mutex);
+  const gboolean failed = job->failed_dependency && job->dependencies == 0;
+  dt_pthread_mutex_unlock(&control->dependency_mutex);
+  if(failed)
+  {
+    _control_job_print(job, "add_job", "dependency failed", -1);
+    _control_job_set_state(job, DT_JOB_STATE_DISCARDED);
+    dt_control_job_dispose(job);
+    return TRUE;
+  }
+
   if(!dt_control_running() || queue_id == DT_JOB_QUEUE_SYNCHRONOUS)
   {
     // whatever we are adding here won't be scheduled as the system isn't running. execute it synchronous instead.
@@ -407,7 +619,20 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
 
   job->queue = queue_id;
 
+  // jobs waiting for others are parked until the last dependency is done
+  dt_pthread_mutex_lock(&control->dependency_mutex);
+  const gboolean parked = job->parked = job->dependencies > 0;
+  dt_pthread_mutex_unlock(&control->dependency_mutex);
+  if(parked)
+  {
+    _control_job_print(job, "add_job", "waiting for dependencies", job->dependencies);
+    dt_atomic_add_int(&control->pending_jobs, 1);
+    _control_job_set_state(job, DT_JOB_STATE_QUEUED);
+    return FALSE;
+  }
+
   _dt_job_t *job_for_disposal = NULL;
+  _dt_job_t *job_dropped = NULL;
 
   dt_pthread_mutex_lock(&control->queue_mutex);
 
@@ -466,9 +691,9 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
     // and take care of the maximal queue size
     if(length > DT_CONTROL_MAX_JOBS)
     {
+      // disposed after unlocking, it might release dependent jobs
       GList *last = g_list_last(*queue);
-      _control_job_set_state(last->data, DT_JOB_STATE_DISCARDED);
-      dt_control_job_dispose(last->data);
+      job_dropped = last->data;
       *queue = g_list_delete_link(*queue, last);
       length--;
       dt_atomic_sub_int(&control->pending_jobs, 1);
@@ -496,9 +721,11 @@ gboolean dt_control_add_job(dt_job_queue_t queue_id, _dt_job_t *job)
   pthread_cond_broadcast(&control->cond);
   dt_pthread_mutex_unlock(&control->cond_mutex);
 
-  // dispose of dropped job, if any
+  // dispose of dropped jobs, if any
   _control_job_set_state(job_for_disposal, DT_JOB_STATE_DISCARDED);
   dt_control_job_dispose(job_for_disposal);
+  _control_job_set_state(job_dropped, DT_JOB_STATE_DISCARDED);
+  dt_control_job_dispose(job_dropped);
 
   return FALSE;
 }
@@ -619,6 +846,11 @@ void dt_control_jobs_init()
   control->num_threads = dt_worker_threads();
   control->thread = (pthread_t *)calloc(control->num_threads, sizeof(pthread_t));
   control->job = (dt_job_t **)calloc(control->num_threads, sizeof(dt_job_t *));
+  control->deque = g_new0(GQueue, control->num_threads + 1);
+  control->deque_mutex = g_new(dt_pthread_mutex_t, control->num_threads + 1);
+  for(int k = 0; k <= control->num_threads; k++)
+    dt_pthread_mutex_init(&control->deque_mutex[k], NULL);
+  dt_pthread_mutex_init(&control->dependency_mutex, NULL);
 
   g_atomic_int_set(&control->running, DT_CONTROL_STATE_RUNNING);
 
@@ -691,6 +923,20 @@ void dt_control_jobs_cleanup()
   control->job = NULL;
   free(control->thread);
   control->thread = NULL;
+  if(control->deque)
+  {
+    for(int k = 0; k <= control->num_threads; k++)
+    {
+      // parents are gone, so should be their children
+      g_queue_clear_full(&control->deque[k], (GDestroyNotify)dt_control_job_dispose);
+      dt_pthread_mutex_destroy(&control->deque_mutex[k]);
+    }
+    g_free(control->deque);
+    g_free(control->deque_mutex);
+    control->deque = NULL;
+    control->deque_mutex = NULL;
+    dt_pthread_mutex_destroy(&control->dependency_mutex);
+  }
 }
 
 int dt_control_jobs_pending()
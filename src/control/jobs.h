@@ -87,6 +87,18 @@ gboolean dt_control_all_running(void);
 gboolean dt_control_add_job(dt_job_queue_t queue_id, dt_job_t *job);
 gboolean dt_control_add_job_res(dt_job_t *job, const int32_t res);
 
+/** fan out: add a job to be run by any idle worker as a child of parent, usually called from
+    within the execute callback of parent. the child is cancelled together with its parent and
+    the parent is only finished once all its children are. */
+gboolean dt_control_add_child_job(dt_job_t *parent, dt_job_t *job);
+/** run one queued child job on the calling thread, FALSE if there was none to run */
+gboolean dt_control_job_help_children(void);
+/** wait for all children of job, running queued ones on the calling thread meanwhile */
+void dt_control_job_wait_children(dt_job_t *job);
+/** job won't be scheduled before dependency has finished, it's discarded if dependency fails,
+    is cancelled or returns an error. both jobs must not have been added to a queue yet. */
+void dt_control_job_add_dependency(dt_job_t *job, dt_job_t *dependency);
+
 dt_view_type_flags_t dt_control_job_get_view_creator(const dt_job_t *job);
 gboolean dt_control_job_is_synchronous(const dt_job_t *job);
 
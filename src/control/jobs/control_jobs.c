@@ -170,12 +170,15 @@ static void _control_image_enumerator_job_film_init(dt_control_image_enumerator_
 }
 
 static void _collection_update(double *last_update,
-                               double *update_interval)
+                               double *update_interval,
+                               dt_image_import_bulk_t *bulk)
 {
   const double currtime = dt_get_wtime();
   if(currtime - *last_update > *update_interval)
   {
     *last_update = currtime;
+    // a bulk import must make its images visible to the query
+    if(bulk) dt_image_import_bulk_commit(bulk);
     // We want frequent updates at the beginning to make the import
     // feel responsive, but large imports should use infrequent
     // updates to get the fastest import.  So we gradually increase
@@ -742,7 +745,7 @@ static int32_t _control_duplicate_images_job_run(dt_job_t *job)
       // a duplicate should keep the change time stamp of the original
       dt_image_cache_set_change_timestamp_from_image(newimgid, imgid);
 
-      _collection_update(&last_coll_update, &update_interval);
+      _collection_update(&last_coll_update, &update_interval, NULL);
     }
     fraction += 1.0 / total;
     _update_progress(job, fraction, &prev_time);
@@ -1805,6 +1808,234 @@ static int32_t _control_apply_styles_job_run(dt_job_t *job)
   return 0;
 }
 
+// state shared by all images of one export
+typedef struct dt_control_export_ctx_t
+{
+  dt_job_t *job;
+  dt_control_export_t *settings;
+  dt_imageio_module_format_t *mformat;
+  dt_imageio_module_storage_t *mstorage;
+  dt_imageio_module_data_t *sdata;
+  dt_imageio_module_data_t *fdata;
+  dt_export_metadata_t *metadata;
+  guint tagid, etagid;
+  guint total;
+
+  // protected by lock
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  int in_flight;
+  size_t mem_in_flight;
+  guint done;
+  double fraction, prev_time;
+  gboolean tag_change;
+} dt_control_export_ctx_t;
+
+typedef struct dt_control_export_image_t
+{
+  dt_control_export_ctx_t *ctx;
+  dt_imgid_t imgid;
+  guint num;
+  size_t mem;
+} dt_control_export_image_t;
+
+// mark the image as exported once its file has been written
+static void _control_export_tag(dt_control_export_ctx_t *ctx,
+                                const dt_imgid_t imgid)
+{
+  // remove 'changed' tag from image
+  gboolean tag_change = dt_tag_detach(ctx->tagid, imgid, FALSE, FALSE);
+  // make sure the 'exported' tag is set on the image
+  tag_change |= dt_tag_attach(ctx->etagid, imgid, FALSE, FALSE);
+
+  /* register export timestamp in cache */
+  dt_image_cache_set_export_timestamp(imgid);
+
+  if(tag_change)
+  {
+    dt_pthread_mutex_lock(&ctx->lock);
+    ctx->tag_change = TRUE;
+    dt_pthread_mutex_unlock(&ctx->lock);
+  }
+}
+
+// called by the write stage for deferred writes
+static void _control_export_written(const dt_imgid_t imgid,
+                                    const char *filename,
+                                    const int num,
+                                    const int total,
+                                    const gboolean failed,
+                                    void *data)
+{
+  if(!failed) _control_export_tag(data, imgid);
+}
+
+// export a single image, returns FALSE if the storage failed
+static gboolean _control_export_image(dt_control_export_ctx_t *ctx,
+                                      const dt_imgid_t imgid,
+                                      const guint num,
+                                      dt_imageio_module_data_t *fdata)
+{
+  dt_control_export_t *settings = ctx->settings;
+
+  // check if image still exists:
+  const dt_image_t *image = dt_image_cache_get(imgid, 'r');
+  if(!image) return TRUE;
+
+  char imgfilename[PATH_MAX] = { 0 };
+  gboolean from_cache = TRUE;
+  dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
+  if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
+  {
+    dt_control_log(_("image `%s' is currently unavailable"), image->filename);
+    dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable", imgfilename);
+    // dt_image_remove(imgid);
+    dt_image_cache_read_release(image);
+    return TRUE;
+  }
+  dt_image_cache_read_release(image);
+
+  if(ctx->mstorage->store(ctx->mstorage, ctx->sdata, imgid, ctx->mformat, fdata,
+                          num, ctx->total, settings->high_quality, settings->upscale,
+                          settings->is_scaling, settings->scale_factor,
+                          settings->export_masks, settings->icc_type,
+                          settings->icc_filename, settings->icc_intent,
+                          ctx->metadata) != 0)
+    return FALSE;
+
+  // a deferred write is tagged by _control_export_written()
+  if(!dt_imageio_write_stage_deferred())
+    _control_export_tag(ctx, imgid);
+  return TRUE;
+}
+
+// rough size of a full resolution export pipe of the image: input, output
+// and a couple of intermediate 4 channel float buffers
+static size_t _control_export_mem_estimate(const dt_imgid_t imgid)
+{
+  const dt_image_t *image = dt_image_cache_get(imgid, 'r');
+  if(!image) return 0;
+  const size_t pixels = (size_t)image->width * image->height;
+  dt_image_cache_read_release(image);
+  return pixels * 4 * sizeof(float) * 4;
+}
+
+static int32_t _control_export_image_job_run(dt_job_t *job)
+{
+  dt_control_export_image_t *p = dt_control_job_get_params(job);
+  dt_control_export_ctx_t *ctx = p->ctx;
+
+  // every image needs its own format parameters as the export writes the
+  // actual dimensions into them
+  dt_imageio_module_format_t *mformat = ctx->mformat;
+  dt_imageio_module_data_t *fdata = mformat->get_params(mformat);
+  if(fdata)
+  {
+    memcpy(fdata, ctx->fdata, mformat->params_size(mformat));
+    if(!_control_export_image(ctx, p->imgid, p->num, fdata))
+      dt_control_job_cancel(ctx->job);
+    mformat->free_params(mformat, fdata);
+  }
+  else
+    dt_control_job_cancel(ctx->job);
+
+  dt_pthread_mutex_lock(&ctx->lock);
+  ctx->in_flight--;
+  ctx->mem_in_flight -= p->mem;
+  ctx->done++;
+  ctx->fraction += 1.0 / ctx->total;
+  dt_control_job_set_progress_message(ctx->job, _("exporting %d / %d to %s"),
+                                      ctx->done, ctx->total,
+                                      ctx->mstorage->name(ctx->mstorage));
+  _update_progress(ctx->job, ctx->fraction, &ctx->prev_time);
+  pthread_cond_broadcast(&ctx->cond);
+  dt_pthread_mutex_unlock(&ctx->lock);
+  return 0;
+}
+
+// number of images to export concurrently
+static int _control_export_parallel(dt_imageio_module_storage_t *mstorage,
+                                    dt_imageio_module_format_t *mformat,
+                                    dt_imageio_module_data_t *fdata,
+                                    const guint total)
+{
+  if(total < 2 || !mstorage->parallel_store || !mstorage->parallel_store(mstorage))
+    return 1;
+  // formats carrying state from one image to the next (pdf) need them in order
+  if(mformat->flags && (mformat->flags(fdata) & FORMAT_FLAGS_SHARED_PARAMS))
+    return 1;
+  return CLAMP(dt_conf_get_int("export_parallel_images"), 1, (int)total);
+}
+
+static void _control_export_images_parallel(dt_control_export_ctx_t *ctx,
+                                            GList *images,
+                                            const int parallel)
+{
+  dt_job_t *job = ctx->job;
+  const size_t budget = dt_get_available_mem();
+  dt_print(DT_DEBUG_ALWAYS,
+           "[export_job] exporting up to %d images in parallel within %zuMB",
+           parallel, budget / DT_MEGA);
+
+  guint num = 0;
+  for(GList *t = images; t && !_job_cancelled(job); t = g_list_next(t))
+  {
+    const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
+    const size_t mem = _control_export_mem_estimate(imgid);
+    num++;
+
+    // admission: always allow one image, more only while they fit into the memory budget.
+    // while waiting we export queued images ourselves instead of idling on a worker, and
+    // only block once all of them are running elsewhere.
+    dt_pthread_mutex_lock(&ctx->lock);
+    while(ctx->in_flight
+          && (ctx->in_flight >= parallel || ctx->mem_in_flight + mem > budget)
+          && !_job_cancelled(job))
+    {
+      dt_pthread_mutex_unlock(&ctx->lock);
+      const gboolean helped = dt_control_job_help_children();
+      dt_pthread_mutex_lock(&ctx->lock);
+      if(!helped
+         && ctx->in_flight
+         && (ctx->in_flight >= parallel || ctx->mem_in_flight + mem > budget)
+         && !_job_cancelled(job))
+        dt_pthread_cond_wait(&ctx->cond, &ctx->lock);
+    }
+    const gboolean admitted = !_job_cancelled(job);
+    if(admitted)
+    {
+      ctx->in_flight++;
+      ctx->mem_in_flight += mem;
+    }
+    dt_pthread_mutex_unlock(&ctx->lock);
+    if(!admitted) break;
+
+    dt_control_export_image_t *p = calloc(1, sizeof(dt_control_export_image_t));
+    dt_job_t *child = dt_control_job_create(&_control_export_image_job_run,
+                                            "export image %d", imgid);
+    if(!p || !child)
+    {
+      free(p);
+      dt_control_job_dispose(child);
+      dt_pthread_mutex_lock(&ctx->lock);
+      ctx->in_flight--;
+      ctx->mem_in_flight -= mem;
+      dt_pthread_mutex_unlock(&ctx->lock);
+      dt_control_job_cancel(job);
+      break;
+    }
+    p->ctx = ctx;
+    p->imgid = imgid;
+    p->num = num;
+    p->mem = mem;
+    dt_control_job_set_params(child, p, free);
+    dt_control_add_child_job(job, child);
+  }
+
+  // the storage may only be finalized once all images are done
+  dt_control_job_wait_children(job);
+}
+
 static int32_t _control_export_job_run(dt_job_t *job)
 {
   dt_stop_backthumbs_crawler(FALSE);
@@ -1894,61 +2125,56 @@ static int32_t _control_export_job_run(dt_job_t *job)
     metadata.list = g_list_remove(metadata.list, metadata.list->data);
   }
 
-  GList *t = params->index;
-  double prev_time = 0;
-
-  while(t && !_job_cancelled(job))
+  dt_control_export_ctx_t ctx = { 0 };
+  ctx.job = job;
+  ctx.settings = settings;
+  ctx.mformat = mformat;
+  ctx.mstorage = mstorage;
+  ctx.sdata = sdata;
+  ctx.fdata = fdata;
+  ctx.metadata = &metadata;
+  ctx.tagid = tagid;
+  ctx.etagid = etagid;
+  ctx.total = total;
+  dt_pthread_mutex_init(&ctx.lock, NULL);
+  pthread_cond_init(&ctx.cond, NULL);
+
+  const int parallel = _control_export_parallel(mstorage, mformat, fdata, total);
+  if(parallel > 1)
+    _control_export_images_parallel(&ctx, params->index, parallel);
+  else
   {
-    const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
-    t = g_list_next(t);
-    const guint num = total - g_list_length(t);
+    GList *t = params->index;
+    double prev_time = 0;
 
-    // progress message
-    // update the message. initialize_store() might have changed the number of images
-    dt_control_job_set_progress_message(job, _("exporting %d / %d to %s"),
-                                             num, total, mstorage->name(mstorage));
+    // encode and write the previous image while the next one is processed
+    dt_imageio_write_stage_t *stage =
+      total > 1 ? dt_imageio_write_stage_start(1, _control_export_written, &ctx) : NULL;
 
-    // check if image still exists:
-    const dt_image_t *image = dt_image_cache_get(imgid, 'r');
-    if(image)
+    while(t && !_job_cancelled(job))
     {
-      char imgfilename[PATH_MAX] = { 0 };
-      gboolean from_cache = TRUE;
-      dt_image_full_path(image->id, imgfilename, sizeof(imgfilename), &from_cache);
-      if(!g_file_test(imgfilename, G_FILE_TEST_IS_REGULAR))
-      {
-        dt_control_log(_("image `%s' is currently unavailable"), image->filename);
-        dt_print(DT_DEBUG_ALWAYS, "image `%s' is currently unavailable", imgfilename);
-        // dt_image_remove(imgid);
-        dt_image_cache_read_release(image);
-      }
-      else
-      {
-        dt_image_cache_read_release(image);
-        if(mstorage->store(mstorage, sdata, imgid, mformat, fdata,
-                           num, total, settings->high_quality, settings->upscale,
-                           settings->is_scaling, settings->scale_factor,
-                           settings->export_masks, settings->icc_type,
-                           settings->icc_filename, settings->icc_intent,
-                           &metadata) != 0)
-          dt_control_job_cancel(job);
-        else
-        {
-          // remove 'changed' tag from image
-          if(dt_tag_detach(tagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+      const dt_imgid_t imgid = GPOINTER_TO_INT(t->data);
+      t = g_list_next(t);
+      const guint num = total - g_list_length(t);
 
-          // make sure the 'exported' tag is set on the image
-          if(dt_tag_attach(etagid, imgid, FALSE, FALSE)) tag_change = TRUE;
+      // progress message
+      // update the message. initialize_store() might have changed the number of images
+      dt_control_job_set_progress_message(job, _("exporting %d / %d to %s"),
+                                               num, total, mstorage->name(mstorage));
 
-          /* register export timestamp in cache */
-          dt_image_cache_set_export_timestamp(imgid);
-        }
-      }
+      if(!_control_export_image(&ctx, imgid, num, fdata))
+        dt_control_job_cancel(job);
+
+      fraction += 1.0 / total;
+      _update_progress(job, fraction, &prev_time);
     }
 
-    fraction += 1.0 / total;
-    _update_progress(job, fraction, &prev_time);
+    if(dt_imageio_write_stage_finish(stage))
+      dt_control_job_cancel(job);
   }
+  tag_change = ctx.tag_change;
+  pthread_cond_destroy(&ctx.cond);
+  dt_pthread_mutex_destroy(&ctx.lock);
   g_list_free_full(metadata.list, g_free);
 
   if(mstorage->finalize_store) mstorage->finalize_store(mstorage, sdata);
@@ -2900,18 +3126,21 @@ static int _control_import_image_copy(const char *filename,
 static int _control_import_image_insitu(const char *filename,
                                         GList **imgs,
                                         double *last_update,
-                                        double *update_interval)
+                                        double *update_interval,
+                                        dt_image_import_bulk_t *bulk)
 {
   dt_conf_set_int("ui_last/import_last_image", -1);
   char *dirname = dt_util_path_get_dirname(filename);
   dt_film_t film;
   const dt_filmid_t filmid = dt_film_new(&film, dirname);
-  const dt_imgid_t imgid = dt_image_import(filmid, filename, FALSE, FALSE);
+  const dt_imgid_t imgid = bulk
+    ? dt_image_import_bulk(bulk, filmid, filename, FALSE)
+    : dt_image_import(filmid, filename, FALSE, FALSE);
   if(!dt_is_valid_imgid(imgid)) dt_control_log(_("error loading file `%s'"), filename);
   else
   {
     *imgs = g_list_prepend(*imgs, GINT_TO_POINTER(imgid));
-    _collection_update(last_update, update_interval);
+    _collection_update(last_update, update_interval, bulk);
     dt_conf_set_int("ui_last/import_last_image", imgid);
   }
   g_free(dirname);
@@ -2997,6 +3226,10 @@ static int32_t _control_import_job_run(dt_job_t *job)
   double update_interval = INIT_UPDATE_INTERVAL;
   char *prev_filename = NULL;
   char *prev_output = NULL;
+  // large imports defer the sidecars and batch the database writes
+  dt_image_import_bulk_t *bulk = !data->session && dt_conf_get_bool("ui_last/import_bulk")
+                               ? dt_image_import_bulk_new(t)
+                               : NULL;
   for(GList *img = t; img && !_job_cancelled(job); img = g_list_next(img))
   {
     if(data->session)
@@ -3023,12 +3256,12 @@ static int32_t _control_import_job_run(dt_job_t *job)
         dt_conf_set_int("plugins/lighttable/collect/num_rules", 1);
         dt_conf_set_int("plugins/lighttable/collect/item0", property);
         dt_conf_set_string("plugins/lighttable/collect/string0", output_path);
-        _collection_update(&last_coll_update, &update_interval);
+        _collection_update(&last_coll_update, &update_interval, NULL);
       }
     }
     else
       filmid = _control_import_image_insitu((char *)img->data, &imgs,
-                                            &last_coll_update, &update_interval);
+                                            &last_coll_update, &update_interval, bulk);
     if(filmid != -1)
       cntr++;
     fraction += 1.0 / total;
@@ -3043,6 +3276,7 @@ static int32_t _control_import_job_run(dt_job_t *job)
     }
   }
   g_free(prev_output);
+  dt_image_import_bulk_free(bulk);
 
   dt_control_log(ngettext("imported %d image", "imported %d images", cntr), cntr);
   dt_control_queue_redraw_center();
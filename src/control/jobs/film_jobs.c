@@ -299,6 +299,11 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
   GList *imgs = NULL;
   GList *all_imgs = NULL;
 
+  // large imports defer the sidecars and batch the database writes
+  dt_image_import_bulk_t *bulk = dt_conf_get_bool("ui_last/import_bulk")
+                               ? dt_image_import_bulk_new(images)
+                               : NULL;
+
   /* loop thru the images and import to current film roll */
   dt_film_t *cfr = film;
   int pending = 0;
@@ -333,7 +338,9 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
     g_free(cdn);
 
     /* import image */
-    const dt_imgid_t imgid = dt_image_import(cfr->id, (const gchar *)image->data, FALSE, FALSE);
+    const dt_imgid_t imgid = bulk
+      ? dt_image_import_bulk(bulk, cfr->id, (const gchar *)image->data, FALSE)
+      : dt_image_import(cfr->id, (const gchar *)image->data, FALSE, FALSE);
     pending++;  // we have another image which hasn't been reported yet
     fraction += 1.0 / total;
     dt_control_job_set_progress(job, fraction);
@@ -345,6 +352,7 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
     //   one, update the interface
     if(pending >= 4 && curr_time - last_update > 0.5)
     {
+      if(bulk) dt_image_import_bulk_commit(bulk);
       dt_collection_update_query(darktable.collection, DT_COLLECTION_CHANGE_RELOAD, DT_COLLECTION_PROP_UNDEF,
                                  g_list_copy(imgs));
       g_list_free(imgs);
@@ -357,6 +365,7 @@ static void _film_import1(dt_job_t *job, dt_film_t *film, GList *images)
       break;
   }
 
+  dt_image_import_bulk_free(bulk);
   g_list_free_full(images, g_free);
   all_imgs = g_list_reverse(all_imgs);
 
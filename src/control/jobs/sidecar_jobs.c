@@ -17,12 +17,12 @@
 */
 
 #include "control/jobs/sidecar_jobs.h"
+#include "common/dtpthread.h"
 
 static GSList *pending_images = NULL;
 static gboolean background_running = FALSE;
 
 #ifndef _OPENMP
-#include "common/dtpthread.h"
 static gboolean lock_initialized = FALSE;
 static dt_pthread_mutex_t pending_mutex;
 
@@ -45,21 +45,49 @@ static void _unlock_pending_queue()
 }
 #endif /* !_OPENMP */
 
+// an image is only written once it has not been changed for this many
+// seconds, a burst of edits (slider drags, rating a range of images)
+// ends up as a single sidecar write
+#define DT_SIDECAR_DEBOUNCE 0.5
+// number of sidecars written concurrently, writes are mostly waiting on
+// the file system which on network shares has a high latency per file
+#define DT_SIDECAR_WRITERS 4
+
+// images handed to the writer pool and not finished yet, an image is
+// never written by two workers at the same time
+static GHashTable *in_flight = NULL;
+static dt_pthread_mutex_t flight_mutex;
+
+static void _sidecar_write_worker(gpointer data, gpointer user_data)
+{
+  const dt_imgid_t imgid = GPOINTER_TO_INT(data);
+  dt_image_write_sidecar_file(imgid);
+
+  dt_pthread_mutex_lock(&flight_mutex);
+  g_hash_table_remove(in_flight, data);
+  dt_pthread_mutex_unlock(&flight_mutex);
+}
+
 static int32_t _control_write_sidecars_job_run(dt_job_t *job)
 {
-  GSList *imgs = NULL;
-  GHashTable *enqueued = g_hash_table_new(g_direct_hash, g_direct_equal);
+  // image id -> time of the most recent request for it
+  GHashTable *due = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+  in_flight = g_hash_table_new(g_direct_hash, g_direct_equal);
+  dt_pthread_mutex_init(&flight_mutex, NULL);
+  GThreadPool *writers = g_thread_pool_new(_sidecar_write_worker, NULL,
+                                           DT_SIDECAR_WRITERS, FALSE, NULL);
 
   double prev_fetch = 0;
   // keep going until explicitly cancelled or darktable shuts down AND all writes have finished
-  while(imgs || (dt_control_running() && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED))
+  while(g_hash_table_size(due)
+        || (dt_control_running() && dt_control_job_get_state(job) != DT_JOB_STATE_CANCELLED))
   {
     GSList *new_imgs = NULL;
-    double curr_fetch = dt_get_wtime();
-    // grab any pending images and add them to the list of images to be synchronized
-    if(curr_fetch > prev_fetch + 0.25)
+    const double now = dt_get_wtime();
+    // grab any pending images and add them to the set of images to be synchronized
+    if(now > prev_fetch + 0.1)
     {
-      prev_fetch = curr_fetch;
+      prev_fetch = now;
 #ifdef _OPENMP
 #pragma omp atomic capture
       { new_imgs = pending_images; pending_images = NULL ; }
@@ -70,44 +98,51 @@ static int32_t _control_write_sidecars_job_run(dt_job_t *job)
       pending_images = NULL;
       _unlock_pending_queue();
 #endif
-      if(new_imgs)
+      // requests for an image already waiting are coalesced, the newest
+      // request restarts its debounce period
+      for(GSList *imglist = new_imgs; imglist; imglist = g_slist_next(imglist))
       {
-        // add the new images to the queue being processed if they are not already on the queue
-        GSList *to_add = NULL;
-        for(GSList *imglist = new_imgs; imglist; imglist = g_slist_next(imglist))
-        {
-          if(!g_hash_table_contains(enqueued,GINT_TO_POINTER(imglist->data)))
-          {
-            to_add = g_slist_prepend(to_add, imglist->data);
-            g_hash_table_insert(enqueued, GINT_TO_POINTER(imglist->data), GINT_TO_POINTER(imglist->data));
-          }
-        }
-        imgs = g_slist_concat(imgs, to_add);
-        g_slist_free(new_imgs);
+        double *stamp = g_new(double, 1);
+        *stamp = now;
+        g_hash_table_insert(due, imglist->data, stamp);
       }
+      g_slist_free(new_imgs);
     }
-    // synchronize the first few images on the queue
-    for(int i = 0; imgs && i < 3; i++)
-    {
-      dt_imgid_t imgid = GPOINTER_TO_INT(imgs->data);
-      dt_image_write_sidecar_file(imgid);
-      // remove the head of the image queue
-      g_hash_table_remove(enqueued, GINT_TO_POINTER(imgid));
-      imgs = g_slist_delete_link(imgs, imgs);
-    }
-    if(imgs) // do we have more images already queued?
-    {
-      // give others a chance to run by sleeping 10ms; avoids apparent
-      // hangs when trying to switch views
-      g_usleep(10000);
-    }
-    else
+
+    // on shutdown don't wait for the debounce period any more
+    const gboolean flush = !dt_control_running()
+                           || dt_control_job_get_state(job) == DT_JOB_STATE_CANCELLED;
+
+    // hand the settled images to the writer pool. An image still being
+    // written stays in the set and is written again afterwards as it
+    // has been changed in the meantime.
+    GHashTableIter iter;
+    gpointer key, value;
+    dt_pthread_mutex_lock(&flight_mutex);
+    g_hash_table_iter_init(&iter, due);
+    while(g_hash_table_iter_next(&iter, &key, &value))
     {
-      // we currently have nothing to do, so wait 1 second before checking for more work
-      g_usleep(1000000);
+      if((flush || now - *(double *)value >= DT_SIDECAR_DEBOUNCE)
+         && !g_hash_table_contains(in_flight, key))
+      {
+        g_hash_table_add(in_flight, key);
+        g_hash_table_iter_remove(&iter);
+        g_thread_pool_push(writers, key, NULL);
+      }
     }
+    dt_pthread_mutex_unlock(&flight_mutex);
+
+    // poll often enough for the debounce period while there is work,
+    // otherwise wait a bit longer before checking for more
+    g_usleep(g_hash_table_size(due) ? 50000 : 250000);
   }
-  g_hash_table_destroy(enqueued);
+
+  // wait for the writes still running
+  g_thread_pool_free(writers, FALSE, TRUE);
+  g_hash_table_destroy(due);
+  g_hash_table_destroy(in_flight);
+  in_flight = NULL;
+  dt_pthread_mutex_destroy(&flight_mutex);
   return 0;
 }
 
@@ -623,6 +623,28 @@ void dt_masks_iop_use_same_as(struct dt_iop_module_t *module,
                               struct dt_iop_module_t *src);
 dt_hash_t dt_masks_group_hash(dt_hash_t hash, dt_masks_form_t *form);
 
+/** cache of rasterized forms, see dt_masks_raster_hash() for the key */
+void dt_masks_raster_cache_init(void);
+void dt_masks_raster_cache_cleanup(void);
+/** hash of everything the rasterization of the form into roi depends on */
+dt_hash_t dt_masks_raster_hash(const dt_iop_module_t *const module,
+                               const dt_dev_pixelpipe_iop_t *const piece,
+                               dt_masks_form_t *const form,
+                               const dt_iop_roi_t *const roi);
+/** write the cached non-zero area into buffer (roi sized, zero outside of
+    box) and return its bounding box as x, y, width, height.
+    returns FALSE if not cached */
+gboolean dt_masks_raster_cache_get(const dt_hash_t hash,
+                                   const dt_iop_roi_t *const roi,
+                                   float *const buffer,
+                                   int box[4]);
+/** store the rasterized form, box receives the bounding box of its
+    non-zero area even if the cache is disabled */
+void dt_masks_raster_cache_put(const dt_hash_t hash,
+                               const dt_iop_roi_t *const roi,
+                               const float *const buffer,
+                               int box[4]);
+
 void dt_masks_form_remove(struct dt_iop_module_t *module,
                           dt_masks_form_t *grp,
                           dt_masks_form_t *form);
@@ -625,6 +625,65 @@ static void _combine_masks_exclusion(float *const restrict dest,
   }
 }
 
+static void _clear_box(float *const restrict buf,
+                       const int width,
+                       const int box[4])
+{
+  if(box[0] == 0 && box[2] == width)
+  {
+    memset(buf + (size_t)box[1] * width, 0, sizeof(float) * width * box[3]);
+    return;
+  }
+  DT_OMP_FOR()
+  for(int row = box[1]; row < box[1] + box[3]; row++)
+    memset(buf + (size_t)row * width + box[0], 0, sizeof(float) * box[2]);
+}
+
+// combine a shape that is zero outside of box. For these operators a zero
+// shape leaves the destination unchanged, so only the box is processed.
+static void _combine_masks_box(float *const restrict dest,
+                               const float *const restrict newmask,
+                               const int width,
+                               const int box[4],
+                               const float opacity,
+                               const int state)
+{
+  DT_OMP_FOR()
+  for(int row = box[1]; row < box[1] + box[3]; row++)
+  {
+    float *const restrict d = dest + (size_t)row * width + box[0];
+    const float *const restrict m = newmask + (size_t)row * width + box[0];
+    if(state & DT_MASKS_STATE_UNION)
+    {
+      for(int k = 0; k < box[2]; k++)
+        d[k] = MAX(d[k], opacity * m[k]);
+    }
+    else if(state & DT_MASKS_STATE_DIFFERENCE)
+    {
+      for(int k = 0; k < box[2]; k++)
+      {
+        const float mask = opacity * m[k];
+        d[k] *= (1.0f - mask * both_positive(d[k], mask));
+      }
+    }
+    else if(state & DT_MASKS_STATE_SUM)
+    {
+      for(int k = 0; k < box[2]; k++)
+        d[k] = MIN(1.0f, d[k] + opacity * m[k]);
+    }
+    else // DT_MASKS_STATE_EXCLUSION
+    {
+      for(int k = 0; k < box[2]; k++)
+      {
+        const float mask = opacity * m[k];
+        const float pos = both_positive(d[k], mask);
+        const float b1 = d[k];
+        d[k] = pos * MAX((1.0f - b1) * mask, b1 * (1.0f - mask)) + (1.0f - pos) * MAX(b1, mask);
+      }
+    }
+  }
+}
+
 static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
                                const dt_dev_pixelpipe_iop_t *const restrict piece,
                                dt_masks_form_t *const form,
@@ -643,6 +702,8 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
   // creation of individual shapes
   float *const restrict bufs = dt_alloc_align_float(npixels);
   if(bufs == NULL) return 0;
+  // the area of 'bufs' that may hold non-zero values
+  int dirty[4] = { 0, 0, width, height };
 
   // and we get all masks
   for(GList *fpts = form->points; fpts; fpts = g_list_next(fpts))
@@ -654,8 +715,24 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
     {
       // ensure that we start with a zeroed buffer regardless of what
       // was previously written into 'bufs'
-      memset(bufs, 0, npixels*sizeof(float));
-      const int ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
+      _clear_box(bufs, width, dirty);
+
+      // unchanged forms are taken from the raster cache, nested
+      // groups are cached as a whole
+      int box[4] = { 0, 0, width, height };
+      const dt_hash_t hash = dt_masks_raster_hash(module, piece, sel, roi);
+      const gboolean cached = dt_masks_raster_cache_get(hash, roi, bufs, box);
+      int ok = cached;
+      if(!cached)
+      {
+        ok = dt_masks_get_mask_roi(module, piece, sel, roi, bufs);
+        if(ok) dt_masks_raster_cache_put(hash, roi, bufs, box);
+      }
+      memcpy(dirty, box, sizeof(dirty));
+      dt_print(DT_DEBUG_MASKS | DT_DEBUG_PERF,
+               "[masks %d] shape %d %s took %0.04f sec",
+               nb_ok, fpt->formid, cached ? "from cache" : "rasterized",
+               dt_get_lap_time(&start));
       const float op = fpt->opacity;
       const int state = fpt->state;
 
@@ -676,7 +753,13 @@ static int _group_get_mask_roi(const dt_iop_module_t *const restrict module,
         // first see if we need to invert this shape
         const int inverted = (state & DT_MASKS_STATE_INVERSE);
 
-        if(state & DT_MASKS_STATE_UNION)
+        if(!inverted
+           && (state & (DT_MASKS_STATE_UNION | DT_MASKS_STATE_DIFFERENCE
+                        | DT_MASKS_STATE_SUM | DT_MASKS_STATE_EXCLUSION)))
+        {
+          _combine_masks_box(buffer, bufs, width, box, op, state);
+        }
+        else if(state & DT_MASKS_STATE_UNION)
         {
           _combine_masks_union(buffer, bufs, npixels, op, inverted);
         }
@@ -19,6 +19,7 @@
 #include "develop/masks.h"
 #include "bauhaus/bauhaus.h"
 #include "common/debug.h"
+#include "common/math.h"
 #include "control/conf.h"
 #include "control/control.h"
 #include "develop/blend.h"
@@ -2009,7 +2010,9 @@ void dt_masks_group_ungroup(dt_masks_form_t *dest_grp,
   }
 }
 
-dt_hash_t dt_masks_group_hash(dt_hash_t hash, dt_masks_form_t *form)
+static dt_hash_t _masks_form_hash(dt_develop_t *dev,
+                                  dt_hash_t hash,
+                                  dt_masks_form_t *form)
 {
   if(!form) return hash;
   // basic infos
@@ -2023,13 +2026,13 @@ dt_hash_t dt_masks_group_hash(dt_hash_t hash, dt_masks_form_t *form)
     if(form->type & DT_MASKS_GROUP)
     {
       const dt_masks_point_group_t *grpt = forms->data;
-      dt_masks_form_t *f = dt_masks_get_from_id(darktable.develop, grpt->formid);
+      dt_masks_form_t *f = dt_masks_get_from_id(dev, grpt->formid);
       if(f)
       {
         // state & opacity
         hash = dt_hash(hash, &grpt->state, sizeof(int));
         hash = dt_hash(hash, &grpt->opacity, sizeof(float));
-        hash = dt_masks_group_hash(hash, f);
+        hash = _masks_form_hash(dev, hash, f);
       }
     }
     else if(form->functions)
@@ -2040,6 +2043,178 @@ dt_hash_t dt_masks_group_hash(dt_hash_t hash, dt_masks_form_t *form)
   return hash;
 }
 
+dt_hash_t dt_masks_group_hash(dt_hash_t hash, dt_masks_form_t *form)
+{
+  return _masks_form_hash(darktable.develop, hash, form);
+}
+
+/* Rasterization cache.
+
+   Forms are rasterized into the roi of the module using them. The result
+   only depends on the form geometry, the roi and the distortions applied
+   by the modules up to the one using the mask, so for an unchanged form it
+   is taken from here instead of rasterizing it again on every pipe run.
+   Only the bounding box of the non-zero pixels is kept, most brush strokes
+   and small shapes cover a tiny part of the roi. The box is handed back to
+   the group so it can skip the zero area when combining the shapes. */
+
+typedef struct _masks_raster_t
+{
+  dt_hash_t hash;
+  int x, y, width, height; // bounding box within the roi
+  float *data;
+  size_t size;
+  uint64_t used;
+} _masks_raster_t;
+
+static struct
+{
+  dt_pthread_mutex_t lock;
+  GHashTable *entries; // hash -> _masks_raster_t
+  size_t size, max_size;
+  uint64_t clock;
+} _raster_cache;
+
+static void _raster_free(gpointer data)
+{
+  _masks_raster_t *r = data;
+  dt_free_align(r->data);
+  g_free(r);
+}
+
+void dt_masks_raster_cache_init(void)
+{
+  dt_pthread_mutex_init(&_raster_cache.lock, NULL);
+  _raster_cache.entries = g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, _raster_free);
+  _raster_cache.size = 0;
+  _raster_cache.clock = 0;
+  _raster_cache.max_size =
+    (size_t)MAX(0, dt_conf_get_int("plugins/darkroom/masks/raster_cache_size")) * DT_MEGA;
+}
+
+void dt_masks_raster_cache_cleanup(void)
+{
+  g_hash_table_destroy(_raster_cache.entries);
+  _raster_cache.entries = NULL;
+  dt_pthread_mutex_destroy(&_raster_cache.lock);
+}
+
+dt_hash_t dt_masks_raster_hash(const dt_iop_module_t *const module,
+                               const dt_dev_pixelpipe_iop_t *const piece,
+                               dt_masks_form_t *const form,
+                               const dt_iop_roi_t *const roi)
+{
+  dt_dev_pixelpipe_t *pipe = piece->pipe;
+  const dt_hash_t distort = dt_dev_hash_distort_plus(module->dev, pipe, module->iop_order,
+                                                     DT_DEV_TRANSFORM_DIR_BACK_INCL);
+  if(distort == DT_INVALID_HASH) return DT_INVALID_HASH;
+
+  dt_hash_t hash = _masks_form_hash(module->dev, distort, form);
+  hash = dt_hash(hash, &pipe->image.id, sizeof(pipe->image.id));
+  hash = dt_hash(hash, &pipe->iwidth, sizeof(pipe->iwidth));
+  hash = dt_hash(hash, &pipe->iheight, sizeof(pipe->iheight));
+  hash = dt_hash(hash, roi, sizeof(dt_iop_roi_t));
+  return hash;
+}
+
+gboolean dt_masks_raster_cache_get(const dt_hash_t hash,
+                                   const dt_iop_roi_t *const roi,
+                                   float *const buffer,
+                                   int box[4])
+{
+  if(!_raster_cache.max_size || hash == DT_INVALID_HASH) return FALSE;
+
+  dt_pthread_mutex_lock(&_raster_cache.lock);
+  _masks_raster_t *r = g_hash_table_lookup(_raster_cache.entries, &hash);
+  if(r)
+  {
+    r->used = ++_raster_cache.clock;
+    for(int row = 0; row < r->height; row++)
+      memcpy(buffer + (size_t)(r->y + row) * roi->width + r->x,
+             r->data + (size_t)row * r->width,
+             sizeof(float) * r->width);
+    box[0] = r->x;
+    box[1] = r->y;
+    box[2] = r->width;
+    box[3] = r->height;
+  }
+  dt_pthread_mutex_unlock(&_raster_cache.lock);
+  return r != NULL;
+}
+
+void dt_masks_raster_cache_put(const dt_hash_t hash,
+                               const dt_iop_roi_t *const roi,
+                               const float *const buffer,
+                               int box[4])
+{
+  const int width = roi->width;
+  const int height = roi->height;
+  int x0 = width, x1 = -1, y0 = height, y1 = -1;
+  for(int row = 0; row < height; row++)
+  {
+    const float *const line = buffer + (size_t)row * width;
+    int first = 0;
+    while(first < width && line[first] == 0.0f) first++;
+    if(first == width) continue;
+    int last = width - 1;
+    while(line[last] == 0.0f) last--;
+    x0 = MIN(x0, first);
+    x1 = MAX(x1, last);
+    y0 = MIN(y0, row);
+    y1 = row;
+  }
+
+  box[0] = x1 >= 0 ? x0 : 0;
+  box[1] = x1 >= 0 ? y0 : 0;
+  box[2] = x1 >= 0 ? x1 - x0 + 1 : 0;
+  box[3] = x1 >= 0 ? y1 - y0 + 1 : 0;
+
+  if(!_raster_cache.max_size || hash == DT_INVALID_HASH) return;
+
+  _masks_raster_t *r = g_malloc0(sizeof(_masks_raster_t));
+  r->hash = hash;
+  r->x = box[0];
+  r->y = box[1];
+  r->width = box[2];
+  r->height = box[3];
+  r->size = sizeof(float) * r->width * r->height;
+  if(r->size > _raster_cache.max_size / 4
+     || (r->size && !(r->data = dt_alloc_align_float((size_t)r->width * r->height))))
+  {
+    g_free(r);
+    return;
+  }
+  for(int row = 0; row < r->height; row++)
+    memcpy(r->data + (size_t)row * r->width,
+           buffer + (size_t)(r->y + row) * width + r->x,
+           sizeof(float) * r->width);
+
+  dt_pthread_mutex_lock(&_raster_cache.lock);
+  _masks_raster_t *old = g_hash_table_lookup(_raster_cache.entries, &hash);
+  if(old) _raster_cache.size -= old->size;
+  // evict the least recently used entries
+  while(_raster_cache.size + r->size > _raster_cache.max_size
+        && g_hash_table_size(_raster_cache.entries))
+  {
+    GHashTableIter iter;
+    gpointer key, value;
+    _masks_raster_t *lru = NULL;
+    g_hash_table_iter_init(&iter, _raster_cache.entries);
+    while(g_hash_table_iter_next(&iter, &key, &value))
+    {
+      _masks_raster_t *e = value;
+      if(e != old && (!lru || e->used < lru->used)) lru = e;
+    }
+    if(!lru) break;
+    _raster_cache.size -= lru->size;
+    g_hash_table_remove(_raster_cache.entries, &lru->hash);
+  }
+  r->used = ++_raster_cache.clock;
+  _raster_cache.size += r->size;
+  g_hash_table_replace(_raster_cache.entries, &r->hash, r);
+  dt_pthread_mutex_unlock(&_raster_cache.lock);
+}
+
 // adds formid to used array
 // if formid is a group it adds all the forms that belongs to that group
 static void _cleanup_unused_recurs(GList *forms,
@@ -17,6 +17,9 @@
 */
 
 #include "develop/pixelpipe_cache.h"
+#include "common/file_location.h"
+#include "common/iop_profile.h"
+#include "control/conf.h"
 #include "develop/format.h"
 #include "develop/pixelpipe.h"
 #include "libs/lib.h"
@@ -28,6 +31,41 @@ static inline int _to_mb(size_t m)
   return (int)((m + 0x80000lu) / 0x400lu / 0x400lu);
 }
 
+// cachelines below DT_PIPECACHE_MIN are used for swapping and never indexed
+static inline int _cacheline_by_hash(const dt_dev_pixelpipe_cache_t *cache,
+                                     const dt_hash_t hash)
+{
+  if(!cache->index || hash == DT_INVALID_HASH) return -1;
+  return GPOINTER_TO_INT(g_hash_table_lookup(cache->index, &hash)) - 1;
+}
+
+static void _set_cacheline_hash(const dt_dev_pixelpipe_cache_t *cache,
+                                const int k,
+                                const dt_hash_t hash)
+{
+  if(!cache->index || k < DT_PIPECACHE_MIN)
+  {
+    cache->hash[k] = hash;
+    return;
+  }
+
+  // The index keys point to the hash array. Only remove our own entry as a line
+  // with an identical hash might have taken over the index entry.
+  if(_cacheline_by_hash(cache, cache->hash[k]) == k)
+    g_hash_table_remove(cache->index, &cache->hash[k]);
+  cache->hash[k] = hash;
+  if(hash != DT_INVALID_HASH)
+    g_hash_table_replace(cache->index, &cache->hash[k], GINT_TO_POINTER(k + 1));
+}
+
+// greedy-dual-size priority, the processing cost in seconds per megabyte on top of inflation
+static inline void _update_priority(const dt_dev_pixelpipe_cache_t *cache,
+                                    const int k)
+{
+  const double mb = MAX(0.01, (double)cache->size[k] / DT_MEGA);
+  cache->priority[k] = cache->inflation + (cache->cost[k] + 0.001) / mb;
+}
+
 gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
                                      const int entries,
                                      const size_t size,
@@ -37,15 +75,23 @@ gboolean dt_dev_pixelpipe_cache_init(dt_dev_pixelpipe_t *pipe,
 
   cache->entries = entries;
   cache->allmem = cache->hits = cache->calls = cache->tests = 0;
+  cache->misses = cache->evictions = 0;
+  cache->inflation = 0.0;
   cache->memlimit = limit;
 
-  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t) + 2*sizeof(int32_t) + sizeof(uint64_t);
+  const size_t csize = sizeof(void *) + sizeof(size_t) + sizeof(dt_iop_buffer_dsc_t)
+                     + sizeof(dt_hash_t) + 2*sizeof(double) + 2*sizeof(int32_t);
   cache->data = (void **) calloc(entries, csize);
   cache->size = (size_t *)((void *)cache->data + entries * sizeof(void *));
   cache->dsc = (dt_iop_buffer_dsc_t *)((void *)cache->size + entries * sizeof(size_t));
   cache->hash = (dt_hash_t *)((void *)cache->dsc + entries * sizeof(dt_iop_buffer_dsc_t));
-  cache->used = (int32_t *)((void *)cache->hash + entries * sizeof(dt_hash_t));
+  cache->cost = (double *)((void *)cache->hash + entries * sizeof(dt_hash_t));
+  cache->priority = (double *)((void *)cache->cost + entries * sizeof(double));
+  cache->used = (int32_t *)((void *)cache->priority + entries * sizeof(double));
   cache->ioporder = (int32_t *)((void *)cache->used + entries * sizeof(int32_t));
+  cache->index = entries > DT_PIPECACHE_MIN
+               ? g_hash_table_new(g_int64_hash, g_int64_equal)
+               : NULL;
 
   for(int k = 0; k < entries; k++)
   {
@@ -86,11 +132,16 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_t *pipe)
 
   if(pipe->type == DT_DEV_PIXELPIPE_FULL)
   {
-    dt_print(DT_DEBUG_PIPE, "Session fullpipe cache report. hits/run=%.2f, hits/test=%.3f",
+    dt_print(DT_DEBUG_PIPE, "Session fullpipe cache report. hits/run=%.2f, hits/test=%.3f, misses=%" PRIu64 ", evicted=%" PRIu64,
     (double)(cache->hits) / fmax(1.0, pipe->runs),
-    (double)(cache->hits) / fmax(1.0, cache->tests));
+    (double)(cache->hits) / fmax(1.0, cache->tests),
+    cache->misses, cache->evictions);
   }
 
+  if(cache->index)
+    g_hash_table_destroy(cache->index);
+  cache->index = NULL;
+
   for(int k = 0; k < cache->entries; k++)
   {
     dt_free_align(cache->data[k]);
@@ -100,9 +151,20 @@ void dt_dev_pixelpipe_cache_cleanup(dt_dev_pixelpipe_t *pipe)
   cache->data = NULL;
 }
 
+static dt_hash_t _hash_profile_info(dt_hash_t hash,
+                                    const dt_iop_order_iccprofile_info_t *info)
+{
+  // the profile info content without the pointers and derived data
+  if(!info) return dt_hash(hash, &info, sizeof(info));
+  hash = dt_hash(hash, &info->type, sizeof(info->type));
+  hash = dt_hash(hash, info->filename, strlen(info->filename));
+  return dt_hash(hash, &info->intent, sizeof(info->intent));
+}
+
 static dt_hash_t _dev_pixelpipe_cache_basichash(dt_dev_pixelpipe_t *pipe,
                                                 const int position,
-                                                const dt_iop_roi_t *roi)
+                                                const dt_iop_roi_t *roi,
+                                                const gboolean persistent)
 {
   /* What do we use for the basic hash
        1) imgid as all structures using the hash might possibly contain data from other images
@@ -117,14 +179,30 @@ static dt_hash_t _dev_pixelpipe_cache_basichash(dt_dev_pixelpipe_t *pipe,
        5) Please note that position is not the iop_order but the position in the pipe
        6) Please note that pipe->type, want_details and request_color_pick are only used if a roi is provided
           for better support of dt_dev_pixelpipe_piece_hash()
+       7) A persistent hash is used by the disk tier, it must be valid across sessions so we use
+          the profile contents instead of the profile info pointers and make sure a re-used imgid
+          or a different darktable version won't match.
   */
   const uint32_t hashing_pipemode[3] = {(uint32_t)pipe->image.id,
                                         (uint32_t)pipe->type,
                                         (uint32_t)pipe->want_detail_mask };
   dt_hash_t hash = dt_hash(DT_INITHASH, &hashing_pipemode, sizeof(uint32_t) * (roi ? 3 : 1));
-  hash = dt_hash(hash, &pipe->input_profile_info, sizeof(pipe->input_profile_info));
-  hash = dt_hash(hash, &pipe->work_profile_info, sizeof(pipe->work_profile_info));
-  hash = dt_hash(hash, &pipe->output_profile_info, sizeof(pipe->output_profile_info));
+  if(persistent)
+  {
+    hash = dt_hash(hash, darktable_package_string, strlen(darktable_package_string));
+    hash = dt_hash(hash, &pipe->image.film_id, sizeof(pipe->image.film_id));
+    hash = dt_hash(hash, pipe->image.filename, strlen(pipe->image.filename));
+    hash = dt_hash(hash, &pipe->image.import_timestamp, sizeof(pipe->image.import_timestamp));
+    hash = _hash_profile_info(hash, pipe->input_profile_info);
+    hash = _hash_profile_info(hash, pipe->work_profile_info);
+    hash = _hash_profile_info(hash, pipe->output_profile_info);
+  }
+  else
+  {
+    hash = dt_hash(hash, &pipe->input_profile_info, sizeof(pipe->input_profile_info));
+    hash = dt_hash(hash, &pipe->work_profile_info, sizeof(pipe->work_profile_info));
+    hash = dt_hash(hash, &pipe->output_profile_info, sizeof(pipe->output_profile_info));
+  }
 
   // go through all modules up to position and compute a hash using the operation and params.
   GList *pieces = pipe->nodes;
@@ -164,7 +242,7 @@ dt_hash_t dt_dev_pixelpipe_cache_hash(const dt_iop_roi_t *roi,
                                       dt_dev_pixelpipe_t *pipe,
                                       const int position)
 {
-  dt_hash_t hash = _dev_pixelpipe_cache_basichash(pipe, position, roi);
+  dt_hash_t hash = _dev_pixelpipe_cache_basichash(pipe, position, roi, FALSE);
   // also include roi data if provided
   if(roi)
   {
@@ -185,44 +263,52 @@ gboolean dt_dev_pixelpipe_cache_available(dt_dev_pixelpipe_t *pipe,
 
   dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
   cache->tests++;
-  // search for hash in cache and make the sizes are identical
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  // search for hash in cache and make sure the sizes are identical
+  const int k = _cacheline_by_hash(cache, hash);
+  if(k >= DT_PIPECACHE_MIN && cache->size[k] == size)
   {
-    if((cache->size[k] == size) && (cache->hash[k] == hash))
-    {
-      cache->hits++;
-      return TRUE;
-    }
+    cache->hits++;
+    return TRUE;
   }
   return FALSE;
 }
 
-// While looking for the oldest cacheline we always ignore the first two lines as they are used
-// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode
+// While looking for the cacheline to be dropped we always ignore the first two lines as they are used
+// for swapping buffers while in entries==DT_PIPECACHE_MIN or masking mode.
+// Important and just used lines are never taken, from the others we take the one with lowest
+// priority and prefer the older one if equal.
 static int _get_oldest_cacheline(dt_dev_pixelpipe_cache_t *cache,
                                  const dt_dev_pixelpipe_cache_test_t mode)
 {
   // we never want the latest used cacheline! It was <= 0 and the weight has increased just now
-  int age = 1;
   int id = 0;
   for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
   {
-    gboolean older = (cache->used[k] > age) && (k != cache->lastline);
-    if(older)
+    gboolean candidate = (cache->used[k] > 1) && (k != cache->lastline);
+    if(candidate)
     {
-      if(mode == DT_CACHETEST_USED)         older = cache->data[k] != NULL;
-      else if(mode == DT_CACHETEST_FREE)    older = cache->data[k] == NULL;
-      else if(mode == DT_CACHETEST_INVALID) older = cache->hash[k] == DT_INVALID_HASH;
-      if(older)
-      {
-        age = cache->used[k];
+      if(mode == DT_CACHETEST_USED)         candidate = cache->data[k] != NULL;
+      else if(mode == DT_CACHETEST_FREE)    candidate = cache->data[k] == NULL;
+      else if(mode == DT_CACHETEST_INVALID) candidate = cache->hash[k] == DT_INVALID_HASH;
+      if(candidate
+         && (id == 0
+             || cache->priority[k] < cache->priority[id]
+             || (cache->priority[k] == cache->priority[id] && cache->used[k] > cache->used[id])))
         id = k;
-      }
     }
   }
   return id;
 }
 
+// a valid cacheline is dropped so all others gain relative weight
+static void _evict_cacheline(dt_dev_pixelpipe_cache_t *cache,
+                             const int k)
+{
+  if(cache->hash[k] == DT_INVALID_HASH) return;
+  cache->inflation = MAX(cache->inflation, cache->priority[k]);
+  cache->evictions++;
+}
+
 static int _get_c_cacheline(dt_dev_pixelpipe_cache_t *cache)
 {
   int oldest = _get_oldest_cacheline(cache, DT_CACHETEST_INVALID);
@@ -232,6 +318,7 @@ static int _get_c_cacheline(dt_dev_pixelpipe_cache_t *cache)
   if(oldest > 0) return oldest;
 
   oldest = _get_oldest_cacheline(cache, DT_CACHETEST_PLAIN);
+  if(oldest > 0) _evict_cacheline(cache, oldest);
   return (oldest == 0) ? cache->calls & 1 : oldest;
 }
 
@@ -257,36 +344,35 @@ static gboolean _get_by_hash(dt_dev_pixelpipe_t *pipe,
                              dt_iop_buffer_dsc_t **dsc)
 {
   dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
-  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  const int k = _cacheline_by_hash(cache, hash);
+  if(k < DT_PIPECACHE_MIN)
+    return FALSE;
+
+  if(cache->size[k] != size)
   {
-    if(cache->hash[k] == hash)
-    {
-      if(cache->size[k] != size)
-      {
-        /* We check for situation with a hash identity but buffer sizes don't match.
-           This could happen because of "hash overlaps" or other situations where the hash
-           doesn't reflect the complete status.
-           Anyway this has to be accepted as a dt bug so we always report
-        */
-        cache->hash[k] = DT_INVALID_HASH;
-        dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
-          pipe, module, DT_DEVICE_NONE, NULL, NULL);
-      }
-      else if(pipe->mask_display || pipe->nocache)
-      {
-        // this should not happen but we make sure
-        cache->hash[k] = DT_INVALID_HASH;
-      }
-      else
-      {
-        // we have a proper hit
-        *data = cache->data[k];
-        *dsc = &cache->dsc[k];
-        // in case of a hit it's always good to further keep the cacheline as important
-        cache->used[k] = -cache->entries;
-        return TRUE;
-      }
-    }
+    /* We check for situation with a hash identity but buffer sizes don't match.
+       This could happen because of "hash overlaps" or other situations where the hash
+       doesn't reflect the complete status.
+       Anyway this has to be accepted as a dt bug so we always report
+    */
+    _set_cacheline_hash(cache, k, DT_INVALID_HASH);
+    dt_print_pipe(DT_DEBUG_ALWAYS, "CACHELINE_SIZE ERROR",
+      pipe, module, DT_DEVICE_NONE, NULL, NULL);
+  }
+  else if(pipe->mask_display || pipe->nocache)
+  {
+    // this should not happen but we make sure
+    _set_cacheline_hash(cache, k, DT_INVALID_HASH);
+  }
+  else
+  {
+    // we have a proper hit
+    *data = cache->data[k];
+    *dsc = &cache->dsc[k];
+    // in case of a hit it's always good to further keep the cacheline as important
+    cache->used[k] = -cache->entries;
+    _update_priority(cache, k);
+    return TRUE;
   }
   return FALSE;
 }
@@ -317,6 +403,9 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
           hash);
     return FALSE;
   }
+  if(cache->entries > DT_PIPECACHE_MIN && hash != DT_INVALID_HASH)
+    cache->misses++;
+
   // We need a fresh buffer as there was no hit.
   //
   // Pipes with two cache lines have pre-allocated memory, but we must
@@ -350,7 +439,7 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
   *dsc = &cache->dsc[cline];
 
   const gboolean masking = pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE;
-  cache->hash[cline]      = masking ? DT_INVALID_HASH : hash;
+  _set_cacheline_hash(cache, cline, masking ? DT_INVALID_HASH : hash);
 
   const dt_iop_buffer_dsc_t *cdsc = *dsc;
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_VERBOSE, "pipe cache get",
@@ -363,13 +452,16 @@ gboolean dt_dev_pixelpipe_cache_get(dt_dev_pixelpipe_t *pipe,
 
   cache->used[cline]      = !masking && important ? -cache->entries : 0;
   cache->ioporder[cline]  = module ? module->iop_order : 0;
+  // the processing cost is not known yet
+  cache->cost[cline]      = 0.0;
+  _update_priority(cache, cline);
 
   return TRUE;
 }
 
 static void _mark_invalid_cacheline(const dt_dev_pixelpipe_cache_t *cache, const int k)
 {
-  cache->hash[k] = DT_INVALID_HASH;
+  _set_cacheline_hash(cache, k, DT_INVALID_HASH);
   cache->ioporder[k] = 0;
 }
 
@@ -417,6 +509,21 @@ void dt_dev_pixelpipe_important_cacheline(const dt_dev_pixelpipe_t *pipe,
   }
 }
 
+void dt_dev_pixelpipe_cache_set_cost(const dt_dev_pixelpipe_t *pipe,
+                                     const void *data,
+                                     const double cost)
+{
+  const dt_dev_pixelpipe_cache_t *cache = &pipe->cache;
+  for(int k = DT_PIPECACHE_MIN; k < cache->entries; k++)
+  {
+    if(cache->data[k] == data && cache->hash[k] != DT_INVALID_HASH)
+    {
+      cache->cost[k] = MAX(0.0, cost);
+      _update_priority(cache, k);
+    }
+  }
+}
+
 void dt_dev_pixelpipe_invalidate_cacheline(const dt_dev_pixelpipe_t *pipe,
                                            const void *data)
 {
@@ -472,6 +579,7 @@ void dt_dev_pixelpipe_cache_checkmem(dt_dev_pixelpipe_t *pipe)
     const int k = _get_oldest_cacheline(cache, DT_CACHETEST_USED);
     if(k == 0) break;
 
+    _evict_cacheline(cache, k);
     freed += _free_cacheline(cache, k);
   }
 
@@ -488,11 +596,409 @@ void dt_dev_pixelpipe_cache_report(dt_dev_pixelpipe_t *pipe)
 
   _cline_stats(cache);
   dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_MEMORY, "cache report", pipe, NULL, DT_DEVICE_NONE, NULL, NULL,
-    "%i lines (important=%i, used=%i, invalid=%i). Using %iMB, limit=%iMB. Hits/run=%.2f. Hits/test=%.3f",
+    "%i lines (important=%i, used=%i, invalid=%i). Using %iMB, limit=%iMB. Hits/run=%.2f. Hits/test=%.3f. "
+    "Policy hits=%" PRIu64 " misses=%" PRIu64 " evicted=%" PRIu64 " inflation=%.3f",
     cache->entries, cache->limportant, cache->lused, cache->linvalid,
     _to_mb(cache->allmem), _to_mb(cache->memlimit),
     (double)(cache->hits) / fmax(1.0, pipe->runs),
-    (double)(cache->hits) / fmax(1.0, cache->tests));
+    (double)(cache->hits) / fmax(1.0, cache->tests),
+    cache->hits, cache->misses, cache->evictions, cache->inflation);
+}
+
+/* The disk tier.
+   Every file holds exactly one cacheline, named by the persistent hash. The header keeps the
+   buffer description so a loaded line is indistinguishable from a processed one.
+   The LRU order is kept via the file modification time which is updated on every load.
+*/
+#define DT_PIPECACHE_DISK_MAGIC 0x43505444u
+#define DT_PIPECACHE_DISK_VERSION 1
+#define DT_PIPECACHE_DISK_EXT ".dtpc"
+
+typedef struct dt_pipecache_disk_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  uint32_t dsc_size;
+  dt_iop_buffer_dsc_t dsc;
+} dt_pipecache_disk_header_t;
+
+typedef struct dt_pipecache_disk_t
+{
+  dt_pthread_mutex_t lock;
+  gboolean enabled;
+  char dir[PATH_MAX];
+  gchar **modules;
+  size_t limit;
+  size_t used;
+} dt_pipecache_disk_t;
+
+static dt_pipecache_disk_t _disk = { 0 };
+
+typedef struct _disk_file_t
+{
+  gchar *path;
+  size_t size;
+  GTimeSpan mtime;
+} _disk_file_t;
+
+static gint _sort_by_mtime(gconstpointer a, gconstpointer b)
+{
+  const _disk_file_t *fa = (const _disk_file_t *)a;
+  const _disk_file_t *fb = (const _disk_file_t *)b;
+  return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+static void _disk_file_free(gpointer data)
+{
+  _disk_file_t *f = (_disk_file_t *)data;
+  g_free(f->path);
+  g_free(f);
+}
+
+// scan the directory, take the files sum and remove old files until we are below target.
+// must be called with the lock held.
+static void _disk_evict(const size_t target)
+{
+  GDir *dir = g_dir_open(_disk.dir, 0, NULL);
+  if(!dir) return;
+
+  GList *files = NULL;
+  size_t used = 0;
+  const gchar *name;
+  while((name = g_dir_read_name(dir)))
+  {
+    if(!g_str_has_suffix(name, DT_PIPECACHE_DISK_EXT)) continue;
+    gchar *path = g_build_filename(_disk.dir, name, NULL);
+    GStatBuf st;
+    if(g_stat(path, &st))
+    {
+      g_free(path);
+      continue;
+    }
+    _disk_file_t *f = g_malloc(sizeof(_disk_file_t));
+    f->path = path;
+    f->size = st.st_size;
+    f->mtime = st.st_mtime;
+    used += f->size;
+    files = g_list_prepend(files, f);
+  }
+  g_dir_close(dir);
+
+  int removed = 0;
+  if(used > target)
+  {
+    files = g_list_sort(files, _sort_by_mtime);
+    for(GList *l = files; l && used > target; l = g_list_next(l))
+    {
+      _disk_file_t *f = l->data;
+      if(!g_unlink(f->path))
+      {
+        used -= f->size;
+        removed++;
+      }
+    }
+  }
+  g_list_free_full(files, _disk_file_free);
+
+  _disk.used = used;
+  if(removed)
+    dt_print(DT_DEBUG_CACHE | DT_DEBUG_PIPE,
+             "[pixelpipe_cache] disk tier evicted %i lines, using %iMB of %iMB",
+             removed, _to_mb(_disk.used), _to_mb(_disk.limit));
+}
+
+void dt_dev_pixelpipe_cache_disk_init(void)
+{
+  dt_pthread_mutex_init(&_disk.lock, NULL);
+  _disk.enabled = darktable.pipe_cache && dt_conf_get_bool("cache_disk_pipe");
+  if(!_disk.enabled) return;
+
+  char cachedir[PATH_MAX] = { 0 };
+  dt_loc_get_user_cache_dir(cachedir, sizeof(cachedir));
+  snprintf(_disk.dir, sizeof(_disk.dir), "%s/pipecache", cachedir);
+  if(g_mkdir_with_parents(_disk.dir, 0750))
+  {
+    dt_print(DT_DEBUG_ALWAYS, "[pixelpipe_cache] can't create disk tier directory `%s'", _disk.dir);
+    _disk.enabled = FALSE;
+    return;
+  }
+
+  _disk.limit = (size_t)MAX(64, dt_conf_get_int("cache_disk_pipe_size")) * DT_MEGA;
+  _disk.modules = g_strsplit(dt_conf_get_string_const("cache_disk_pipe_modules"), ",", -1);
+  for(gchar **op = _disk.modules; *op; op++)
+    g_strstrip(*op);
+
+  dt_pthread_mutex_lock(&_disk.lock);
+  _disk_evict(_disk.limit);
+  dt_pthread_mutex_unlock(&_disk.lock);
+
+  dt_print(DT_DEBUG_CACHE | DT_DEBUG_PIPE,
+           "[pixelpipe_cache] disk tier at `%s' using %iMB of %iMB",
+           _disk.dir, _to_mb(_disk.used), _to_mb(_disk.limit));
+}
+
+void dt_dev_pixelpipe_cache_disk_cleanup(void)
+{
+  g_strfreev(_disk.modules);
+  _disk.modules = NULL;
+  _disk.enabled = FALSE;
+  dt_pthread_mutex_destroy(&_disk.lock);
+}
+
+static gboolean _disk_module(const dt_iop_module_t *module)
+{
+  if(!module || !_disk.modules) return FALSE;
+  for(gchar **op = _disk.modules; *op; op++)
+    if(dt_iop_module_is(module->so, *op)) return TRUE;
+  return FALSE;
+}
+
+// check if the pipe state allows using the disk tier for the output at position
+static gboolean _disk_usable(dt_dev_pixelpipe_t *pipe,
+                             const dt_iop_module_t *module,
+                             const int position)
+{
+  if(!_disk.enabled
+     || !(pipe->type & DT_DEV_PIXELPIPE_BASIC)
+     || pipe->cache.entries <= DT_PIPECACHE_MIN
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || pipe->nocache
+     || pipe->want_detail_mask
+     || !_disk_module(module))
+    return FALSE;
+
+  // raster masks are side effects of processing, we can't restore them from disk
+  GList *pieces = pipe->nodes;
+  for(int k = 0; k < position && pieces; k++)
+  {
+    const dt_dev_pixelpipe_iop_t *piece = pieces->data;
+    if(piece->enabled
+       && piece->module->raster_mask.source.users
+       && g_hash_table_size(piece->module->raster_mask.source.users))
+      return FALSE;
+    pieces = g_list_next(pieces);
+  }
+  return TRUE;
+}
+
+static void _disk_filename(char *filename,
+                           const size_t size,
+                           dt_dev_pixelpipe_t *pipe,
+                           const dt_iop_roi_t *roi,
+                           const int position)
+{
+  dt_hash_t hash = _dev_pixelpipe_cache_basichash(pipe, position, roi, TRUE);
+  hash = dt_hash(hash, roi, sizeof(dt_iop_roi_t));
+  snprintf(filename, size, "%s/%016" PRIx64 DT_PIPECACHE_DISK_EXT, _disk.dir, hash);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_load(dt_dev_pixelpipe_t *pipe,
+                                          const dt_iop_module_t *module,
+                                          const dt_iop_roi_t *roi,
+                                          const int position,
+                                          const dt_hash_t hash,
+                                          const size_t size)
+{
+  if(hash == DT_INVALID_HASH || !_disk_usable(pipe, module, position))
+    return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), pipe, roi, position);
+
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return FALSE;
+
+  const double start = dt_get_debug_wtime();
+
+  gboolean loaded = FALSE;
+  dt_pipecache_disk_header_t header;
+  if(fread(&header, sizeof(header), 1, f) == 1
+     && header.magic == DT_PIPECACHE_DISK_MAGIC
+     && header.version == DT_PIPECACHE_DISK_VERSION
+     && header.dsc_size == sizeof(dt_iop_buffer_dsc_t)
+     && header.size == size)
+  {
+    void *data = NULL;
+    dt_iop_buffer_dsc_t *dsc = &header.dsc;
+    dt_dev_pixelpipe_cache_get(pipe, hash, size, &data, &dsc, module, TRUE);
+    if(data && fread(data, 1, size, f) == size)
+      loaded = TRUE;
+    else if(data)
+      dt_dev_pixelpipe_invalidate_cacheline(pipe, data);
+  }
+  fclose(f);
+
+  if(loaded)
+  {
+    // keep the LRU order
+    g_utime(filename, NULL);
+    dt_print_pipe(DT_DEBUG_PIPE, "pipe data: from disk",
+                  pipe, module, DT_DEVICE_NONE, roi, NULL, "%iMB in %.3fs",
+                  _to_mb(size), dt_get_debug_wtime() - start);
+  }
+  else
+  {
+    // a broken or outdated file
+    dt_pthread_mutex_lock(&_disk.lock);
+    if(!g_unlink(filename))
+      _disk.used -= MIN(_disk.used, size + sizeof(header));
+    dt_pthread_mutex_unlock(&_disk.lock);
+  }
+  return loaded;
+}
+
+// write one file of the tier, returns TRUE on success
+static gboolean _disk_write(const char *filename,
+                            const void *owner,
+                            const dt_iop_buffer_dsc_t *dsc,
+                            const void *data,
+                            const size_t size)
+{
+  const size_t filesize = size + sizeof(dt_pipecache_disk_header_t);
+  if(filesize > _disk.limit / 4 || g_file_test(filename, G_FILE_TEST_EXISTS))
+    return FALSE;
+
+  dt_pthread_mutex_lock(&_disk.lock);
+  if(_disk.used + filesize > _disk.limit)
+    _disk_evict(_disk.limit - filesize);
+  dt_pthread_mutex_unlock(&_disk.lock);
+
+  // write to a temporary file and rename so a concurrent or later reader never sees partial data
+  gchar *tmpname = g_strdup_printf("%s.%p.tmp", filename, owner);
+  FILE *f = g_fopen(tmpname, "wb");
+  gboolean written = FALSE;
+  if(f)
+  {
+    dt_pipecache_disk_header_t header = { 0 };
+    header.magic = DT_PIPECACHE_DISK_MAGIC;
+    header.version = DT_PIPECACHE_DISK_VERSION;
+    header.size = size;
+    header.dsc_size = sizeof(dt_iop_buffer_dsc_t);
+    if(dsc) header.dsc = *dsc;
+    written = fwrite(&header, sizeof(header), 1, f) == 1
+           && fwrite(data, 1, size, f) == size;
+    written = !fclose(f) && written;
+  }
+  if(written && !g_rename(tmpname, filename))
+  {
+    dt_pthread_mutex_lock(&_disk.lock);
+    _disk.used += filesize;
+    dt_pthread_mutex_unlock(&_disk.lock);
+  }
+  else
+  {
+    g_unlink(tmpname);
+    written = FALSE;
+  }
+  g_free(tmpname);
+  return written;
+}
+
+void dt_dev_pixelpipe_cache_disk_store(dt_dev_pixelpipe_t *pipe,
+                                       const dt_iop_module_t *module,
+                                       const dt_iop_roi_t *roi,
+                                       const int position,
+                                       const void *data,
+                                       const size_t size,
+                                       const dt_iop_buffer_dsc_t *dsc)
+{
+  if(!data || !_disk_usable(pipe, module, position))
+    return;
+
+  // don't let a single buffer flush most of the tier
+  if(size + sizeof(dt_pipecache_disk_header_t) > _disk.limit / 4)
+    return;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_filename(filename, sizeof(filename), pipe, roi, position);
+  if(g_file_test(filename, G_FILE_TEST_EXISTS))
+    return;
+
+  const double start = dt_get_debug_wtime();
+  if(_disk_write(filename, pipe, dsc, data, size))
+    dt_print_pipe(DT_DEBUG_PIPE, "pipe data: to disk",
+                  pipe, module, DT_DEVICE_NONE, roi, NULL, "%iMB in %.3fs",
+                  _to_mb(size), dt_get_debug_wtime() - start);
+  else
+    dt_print_pipe(DT_DEBUG_PIPE, "pipe data: disk write failed",
+                  pipe, module, DT_DEVICE_NONE, roi, NULL);
+}
+
+/* Module private data like analysis results don't belong to a cacheline, they are
+   stored in the same directory and share the size limit and eviction.
+*/
+static gboolean _disk_aux_usable(const dt_dev_pixelpipe_t *pipe)
+{
+  return _disk.enabled
+    && (pipe->type & DT_DEV_PIXELPIPE_BASIC)
+    && pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE
+    && !pipe->nocache;
+}
+
+static void _disk_aux_filename(char *filename,
+                               const size_t size,
+                               dt_dev_pixelpipe_t *pipe,
+                               const dt_iop_module_t *module,
+                               const int position,
+                               const dt_hash_t key)
+{
+  dt_hash_t hash = _dev_pixelpipe_cache_basichash(pipe, position, NULL, TRUE);
+  hash = dt_hash(hash, module->op, strlen(module->op));
+  hash = dt_hash(hash, &key, sizeof(key));
+  snprintf(filename, size, "%s/%016" PRIx64 DT_PIPECACHE_DISK_EXT, _disk.dir, hash);
+}
+
+gboolean dt_dev_pixelpipe_cache_disk_load_aux(dt_dev_pixelpipe_t *pipe,
+                                              const dt_iop_module_t *module,
+                                              const int position,
+                                              const dt_hash_t key,
+                                              void *data,
+                                              const size_t size)
+{
+  if(!data || !_disk_aux_usable(pipe))
+    return FALSE;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_aux_filename(filename, sizeof(filename), pipe, module, position, key);
+
+  FILE *f = g_fopen(filename, "rb");
+  if(!f) return FALSE;
+
+  dt_pipecache_disk_header_t header;
+  const gboolean loaded = fread(&header, sizeof(header), 1, f) == 1
+     && header.magic == DT_PIPECACHE_DISK_MAGIC
+     && header.version == DT_PIPECACHE_DISK_VERSION
+     && header.dsc_size == sizeof(dt_iop_buffer_dsc_t)
+     && header.size == size
+     && fread(data, 1, size, f) == size;
+  fclose(f);
+
+  if(loaded)
+    g_utime(filename, NULL);
+  else
+  {
+    dt_pthread_mutex_lock(&_disk.lock);
+    if(!g_unlink(filename))
+      _disk.used -= MIN(_disk.used, size + sizeof(header));
+    dt_pthread_mutex_unlock(&_disk.lock);
+  }
+  return loaded;
+}
+
+void dt_dev_pixelpipe_cache_disk_store_aux(dt_dev_pixelpipe_t *pipe,
+                                           const dt_iop_module_t *module,
+                                           const int position,
+                                           const dt_hash_t key,
+                                           const void *data,
+                                           const size_t size)
+{
+  if(!data || !_disk_aux_usable(pipe))
+    return;
+
+  char filename[PATH_MAX] = { 0 };
+  _disk_aux_filename(filename, sizeof(filename), pipe, module, position, key);
+  _disk_write(filename, pipe, NULL, data, size);
 }
 
 // clang-format off
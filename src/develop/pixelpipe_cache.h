@@ -23,12 +23,19 @@
 struct dt_dev_pixelpipe_t;
 struct dt_iop_buffer_dsc_t;
 struct dt_iop_roi_t;
+struct dt_iop_module_t;
 
 /**
  * implements a simple pixel cache suitable for caching float images
  * corresponding to history items and zoom/pan settings in the develop module.
  * correctness is secured via the hash so make sure everything is included here.
  * No caching if cl_mem, instead copied cache buffers are used.
+ *
+ * Cachelines are found via a hash index. If a line has to be dropped we use a
+ * greedy-dual-size policy: every line gets a priority of the current inflation
+ * value plus the measured processing cost per megabyte, the line with the lowest
+ * priority is dropped and its priority becomes the new inflation value.
+ * So cheap & large buffers go first while expensive ones age slowly.
  */
 typedef struct dt_dev_pixelpipe_cache_t
 {
@@ -39,13 +46,19 @@ typedef struct dt_dev_pixelpipe_cache_t
   size_t *size;
   struct dt_iop_buffer_dsc_t *dsc;
   dt_hash_t *hash;
+  double *cost;
+  double *priority;
   int32_t *used;
   int32_t *ioporder;
+  GHashTable *index;
+  double inflation;
   uint64_t calls;
   int32_t lastline;
   // profiling & stats:
   uint64_t tests;
   uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
   uint32_t lused;
   uint32_t linvalid;
   uint32_t limportant;
@@ -89,6 +102,9 @@ void dt_dev_pixelpipe_cache_invalidate_later(struct dt_dev_pixelpipe_t *pipe, co
 /** makes this buffer very important after it has been pulled from the cache. */
 void dt_dev_pixelpipe_important_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data, const size_t size);
 
+/** keep the measured processing time in seconds for the cacheline holding data, used for eviction */
+void dt_dev_pixelpipe_cache_set_cost(const struct dt_dev_pixelpipe_t *pipe, const void *data, const double cost);
+
 /** mark the given cache line as invalid or to be ignored */
 void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe, const void *data);
 
@@ -96,6 +112,49 @@ void dt_dev_pixelpipe_invalidate_cacheline(const struct dt_dev_pixelpipe_t *pipe
 void dt_dev_pixelpipe_cache_report(struct dt_dev_pixelpipe_t *pipe);
 void dt_dev_pixelpipe_cache_checkmem(struct dt_dev_pixelpipe_t *pipe);
 
+/**
+ * optional second tier of the cache on disk.
+ * The output of selected expensive modules (conf key cache_disk_pipe_modules) is written to
+ * the user cache directory keyed by a session-independent hash of the pipe up to that module,
+ * so reopening an image in darkroom can start from the last stored module instead of from raw.
+ * The tier is limited in size by cache_disk_pipe_size (MB), old files are evicted in LRU order.
+ */
+void dt_dev_pixelpipe_cache_disk_init(void);
+void dt_dev_pixelpipe_cache_disk_cleanup(void);
+
+/** try to fill a fresh cacheline with the given hash from disk. Returns TRUE if the data is now
+    available in the memory cache. */
+gboolean dt_dev_pixelpipe_cache_disk_load(struct dt_dev_pixelpipe_t *pipe,
+                                          const struct dt_iop_module_t *module,
+                                          const struct dt_iop_roi_t *roi,
+                                          const int position,
+                                          const dt_hash_t hash,
+                                          const size_t size);
+
+/** possibly write the output of module to the disk tier */
+void dt_dev_pixelpipe_cache_disk_store(struct dt_dev_pixelpipe_t *pipe,
+                                       const struct dt_iop_module_t *module,
+                                       const struct dt_iop_roi_t *roi,
+                                       const int position,
+                                       const void *data,
+                                       const size_t size,
+                                       const struct dt_iop_buffer_dsc_t *dsc);
+
+/** module private data (like analysis results) in the disk tier. key must not depend on the
+    session, the data is also bound to the persistent hash of the pipe up to position. */
+gboolean dt_dev_pixelpipe_cache_disk_load_aux(struct dt_dev_pixelpipe_t *pipe,
+                                              const struct dt_iop_module_t *module,
+                                              const int position,
+                                              const dt_hash_t key,
+                                              void *data,
+                                              const size_t size);
+void dt_dev_pixelpipe_cache_disk_store_aux(struct dt_dev_pixelpipe_t *pipe,
+                                           const struct dt_iop_module_t *module,
+                                           const int position,
+                                           const dt_hash_t key,
+                                           const void *data,
+                                           const size_t size);
+
 // clang-format off
 // modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
 // vim: shiftwidth=2 expandtab tabstop=2 cindent
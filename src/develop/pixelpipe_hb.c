@@ -22,6 +22,7 @@
 #include "common/opencl.h"
 #include "common/iop_order.h"
 #include "common/imagebuf.h"
+#include "common/interpolation.h"
 #include "control/control.h"
 #include "control/signal.h"
 #include "develop/blend.h"
@@ -1534,6 +1535,600 @@ static inline gboolean _skip_piece_on_tags(const dt_dev_pixelpipe_iop_t *piece)
           && (piece->pipe->type & DT_DEV_PIXELPIPE_BASIC);
 }
 
+/* Fused processing of pointwise modules.
+   If the image does not fit into host memory every module would tile on its own, writing a
+   full output buffer that the next module reads again. Consecutive modules with
+   roi_in == roi_out, no tiling overlap and nothing requiring the full buffer (blending, pickers,
+   histograms, raster or details masks) can instead be run block by block: the first module reads
+   a block of rows from its input, intermediates stay in two cache sized ping-pong buffers and the
+   last module writes into its output cacheline. The intermediate results are not cached so this
+   is only done for pipes not attached to the GUI. */
+
+// size of a block per thread, about the size of a L2 cache
+#define FUSED_BLOCK_BYTES (256 * 1024)
+// upper limit of fused modules
+#define FUSED_MAX_MODULES 32
+
+typedef struct _fused_step_t
+{
+  dt_iop_module_t *module;
+  dt_dev_pixelpipe_iop_t *piece;
+  int pos;
+  int cst_from, cst_to;
+  size_t in_bpp, out_bpp;
+  dt_iop_buffer_dsc_t dsc; // pipe->dsc handed to process()
+} _fused_step_t;
+
+static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
+                                           dt_develop_t *dev,
+                                           void **output,
+                                           void **cl_mem_output,
+                                           dt_iop_buffer_dsc_t **out_format,
+                                           const dt_iop_roi_t *roi_out,
+                                           GList *modules,
+                                           GList *pieces,
+                                           const int pos);
+
+static gboolean _piece_is_pointwise(dt_dev_pixelpipe_t *pipe,
+                                    dt_develop_t *dev,
+                                    dt_dev_pixelpipe_iop_t *piece,
+                                    const dt_iop_roi_t *roi,
+                                    const size_t bpp,
+                                    int *yalign,
+                                    gboolean *fits)
+{
+  dt_iop_module_t *module = piece->module;
+
+  if(!_piece_may_tile(piece)
+     || module->flags() & (IOP_FLAGS_TILING_FULL_ROI
+                           | IOP_FLAGS_WRITE_RASTER
+                           | IOP_FLAGS_WRITE_DETAILS)
+     || module->operation_tags() & IOP_TAG_DISTORT
+     || (piece->blendop_data
+         && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+     || piece->request_histogram & DT_REQUEST_ON
+     || _request_color_pick(pipe, dev, module))
+    return FALSE;
+
+  dt_iop_roi_t roi_in = *roi;
+  module->modify_roi_in(module, piece, roi, &roi_in);
+  if(memcmp(&roi_in, roi, sizeof(dt_iop_roi_t)))
+    return FALSE;
+
+  dt_develop_tiling_t tiling = { 0 };
+  tiling.factor_cl = tiling.maxbuf_cl = -1;
+  module->tiling_callback(module, piece, roi, roi, &tiling);
+  if(tiling.overlap > 0)
+    return FALSE;
+
+  // blocks must follow the vertical alignment of all modules
+  const int align = MAX(tiling.yalign, 1);
+  int a = *yalign, b = align;
+  while(b)
+  {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  *yalign = *yalign / a * align;
+  *fits = *fits && dt_tiling_piece_fits_host_memory(piece, roi->width, roi->height, bpp,
+                                                    tiling.factor, tiling.overhead);
+  return TRUE;
+}
+
+/* collect the run of pointwise modules ending at modules/pieces, returns the number of
+   fused modules and the list position of the module providing their input */
+static int _fused_run(dt_dev_pixelpipe_t *pipe,
+                      dt_develop_t *dev,
+                      const dt_iop_roi_t *roi,
+                      const size_t bpp,
+                      GList **modules,
+                      GList **pieces,
+                      int *pos,
+                      _fused_step_t *steps,
+                      int *yalign)
+{
+  if((pipe->type & DT_DEV_PIXELPIPE_BASIC)
+     || pipe->devid > DT_DEVICE_CPU
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || darktable.dump_pfm_pipe
+     || darktable.bench_module)
+    return 0;
+
+  GList *m = *modules;
+  GList *p = *pieces;
+  int n = 0;
+  int position = *pos;
+  gboolean fits = TRUE;
+  int align = 1;
+
+  for(; m && n < FUSED_MAX_MODULES; m = g_list_previous(m), p = g_list_previous(p), position--)
+  {
+    dt_dev_pixelpipe_iop_t *piece = p->data;
+    if(_skip_piece_on_tags(piece))
+      continue;
+    if(!_piece_is_pointwise(pipe, dev, piece, roi, bpp, &align, &fits))
+      break;
+    steps[n].module = m->data;
+    steps[n].piece = piece;
+    steps[n].pos = position;
+    n++;
+  }
+
+  // fusing only pays off if modules would be tiled otherwise
+  if(n < 2 || fits)
+    return 0;
+
+  // we collected backwards, process in pipe order
+  for(int k = 0; k < n / 2; k++)
+  {
+    const _fused_step_t tmp = steps[k];
+    steps[k] = steps[n - 1 - k];
+    steps[n - 1 - k] = tmp;
+  }
+
+  *modules = m;
+  *pieces = p;
+  *pos = position;
+  *yalign = align;
+  return n;
+}
+
+static gboolean _pixelpipe_process_fused(dt_dev_pixelpipe_t *pipe,
+                                         dt_develop_t *dev,
+                                         void **output,
+                                         dt_iop_buffer_dsc_t **out_format,
+                                         const dt_iop_roi_t *roi,
+                                         _fused_step_t *steps,
+                                         const int nsteps,
+                                         const int yalign,
+                                         GList *modules,
+                                         GList *pieces,
+                                         const int pos,
+                                         const dt_hash_t hash,
+                                         const size_t bufsize)
+{
+  dt_iop_module_t *last = steps[nsteps - 1].module;
+  for(int k = 0; k < nsteps; k++)
+  {
+    steps[k].piece->processed_roi_in = *roi;
+    steps[k].piece->processed_roi_out = *roi;
+  }
+
+  // input of the first fused module
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi,
+                                modules, pieces, pos))
+    return TRUE;
+
+  dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, last, FALSE);
+  if(dt_pipe_shutdown(pipe))
+    return TRUE;
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+  const double process_start = dt_get_wtime();
+
+  const size_t width = roi->width;
+  const size_t max_bpp = 4 * sizeof(float); // largest pixel format in the pipe
+  const size_t nthreads = dt_get_num_threads();
+  const int block_rows = MAX(nthreads, FUSED_BLOCK_BYTES * nthreads / (width * max_bpp));
+  // the first and last module work in place of the full buffers, keep every block start
+  // on a cacheline by making block * width a multiple of it, good for any pixel size
+  int a = width % DT_CACHELINE_BYTES, b = DT_CACHELINE_BYTES;
+  while(a)
+  {
+    const int t = b % a;
+    b = a;
+    a = t;
+  }
+  const int cl_rows = DT_CACHELINE_BYTES / b;
+  a = yalign;
+  b = cl_rows;
+  while(b)
+  {
+    const int t = a % b;
+    a = b;
+    b = t;
+  }
+  const int rows_align = yalign / a * cl_rows;
+  const int block = MIN(roi->height, (block_rows + rows_align - 1) / rows_align * rows_align);
+
+  void *buf[2] = { dt_alloc_aligned(width * block * max_bpp),
+                   dt_alloc_aligned(width * block * max_bpp) };
+  if(!buf[0] || !buf[1])
+  {
+    dt_free_align(buf[0]);
+    dt_free_align(buf[1]);
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+                  "fused failed", pipe, last, DT_DEVICE_CPU, roi, roi,
+                  "could not allocate %dx%d block buffers", roi->width, block);
+    return TRUE;
+  }
+
+  const dt_iop_order_iccprofile_info_t *const work_profile =
+    (input_format->cst != IOP_CS_RAW)
+      ? dt_ioppr_get_pipe_work_profile_info(pipe)
+      : NULL;
+
+  dt_print_pipe(DT_DEBUG_PIPE | DT_DEBUG_TILING,
+                "process fused", pipe, last, DT_DEVICE_CPU, roi, roi,
+                "%d modules from `%s%s', blocks of %dx%d",
+                nsteps, steps[0].module->op, dt_iop_get_instance_id(steps[0].module),
+                roi->width, block);
+
+  dt_iop_buffer_dsc_t format = *input_format;
+  pipe->tiling = TRUE;
+
+  for(int y = 0; y < roi->height && !dt_pipe_shutdown(pipe); y += block)
+  {
+    const int rows = MIN(block, roi->height - y);
+    const dt_iop_roi_t troi = { roi->x, roi->y + y, roi->width, rows, roi->scale };
+    const gboolean first_block = y == 0;
+
+    for(int k = 0; k < nsteps; k++)
+    {
+      _fused_step_t *s = &steps[k];
+      dt_iop_module_t *module = s->module;
+      dt_dev_pixelpipe_iop_t *piece = s->piece;
+
+      if(first_block)
+      {
+        // the formats don't depend on pixel data, set them up as the unfused pipe does
+        module->position = s->pos;
+        s->in_bpp = dt_iop_buffer_dsc_to_bpp(&format);
+        s->cst_from = format.cst;
+        s->cst_to = module->input_colorspace(module, pipe, piece);
+        piece->dsc_out = piece->dsc_in = format;
+        module->output_format(module, pipe, piece, &piece->dsc_out);
+        s->out_bpp = dt_iop_buffer_dsc_to_bpp(&piece->dsc_out);
+        s->dsc = piece->dsc_out;
+      }
+      pipe->dsc = s->dsc;
+
+      void *in = k == 0
+        ? (char *)input + y * width * s->in_bpp
+        : buf[(k - 1) & 1];
+      void *out = k == nsteps - 1
+        ? (char *)*output + y * width * s->out_bpp
+        : buf[k & 1];
+
+      int cst = s->cst_from;
+      dt_ioppr_transform_image_colorspace(module, in, in, troi.width, troi.height,
+                                          s->cst_from, s->cst_to, &cst, work_profile);
+
+      module->process(module, piece, in, out, &troi, &troi);
+
+      if(first_block)
+      {
+        // output format as seen by the next module, including processed_maximum
+        format = pipe->dsc;
+        format.cst = module->output_colorspace(module, pipe, piece);
+        piece->dsc_out = format;
+      }
+    }
+  }
+
+  pipe->tiling = FALSE;
+  dt_free_align(buf[0]);
+  dt_free_align(buf[1]);
+
+  // the first module converted its input in place
+  input_format->cst = steps[0].cst_to;
+
+  if(_module_pipe_stop(pipe, input))
+  {
+    // the block loop might have stopped halfway through the output
+    dt_dev_pixelpipe_invalidate_cacheline(pipe, *output);
+    return TRUE;
+  }
+
+  **out_format = pipe->dsc = format;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "[%s] processed %d modules up to `%s%s' fused on CPU",
+                  dt_dev_pixelpipe_type_to_str(pipe->type), nsteps,
+                  last->op, dt_iop_get_instance_id(last));
+
+  dt_dev_pixelpipe_cache_set_cost(pipe, *output, dt_get_wtime() - process_start);
+  dt_dev_pixelpipe_cache_disk_store(pipe, last, roi, steps[nsteps - 1].pos,
+                                    *output, bufsize, *out_format);
+
+  return dt_pipe_shutdown(pipe);
+}
+
+/* Composed processing of geometric modules.
+   Modules providing distort_roi_backtransform() only resample their input, a run of them
+   would write one full sized intermediate per module and interpolate the image again in each.
+   Instead the output positions are mapped back through all modules of the run and the input
+   of the first one is interpolated once. As with fused runs the intermediate results are not
+   cached and the modules don't see their buffers, so this is only done for pipes not attached
+   to the GUI and with nothing requiring the intermediates (blending, pickers, histograms). */
+
+// rows of output positions mapped at once
+#define WARP_BLOCK_ROWS 64
+
+typedef struct _warp_step_t
+{
+  dt_iop_module_t *module;
+  dt_dev_pixelpipe_iop_t *piece;
+  int pos;
+  dt_iop_roi_t roi_in, roi_out;
+} _warp_step_t;
+
+static gboolean _piece_is_warp(dt_dev_pixelpipe_t *pipe,
+                               dt_develop_t *dev,
+                               dt_dev_pixelpipe_iop_t *piece)
+{
+  dt_iop_module_t *module = piece->module;
+
+  return module->distort_roi_backtransform
+    && !(module->flags() & (IOP_FLAGS_WRITE_RASTER | IOP_FLAGS_WRITE_DETAILS))
+    && !(piece->blendop_data
+         && ((dt_develop_blend_params_t *)piece->blendop_data)->mask_mode != DEVELOP_MASK_DISABLED)
+    && !(piece->request_histogram & DT_REQUEST_ON)
+    && !_request_color_pick(pipe, dev, module)
+    && module->output_colorspace(module, pipe, piece)
+         == module->input_colorspace(module, pipe, piece);
+}
+
+/* check whether the module interpolates its input for the current parameters. Neutral
+   settings, integer offsets and flips map pixels onto pixels, process() copies them and
+   composing only such modules would turn these copies into an interpolation. */
+static gboolean _warp_resamples(dt_iop_module_t *module,
+                                dt_dev_pixelpipe_iop_t *piece,
+                                const dt_iop_roi_t *roi_in,
+                                const dt_iop_roi_t *roi_out)
+{
+  // the corners, the center and some positions in between
+  const float wd = roi_out->width - 1;
+  const float ht = roi_out->height - 1;
+  float DT_ALIGNED_ARRAY points[14] =
+    { 0.0f, 0.0f, wd, 0.0f, 0.0f, ht, wd, ht,
+      floorf(wd / 2.0f), floorf(ht / 2.0f),
+      floorf(wd / 3.0f), floorf(ht / 4.0f),
+      floorf(wd / 4.0f), floorf(2.0f * ht / 3.0f) };
+  const size_t count = sizeof(points) / sizeof(points[0]) / 2;
+
+  if(!module->distort_roi_backtransform(module, piece, roi_in, roi_out, points, count))
+    return TRUE;
+
+  for(size_t k = 0; k < 2 * count; k++)
+    if(fabsf(points[k] - roundf(points[k])) > 1e-3f)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* collect the run of geometric modules ending at modules/pieces, returns the number of
+   composed modules and the list position of the module providing their input */
+static int _warp_run(dt_dev_pixelpipe_t *pipe,
+                     dt_develop_t *dev,
+                     const dt_iop_roi_t *roi,
+                     const size_t bpp,
+                     GList **modules,
+                     GList **pieces,
+                     int *pos,
+                     _warp_step_t *steps)
+{
+  if((pipe->type & DT_DEV_PIXELPIPE_BASIC)
+     || pipe->devid > DT_DEVICE_CPU
+     || pipe->mask_display != DT_DEV_PIXELPIPE_DISPLAY_NONE
+     || bpp != 4 * sizeof(float)
+     || darktable.dump_pfm_pipe
+     || darktable.bench_module)
+    return 0;
+
+  GList *m = *modules;
+  GList *p = *pieces;
+  int n = 0;
+  int position = *pos;
+  dt_iop_roi_t roi_out = *roi;
+  int cst = IOP_CS_NONE;
+  int resampling = 0;
+
+  for(; m && n < FUSED_MAX_MODULES; m = g_list_previous(m), p = g_list_previous(p), position--)
+  {
+    dt_iop_module_t *module = m->data;
+    dt_dev_pixelpipe_iop_t *piece = p->data;
+    if(_skip_piece_on_tags(piece))
+      continue;
+    if(!_piece_is_warp(pipe, dev, piece))
+      break;
+    // all modules have to work in the same colorspace
+    const int module_cst = module->input_colorspace(module, pipe, piece);
+    if(n && module_cst != cst)
+      break;
+    cst = module_cst;
+
+    steps[n].module = module;
+    steps[n].piece = piece;
+    steps[n].pos = position;
+    steps[n].roi_out = roi_out;
+    module->modify_roi_in(module, piece, &roi_out, &steps[n].roi_in);
+    if(_warp_resamples(module, piece, &steps[n].roi_in, &steps[n].roi_out))
+      resampling++;
+    roi_out = steps[n].roi_in;
+    n++;
+  }
+
+  // without a module interpolating anyway the run is cheaper processed as usual
+  if(n < 2 || !resampling)
+    return 0;
+
+  // we collected backwards, process in pipe order
+  for(int k = 0; k < n / 2; k++)
+  {
+    const _warp_step_t tmp = steps[k];
+    steps[k] = steps[n - 1 - k];
+    steps[n - 1 - k] = tmp;
+  }
+
+  *modules = m;
+  *pieces = p;
+  *pos = position;
+  return n;
+}
+
+static gboolean _pixelpipe_process_warped(dt_dev_pixelpipe_t *pipe,
+                                          dt_develop_t *dev,
+                                          void **output,
+                                          dt_iop_buffer_dsc_t **out_format,
+                                          const dt_iop_roi_t *roi,
+                                          _warp_step_t *steps,
+                                          const int nsteps,
+                                          GList *modules,
+                                          GList *pieces,
+                                          const int pos,
+                                          const dt_hash_t hash,
+                                          const size_t bufsize)
+{
+  dt_iop_module_t *last = steps[nsteps - 1].module;
+  const dt_iop_roi_t *roi_in = &steps[0].roi_in;
+  for(int k = 0; k < nsteps; k++)
+  {
+    steps[k].piece->processed_roi_in = steps[k].roi_in;
+    steps[k].piece->processed_roi_out = steps[k].roi_out;
+  }
+
+  // input of the first module
+  void *input = NULL;
+  void *cl_mem_input = NULL;
+  dt_iop_buffer_dsc_t _input_format = { 0 };
+  dt_iop_buffer_dsc_t *input_format = &_input_format;
+  if(_dev_pixelpipe_process_rec(pipe, dev, &input, &cl_mem_input, &input_format, roi_in,
+                                modules, pieces, pos))
+    return TRUE;
+
+  if(dt_iop_buffer_dsc_to_bpp(input_format) != 4 * sizeof(float))
+  {
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+                  "warp failed", pipe, last, DT_DEVICE_CPU, roi_in, roi,
+                  "input is not 4 floats per pixel");
+    return TRUE;
+  }
+
+  dt_dev_pixelpipe_cache_get(pipe, hash, bufsize, output, out_format, last, FALSE);
+  if(dt_pipe_shutdown(pipe))
+    return TRUE;
+
+  dt_times_t start;
+  dt_get_perf_times(&start);
+  const double process_start = dt_get_wtime();
+
+  const int block = MIN(roi->height, WARP_BLOCK_ROWS);
+  float *points = dt_alloc_align_float((size_t)2 * roi->width * block);
+  if(!points)
+  {
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+                  "warp failed", pipe, last, DT_DEVICE_CPU, roi_in, roi,
+                  "could not allocate %dx%d positions", roi->width, block);
+    return TRUE;
+  }
+
+  // the formats don't depend on pixel data, set them up as the unwarped pipe does
+  dt_iop_buffer_dsc_t format = *input_format;
+  const int cst_from = format.cst;
+  const int cst_to = steps[0].module->input_colorspace(steps[0].module, pipe, steps[0].piece);
+  for(int k = 0; k < nsteps; k++)
+  {
+    dt_iop_module_t *module = steps[k].module;
+    dt_dev_pixelpipe_iop_t *piece = steps[k].piece;
+    module->position = steps[k].pos;
+    format.cst = cst_to;
+    piece->dsc_out = piece->dsc_in = format;
+    module->output_format(module, pipe, piece, &piece->dsc_out);
+    format = piece->dsc_out;
+    format.cst = module->output_colorspace(module, pipe, piece);
+    piece->dsc_out = format;
+  }
+
+  const dt_iop_order_iccprofile_info_t *const work_profile =
+    (input_format->cst != IOP_CS_RAW)
+      ? dt_ioppr_get_pipe_work_profile_info(pipe)
+      : NULL;
+  int cst = cst_from;
+  dt_ioppr_transform_image_colorspace(steps[0].module, input, input,
+                                      roi_in->width, roi_in->height,
+                                      cst_from, cst_to, &cst, work_profile);
+
+  dt_print_pipe(DT_DEBUG_PIPE,
+                "process warped", pipe, last, DT_DEVICE_CPU, roi_in, roi,
+                "%d modules from `%s%s'",
+                nsteps, steps[0].module->op, dt_iop_get_instance_id(steps[0].module));
+
+  const dt_interpolation_t *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
+  const int width = roi->width;
+  const float *const in = (const float *)input;
+  float *const out = (float *)*output;
+
+  gboolean failed = FALSE;
+  for(int y = 0; y < roi->height && !failed && !dt_pipe_shutdown(pipe); y += block)
+  {
+    const int rows = MIN(block, roi->height - y);
+    const size_t count = (size_t)width * rows;
+
+    DT_OMP_FOR(collapse(2))
+    for(int j = 0; j < rows; j++)
+      for(int i = 0; i < width; i++)
+      {
+        float *const pt = points + 2 * ((size_t)j * width + i);
+        pt[0] = i;
+        pt[1] = y + j;
+      }
+
+    // from the output of the last module back to the input of the first one
+    for(int k = nsteps - 1; k >= 0 && !failed; k--)
+    {
+      dt_iop_module_t *module = steps[k].module;
+      failed = !module->distort_roi_backtransform(module, steps[k].piece,
+                                                  &steps[k].roi_in, &steps[k].roi_out,
+                                                  points, count);
+    }
+
+    DT_OMP_FOR()
+    for(int j = 0; j < rows; j++)
+    {
+      float *const o = out + (size_t)4 * width * (y + j);
+      const float *const pt = points + (size_t)2 * width * j;
+      for(int i = 0; i < width; i++)
+        dt_interpolation_compute_pixel4c(interpolation, in, o + 4 * i,
+                                         pt[2 * i], pt[2 * i + 1],
+                                         roi_in->width, roi_in->height, 4 * roi_in->width);
+    }
+  }
+
+  dt_free_align(points);
+
+  if(failed)
+  {
+    dt_print_pipe(DT_DEBUG_ALWAYS,
+                  "warp failed", pipe, last, DT_DEVICE_CPU, roi_in, roi,
+                  "positions could not be mapped");
+    return TRUE;
+  }
+
+  // the first module converted its input in place
+  input_format->cst = cst_to;
+
+  if(_module_pipe_stop(pipe, input))
+    return TRUE;
+
+  **out_format = pipe->dsc = format;
+
+  dt_show_times_f(&start, "[dev_pixelpipe]", "[%s] processed %d modules up to `%s%s' warped on CPU",
+                  dt_dev_pixelpipe_type_to_str(pipe->type), nsteps,
+                  last->op, dt_iop_get_instance_id(last));
+
+  dt_dev_pixelpipe_cache_set_cost(pipe, *output, dt_get_wtime() - process_start);
+  dt_dev_pixelpipe_cache_disk_store(pipe, last, roi, steps[nsteps - 1].pos,
+                                    *output, bufsize, *out_format);
+
+  return dt_pipe_shutdown(pipe);
+}
+
 // recursive helper for process, returns TRUE in case of unfinished work or error
 static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
                                            dt_develop_t *dev,
@@ -1618,7 +2213,8 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
       !gamma_preview
       && (pipe->mask_display == DT_DEV_PIXELPIPE_DISPLAY_NONE)
       && !pipe->nocache
-      && dt_dev_pixelpipe_cache_available(pipe, hash, bufsize);
+      && (dt_dev_pixelpipe_cache_available(pipe, hash, bufsize)
+          || dt_dev_pixelpipe_cache_disk_load(pipe, module, roi_out, pos, hash, bufsize));
 
   if(cache_available)
   {
@@ -1765,6 +2361,31 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
   if(dt_pipe_shutdown(pipe))
     return TRUE;
 
+  // pointwise modules that would have to tile are processed fused if possible
+  _fused_step_t fused[FUSED_MAX_MODULES];
+  GList *fused_modules = modules;
+  GList *fused_pieces = pieces;
+  int fused_pos = pos;
+  int fused_yalign = 1;
+  const int nfused = _fused_run(pipe, dev, roi_out, bpp, &fused_modules, &fused_pieces,
+                                &fused_pos, fused, &fused_yalign);
+  if(nfused)
+    return _pixelpipe_process_fused(pipe, dev, output, out_format, roi_out,
+                                    fused, nfused, fused_yalign,
+                                    fused_modules, fused_pieces, fused_pos, hash, bufsize);
+
+  // consecutive geometric modules are composed into one resampling pass
+  _warp_step_t warp[FUSED_MAX_MODULES];
+  GList *warp_modules = modules;
+  GList *warp_pieces = pieces;
+  int warp_pos = pos;
+  const int nwarp = _warp_run(pipe, dev, roi_out, bpp, &warp_modules, &warp_pieces,
+                              &warp_pos, warp);
+  if(nwarp)
+    return _pixelpipe_process_warped(pipe, dev, output, out_format, roi_out,
+                                     warp, nwarp, warp_modules, warp_pieces, warp_pos,
+                                     hash, bufsize);
+
   module->modify_roi_in(module, piece, roi_out, &roi_in);
   if((darktable.unmuted & DT_DEBUG_PIPE) && memcmp(roi_out, &roi_in, sizeof(dt_iop_roi_t)))
   {
@@ -1820,6 +2441,7 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
 
   dt_times_t start;
   dt_get_perf_times(&start);
+  const double process_start = dt_get_wtime();
 
   dt_pixelpipe_flow_t pixelpipe_flow =
     (PIXELPIPE_FLOW_NONE | PIXELPIPE_FLOW_HISTOGRAM_NONE);
@@ -2865,6 +3487,13 @@ static gboolean _dev_pixelpipe_process_rec(dt_dev_pixelpipe_t *pipe,
     }
   }
 
+  // the cache eviction policy weighs processing cost against buffer size
+  dt_dev_pixelpipe_cache_set_cost(pipe, *output, dt_get_wtime() - process_start);
+
+  // keep expensive results in the disk tier of the cache, only host memory data is valid
+  if(*cl_mem_output == NULL && !gamma_preview)
+    dt_dev_pixelpipe_cache_disk_store(pipe, module, roi_out, pos, *output, bufsize, *out_format);
+
   // 4) colorpicker and scopes:
   if(dt_pipe_shutdown(pipe))
     return TRUE;
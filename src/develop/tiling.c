@@ -23,6 +23,7 @@
 #include "develop/pixelpipe.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -93,6 +94,209 @@ static inline void _print_roi(const dt_iop_roi_t *roi, const char *label)
            roi->width, roi->height, roi->scale, label);
 }
 
+/* Tiling planner.
+   The tile shape is chosen from a simple cost model: each tile costs the number of pixels it
+   processes (including the overlap which is computed again by its neighbours) plus a fixed
+   per-tile cost for process() setup, buffer copies and - with OpenCL - kernel launches and
+   host/device synchronisation. Candidates are generated for every number of tile columns
+   (tiles as high as the memory limit allows) and every number of tile rows (tiles as wide as
+   possible), so full width strips and full height columns are part of the search. For modules
+   with large overlap the strips avoid the overlap in one direction altogether, for row streaming
+   modules with no overlap they keep the tile copies contiguous. */
+
+/* fixed costs of one tile in units of processed pixels */
+#define TILE_COST_CPU (1 << 16)
+#define TILE_COST_CL (1 << 18)
+
+/* upper limit of tile columns/rows to evaluate */
+#define PLAN_MAX_CANDIDATES 256
+
+typedef struct _tiling_plan_t
+{
+  int width, height;     // tile dimensions including overlap
+  int tiles_x, tiles_y;  // number of tiles actually processed
+  double cost;           // predicted cost in processed pixels
+  double waste;          // processed pixels outside of the image area
+} _tiling_plan_t;
+
+/* number of processed tiles and processed pixels along one axis.
+   mirrors the tile loops: end tiles not larger than the overlap are skipped */
+static int _plan_axis(const int full,
+                      const int dim,
+                      const int lost,
+                      double *extent)
+{
+  if(dim >= full)
+  {
+    *extent = full;
+    return 1;
+  }
+  const int step = MAX(dim - lost, 1);
+  const int count = (int)ceilf((float)full / (float)step);
+  if(dim <= lost)
+  {
+    /* degenerated tiles without an effective part, as counted by the tile loops */
+    *extent = (double)count * dim;
+    return count;
+  }
+  int n = 0;
+  double sum = 0.0;
+  for(int k = 0; k < count; k++)
+  {
+    const int d = MIN(dim, full - k * step);
+    if(k > 0 && d <= lost) continue;
+    sum += d;
+    n++;
+  }
+  *extent = sum;
+  return n;
+}
+
+static gboolean _plan_evaluate(_tiling_plan_t *plan,
+                               const int full_width,
+                               const int full_height,
+                               const int width,
+                               const int height,
+                               const int lost,
+                               const double tile_cost)
+{
+  double ex, ey;
+  const int tx = _plan_axis(full_width, width, lost, &ex);
+  const int ty = _plan_axis(full_height, height, lost, &ey);
+  if((double)tx * ty > _maximum_number_tiles()) return FALSE;
+
+  const double cost = ex * ey + (double)tx * ty * tile_cost;
+  if(plan->width > 0 && cost >= plan->cost) return FALSE;
+
+  plan->width = width;
+  plan->height = height;
+  plan->tiles_x = tx;
+  plan->tiles_y = ty;
+  plan->cost = cost;
+  plan->waste = ex * ey - (double)full_width * full_height;
+  return TRUE;
+}
+
+/* tile dimension to cover full in n tiles, 0 if that is not possible within limit */
+static int _plan_dimension(const int full,
+                           const int n,
+                           const int lost,
+                           const int limit,
+                           const int align)
+{
+  if(n == 1) return full <= limit ? full : 0;
+  const int dim = _align_up((full + n - 1) / n + lost, align);
+  return dim < full && dim <= limit ? dim : 0;
+}
+
+/* largest aligned tile dimension not exceeding pixels / other */
+static int _plan_fill(const int full,
+                      const int other,
+                      const float pixels,
+                      const int limit,
+                      const int align)
+{
+  const float dim = pixels / (float)MAX(other, 1);
+  if(dim >= full && full <= limit) return full;
+  return _align_down((int)fminf(dim, (float)limit), align);
+}
+
+/* shrink the last tile's slack: same number of tiles but evenly sized */
+static int _plan_balance(const int full,
+                         const int dim,
+                         const int lost,
+                         const int align)
+{
+  if(dim >= full) return dim;
+  double extent;
+  const int n = _plan_axis(full, dim, lost, &extent);
+  const int balanced = _plan_dimension(full, n, lost, dim, align);
+  if(balanced <= 0) return dim;
+  return _plan_axis(full, balanced, lost, &extent) <= n ? balanced : dim;
+}
+
+/* caller names the reporting function, pass NULL for a silent estimate */
+static _tiling_plan_t _tiling_plan(const char *caller,
+                                   dt_dev_pixelpipe_iop_t *piece,
+                                   const int full_width,
+                                   const int full_height,
+                                   const int max_width,
+                                   const int max_height,
+                                   const float singlebuffer,
+                                   const float pixelsize,
+                                   const int overlap,
+                                   const int lost,
+                                   const int walign,
+                                   const int halign,
+                                   const double tile_cost)
+{
+  _tiling_plan_t plan = { 0 };
+  const float pixels = singlebuffer / fmaxf(pixelsize, 1.0f);
+
+  /* a tile must keep a reasonably effective part besides the overlap */
+  const int min_width = MAX(3 * overlap, walign);
+  const int min_height = MAX(3 * overlap, halign);
+
+  if(full_width <= max_width && full_height <= max_height
+     && (float)full_width * full_height <= pixels)
+    _plan_evaluate(&plan, full_width, full_height, full_width, full_height, lost, tile_cost);
+
+  /* fixed number of tile columns, as high as memory permits */
+  for(int nx = 1; nx <= PLAN_MAX_CANDIDATES && plan.tiles_x * plan.tiles_y != 1; nx++)
+  {
+    const int width = _plan_dimension(full_width, nx, lost, max_width, walign);
+    if(width <= 0) continue;
+    if(width < min_width && width < full_width) break;
+    int height = _plan_fill(full_height, width, pixels, max_height, halign);
+    if(height < min_height && height < full_height) continue;
+    height = _plan_balance(full_height, height, lost, halign);
+    _plan_evaluate(&plan, full_width, full_height, width, height, lost, tile_cost);
+  }
+
+  /* fixed number of tile rows, as wide as memory permits */
+  for(int ny = 1; ny <= PLAN_MAX_CANDIDATES && plan.tiles_x * plan.tiles_y != 1; ny++)
+  {
+    const int height = _plan_dimension(full_height, ny, lost, max_height, halign);
+    if(height <= 0) continue;
+    if(height < min_height && height < full_height) break;
+    int width = _plan_fill(full_width, height, pixels, max_width, walign);
+    if(width < min_width && width < full_width) continue;
+    width = _plan_balance(full_width, width, lost, walign);
+    _plan_evaluate(&plan, full_width, full_height, width, height, lost, tile_cost);
+  }
+
+  if(plan.width <= 0)
+  {
+    /* nothing fits the cost model constraints, use squares as the last resort */
+    const int align = _lcm(walign, halign);
+    const int side = MAX(_align_down((int)sqrtf(pixels), align), align);
+    plan.width = MIN(side, MIN(max_width, full_width));
+    plan.height = MIN(side, MIN(max_height, full_height));
+    double ex, ey;
+    plan.tiles_x = _plan_axis(full_width, plan.width, lost, &ex);
+    plan.tiles_y = _plan_axis(full_height, plan.height, lost, &ey);
+    plan.cost = ex * ey + (double)plan.tiles_x * plan.tiles_y * tile_cost;
+    plan.waste = ex * ey - (double)full_width * full_height;
+    if(caller)
+      dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
+               "[%s] [%s] no tile shape within limits, use squares %dx%d",
+               caller, dt_dev_pixelpipe_type_to_str(piece->pipe->type), plan.width, plan.height);
+  }
+
+  if(caller)
+    dt_print(DT_DEBUG_TILING,
+             "[%s] [%s] plan for module '%s%s': %dx%d %s of %dx%d, overlap %d, "
+             "predicted cost %.1f Mpix (%.1f%% overlap waste)",
+             caller, dt_dev_pixelpipe_type_to_str(piece->pipe->type),
+             piece->module->op, dt_iop_get_instance_id(piece->module),
+             plan.tiles_x, plan.tiles_y,
+             (plan.tiles_x == 1) != (plan.tiles_y == 1) ? "strips" : "tiles",
+             plan.width, plan.height, overlap, plan.cost * 1e-6,
+             100.0 * plan.waste / fmax((double)full_width * full_height, 1.0));
+
+  return plan;
+}
+
 
 static double _nm_fitness(double x[], void *rest[])
 {
@@ -624,42 +828,6 @@ static void _default_process_tiling_ptp(dt_iop_module_t *self,
   const float maxbuf = fmaxf(tiling.maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
-  int width = roi_in->width;
-  int height = roi_in->height;
-
-  /* shrink tile size in case it would exceed singlebuffer size */
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-
-    /* TODO: can we make this more efficient to minimize total overlap between tiles? */
-    if(width < height && scale >= 0.333f)
-    {
-      height = floorf(height * scale);
-    }
-    else if(height <= width && scale >= 0.333f)
-    {
-      width = floorf(width * scale);
-    }
-    else
-    {
-      width = floorf(width * sqrtf(scale));
-      height = floorf(height * sqrtf(scale));
-    }
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_ptp] buffer exceeds singlebuffer, corrected to %dx%d",
-             width, height);
-  }
-
-  /* make sure we have a reasonably effective tile dimension. if not try square tiles */
-  if(3 * tiling.overlap > width || 3 * tiling.overlap > height)
-  {
-    width = height = floorf(sqrtf((float)width * height));
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_roi] use squares because of overlap, corrected to %dx%d",
-             width, height);
-  }
-
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
      Typical use case is demosaic where Bayer pattern requires alignment to a multiple of 2 in x and y
@@ -671,14 +839,18 @@ static void _default_process_tiling_ptp(dt_iop_module_t *self,
 
   assert(xyalign != 0);
 
-  /* properly align tile width and height by making them smaller if needed */
-  if(width < roi_in->width) width = (width / xyalign) * xyalign;
-  if(height < roi_in->height) height = (height / xyalign) * xyalign;
-
-  /* also make sure that overlap follows alignment rules by making it wider when needed */
+  /* make sure that overlap follows alignment rules by making it wider when needed */
   const int overlap = tiling.overlap % xyalign != 0 ? (tiling.overlap / xyalign + 1) * xyalign
                                                     : tiling.overlap;
 
+  /* choose tile shape and count, tile dimensions are aligned by the planner */
+  const _tiling_plan_t plan = _tiling_plan("default_process_tiling_ptp", piece,
+                                           roi_in->width, roi_in->height, INT_MAX, INT_MAX,
+                                           singlebuffer, max_bpp * maxbuf, overlap, 2 * overlap,
+                                           xyalign, xyalign, TILE_COST_CPU);
+  const int width = plan.width;
+  const int height = plan.height;
+
   /* calculate effective tile size */
   const int tile_wd = width - 2 * overlap > 0 ? width - 2 * overlap : 1;
   const int tile_ht = height - 2 * overlap > 0 ? height - 2 * overlap : 1;
@@ -894,9 +1066,6 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
   const float maxbuf = fmaxf(tiling.maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
-  int width = MAX(roi_in->width, roi_out->width);
-  int height = MAX(roi_in->height, roi_out->height);
-
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
      Typical use case is demosaic where Bayer pattern requires alignment to a multiple of 2 in x and y
@@ -907,44 +1076,21 @@ static void _default_process_tiling_roi(dt_iop_module_t *self,
 
   assert(xyalign != 0);
 
-  /* shrink tile size in case it would exceed singlebuffer size */
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-
-    /* TODO: can we make this more efficient to minimize total overlap between tiles? */
-    if(width < height && scale >= 0.333f)
-    {
-      height = _align_down((int)floorf(height * scale), xyalign);
-    }
-    else if(height <= width && scale >= 0.333f)
-    {
-      width = _align_down((int)floorf(width * scale), xyalign);
-    }
-    else
-    {
-      width = _align_down((int)floorf(width * sqrtf(scale)), xyalign);
-      height = _align_down((int)floorf(height * sqrtf(scale)), xyalign);
-    }
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_roi] [%s] buffer exceeds singlebuffer, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
-
-  /* make sure we have a reasonably effective tile dimension. if not try square tiles */
-  if(3 * tiling.overlap > width || 3 * tiling.overlap > height)
-  {
-    width = height = _align_down((int)floorf(sqrtf((float)width * height)), xyalign);
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_roi] [%s] use squares because of overlap, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
-
   /* make sure that overlap follows alignment rules by making it wider when needed.
      overlap_in needs to be aligned, overlap_out is only here to calculate output buffer size */
   const int overlap_in = _align_up(tiling.overlap, xyalign);
   const int overlap_out = ceilf((float)overlap_in / fullscale);
 
+  /* choose tile shape and count guided by the larger buffer, the tile loops below
+     recalculate the exact tile positions */
+  const _tiling_plan_t plan = _tiling_plan("default_process_tiling_roi", piece,
+                                           MAX(roi_in->width, roi_out->width),
+                                           MAX(roi_in->height, roi_out->height), INT_MAX, INT_MAX,
+                                           singlebuffer, max_bpp * maxbuf, overlap_in,
+                                           2 * overlap_in + inacc, xyalign, xyalign, TILE_COST_CPU);
+  const int width = plan.width;
+  const int height = plan.height;
+
   int tiles_x = 1, tiles_y = 1;
 
   /* calculate number of tiles taking the larger buffer (input or output) as a guiding one.
@@ -1213,27 +1359,15 @@ float dt_tiling_estimate_cpumem(dt_develop_tiling_t *tiling,
   const float maxbuf = fmaxf(tiling->maxbuf, 1.0f);
   singlebuffer = fmaxf(available / factor, singlebuffer);
 
-  int width = MAX(roi_in->width, roi_out->width);
-  int height = MAX(roi_in->height, roi_out->height);
-
   const unsigned int xyalign = _lcm(tiling->xalign, tiling->yalign);
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-    if(width < height && scale >= 0.333f)
-       height = _align_down((int)floorf(height * scale), xyalign);
-    else if(height <= width && scale >= 0.333f)
-      width = _align_down((int)floorf(width * scale), xyalign);
-    else
-    {
-      width = _align_down((int)floorf(width * sqrtf(scale)), xyalign);
-      height = _align_down((int)floorf(height * sqrtf(scale)), xyalign);
-    }
-  }
-
-  if(3 * tiling->overlap > width || 3 * tiling->overlap > height)
-    width = height = _align_down((int)floorf(sqrtf((float)width * height)), xyalign);
   const int overlap_in = _align_up(tiling->overlap, xyalign);
+  const _tiling_plan_t plan = _tiling_plan(NULL, piece,
+                                           MAX(roi_in->width, roi_out->width),
+                                           MAX(roi_in->height, roi_out->height), INT_MAX, INT_MAX,
+                                           singlebuffer, max_bpp * maxbuf, overlap_in, 2 * overlap_in,
+                                           xyalign, xyalign, TILE_COST_CPU);
+  const int width = plan.width;
+  const int height = plan.height;
   const int overlap_out = ceilf((float)overlap_in / fullscale);
 
   int tiles_x = 1, tiles_y = 1;
@@ -1270,31 +1404,19 @@ float dt_tiling_estimate_clmem(dt_develop_tiling_t *tiling,
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmaxf(tiling->maxbuf_cl, 1.0f);
 
-  int width = MIN(MAX(roi_in->width, roi_out->width), darktable.opencl->dev[devid].max_image_width);
-  int height = MIN(MAX(roi_in->height, roi_out->height), darktable.opencl->dev[devid].max_image_height);
-
   unsigned int xyalign = _lcm(tiling->xalign, tiling->yalign);
   xyalign = _lcm(xyalign, CL_ALIGNMENT);
 
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-
-    if(width < height && scale >= 0.333f)
-       height = _align_down((int)floorf(height * scale), xyalign);
-     else if(height <= width && scale >= 0.333f)
-       width = _align_down((int)floorf(width * scale), xyalign);
-     else
-    {
-      width = _align_down((int)floorf(width * sqrtf(scale)), xyalign);
-      height = _align_down((int)floorf(height * sqrtf(scale)), xyalign);
-    }
-  }
-
-  if(3 * tiling->overlap > width || 3 * tiling->overlap > height)
-    width = height = _align_down((int)floorf(sqrtf((float)width * height)), xyalign);
-
   const int overlap_in = _align_up(tiling->overlap, xyalign);
+  const _tiling_plan_t plan = _tiling_plan(NULL, piece,
+                                           MAX(roi_in->width, roi_out->width),
+                                           MAX(roi_in->height, roi_out->height),
+                                           darktable.opencl->dev[devid].max_image_width,
+                                           darktable.opencl->dev[devid].max_image_height,
+                                           singlebuffer, max_bpp * maxbuf, overlap_in, 2 * overlap_in,
+                                           xyalign, xyalign, TILE_COST_CL);
+  const int width = plan.width;
+  const int height = plan.height;
   const int overlap_out = ceilf((float)overlap_in / fullscale);
 
   int tiles_x = 1, tiles_y = 1;
@@ -1357,40 +1479,6 @@ static int _default_process_tiling_cl_ptp(dt_iop_module_t *self,
   const float singlebuffer = fminf(fmaxf((available - tiling.overhead) / factor, 0.0f),
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmaxf(tiling.maxbuf_cl, 1.0f);
-  int width = MIN(roi_in->width, darktable.opencl->dev[devid].max_image_width);
-  int height = MIN(roi_in->height, darktable.opencl->dev[devid].max_image_height);
-
-  /* shrink tile size in case it would exceed singlebuffer size */
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-
-    if(width < height && scale >= 0.333f)
-    {
-      height = floorf(height * scale);
-    }
-    else if(height <= width && scale >= 0.333f)
-    {
-      width = floorf(width * scale);
-    }
-    else
-    {
-      width = floorf(width * sqrtf(scale));
-      height = floorf(height * sqrtf(scale));
-    }
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_cl_ptp] [%s] buffer exceeds singlebuffer, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
-
-  /* make sure we have a reasonably effective tile dimension. if not try square tiles */
-  if(3 * tiling.overlap > width || 3 * tiling.overlap > height)
-  {
-    width = height = floorf(sqrtf((float)width * height));
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_cl_ptp] [%s] use squares because of overlap, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
 
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
@@ -1409,14 +1497,19 @@ static int _default_process_tiling_cl_ptp(dt_iop_module_t *self,
 
   assert(xyalign != 0 && walign != 0 && halign != 0);
 
-  /* properly align tile width and height by making them smaller if needed */
-  if(width < roi_in->width) width = (width / walign) * walign;
-  if(height < roi_in->height) height = (height / halign) * halign;
-
   /* also make sure that overlap follows alignment rules by making it wider when needed */
   const int overlap = tiling.overlap % xyalign != 0 ? (tiling.overlap / xyalign + 1) * xyalign
                                                     : tiling.overlap;
 
+  /* choose tile shape and count within the device limits */
+  const _tiling_plan_t plan = _tiling_plan("default_process_tiling_cl_ptp", piece,
+                                           roi_in->width, roi_in->height,
+                                           darktable.opencl->dev[devid].max_image_width,
+                                           darktable.opencl->dev[devid].max_image_height,
+                                           singlebuffer, max_bpp * maxbuf, overlap, 2 * overlap,
+                                           walign, halign, TILE_COST_CL);
+  const int width = plan.width;
+  const int height = plan.height;
 
   /* calculate effective tile size */
   const int tile_wd = width - 2 * overlap > 0 ? width - 2 * overlap : 1;
@@ -1738,9 +1831,6 @@ static int _default_process_tiling_cl_roi(dt_iop_module_t *self,
                                   pinned_buffer_slack * (float)(dt_opencl_get_device_memalloc(devid)));
   const float maxbuf = fmaxf(tiling.maxbuf_cl, 1.0f);
 
-  int width = MIN(MAX(roi_in->width, roi_out->width), darktable.opencl->dev[devid].max_image_width);
-  int height = MIN(MAX(roi_in->height, roi_out->height), darktable.opencl->dev[devid].max_image_height);
-
   /* Alignment rules: we need to make sure that alignment requirements of module are fulfilled.
      Modules will report alignment requirements via xalign and yalign within tiling_callback().
      Typical use case is demosaic where Bayer pattern requires alignment to a multiple of 2 in x and y
@@ -1752,43 +1842,22 @@ static int _default_process_tiling_cl_roi(dt_iop_module_t *self,
 
   assert(xyalign != 0);
 
-  /* shrink tile size in case it would exceed singlebuffer size */
-  if((float)width * height * max_bpp * maxbuf > singlebuffer)
-  {
-    const float scale = singlebuffer / ((float)width * height * max_bpp * maxbuf);
-
-    if(width < height && scale >= 0.333f)
-    {
-      height = _align_down((int)floorf(height * scale), xyalign);
-    }
-    else if(height <= width && scale >= 0.333f)
-    {
-      width = _align_down((int)floorf(width * scale), xyalign);
-    }
-    else
-    {
-      width = _align_down((int)floorf(width * sqrtf(scale)), xyalign);
-      height = _align_down((int)floorf(height * sqrtf(scale)), xyalign);
-    }
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_cl_roi] [%s] buffer exceeds singlebuffer, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
-
-  /* make sure we have a reasonably effective tile dimension. if not try square tiles */
-  if(3 * tiling.overlap > width || 3 * tiling.overlap > height)
-  {
-    width = height = _align_down((int)floorf(sqrtf((float)width * height)), xyalign);
-    dt_print(DT_DEBUG_TILING | DT_DEBUG_VERBOSE,
-             "[default_process_tiling_cl_roi] [%s] use squares because of overlap, corrected to %dx%d",
-             dt_dev_pixelpipe_type_to_str(piece->pipe->type), width, height);
-  }
-
   /* make sure that overlap follows alignment rules by making it wider when needed.
      overlap_in needs to be aligned, overlap_out is only here to calculate output buffer size */
   const int overlap_in = _align_up(tiling.overlap, xyalign);
   const int overlap_out = ceilf((float)overlap_in / fullscale);
 
+  /* choose tile shape and count guided by the larger buffer within the device limits */
+  const _tiling_plan_t plan = _tiling_plan("default_process_tiling_cl_roi", piece,
+                                           MAX(roi_in->width, roi_out->width),
+                                           MAX(roi_in->height, roi_out->height),
+                                           darktable.opencl->dev[devid].max_image_width,
+                                           darktable.opencl->dev[devid].max_image_height,
+                                           singlebuffer, max_bpp * maxbuf, overlap_in,
+                                           2 * overlap_in + inacc, xyalign, xyalign, TILE_COST_CL);
+  const int width = plan.width;
+  const int height = plan.height;
+
   int tiles_x = 1, tiles_y = 1;
 
   /* calculate number of tiles taking the larger buffer (input or output) as a guiding one.
@@ -17,6 +17,7 @@
 */
 
 #include <glib.h>    // for g_mkdir_with_parents, _
+#include <glib/gstdio.h> // for g_fopen, g_rename, g_unlink
 #include <gtk/gtk.h> // for gtk_init_check
 #include <libintl.h> // for bind_textdomain_codeset, etc
 #include <limits.h>  // for PATH_MAX
@@ -44,7 +45,126 @@
 #include "win/main_wrapper.h"
 #endif
 
-static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mipmap_size_t max_mip, const dt_imgid_t min_imgid, const int32_t max_imgid)
+// images handed to a worker at a time. small enough to balance the load of slow raw files,
+// big enough to keep the bookkeeping negligible.
+#define SHARD_SIZE 64
+// seconds between progress reports and checkpoint updates
+#define REPORT_INTERVAL 5
+
+typedef struct dt_generate_cache_t
+{
+  dt_mipmap_size_t min_mip, max_mip;
+  dt_imgid_t min_imgid, max_imgid; // requested range, part of the checkpoint
+  dt_imgid_t *imgid; // all images to process, sorted by id
+  size_t image_count;
+  size_t shard_count;
+  gint next_shard;   // next shard to hand out
+  gint *shard_done;  // per shard completion flag
+  gint processed;    // images done in this run
+  gint finished_workers;
+  gboolean verbose;  // report every image
+} dt_generate_cache_t;
+
+static void _process_image(dt_generate_cache_t *g,
+                           const dt_imgid_t imgid)
+{
+  for(int k = g->max_mip; k >= g->min_mip && k >= 0; k--)
+  {
+    // if a valid thumbnail is already on disc - do nothing
+    if(dt_mipmap_cache_disk_thumbnail_exists(imgid, k)) continue;
+
+    // else, generate thumbnail and store in mipmap cache.
+    dt_mipmap_buffer_t buf;
+    dt_mipmap_cache_get(&buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
+    dt_mipmap_cache_release(&buf);
+  }
+
+  // and immediately write thumbs to disc and remove from mipmap cache.
+  dt_mipmap_cache_evict(imgid);
+  // thumbnail in sync with image
+  dt_history_hash_set_mipmap(imgid);
+}
+
+static gpointer _worker(gpointer data)
+{
+  dt_generate_cache_t *g = (dt_generate_cache_t *)data;
+  size_t shard;
+  while((shard = g_atomic_int_add(&g->next_shard, 1)) < g->shard_count)
+  {
+    const size_t end = MIN((shard + 1) * SHARD_SIZE, g->image_count);
+    for(size_t i = shard * SHARD_SIZE; i < end; i++)
+    {
+      _process_image(g, g->imgid[i]);
+      const size_t counter = g_atomic_int_add(&g->processed, 1) + 1;
+      if(g->verbose)
+        fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d)\n",
+                counter, g->image_count, 100.0 * counter / (float)g->image_count, g->imgid[i]);
+    }
+    g_atomic_int_set(&g->shard_done[shard], 1);
+  }
+  g_atomic_int_inc(&g->finished_workers);
+  return NULL;
+}
+
+static void _checkpoint_filename(char *filename,
+                                 const size_t size)
+{
+  snprintf(filename, size, "%s.generate-cache", darktable.mipmap_cache->cachedir);
+}
+
+// all images up to the returned id are done if the checkpoint was written for the same
+// mip and image id ranges
+static dt_imgid_t _checkpoint_read(const dt_mipmap_size_t min_mip,
+                                   const dt_mipmap_size_t max_mip,
+                                   const dt_imgid_t min_imgid,
+                                   const int32_t max_imgid)
+{
+  char filename[PATH_MAX] = { 0 };
+  _checkpoint_filename(filename, sizeof(filename));
+  FILE *f = g_fopen(filename, "r");
+  if(!f) return NO_IMGID;
+
+  int mip0 = -1, mip1 = -1;
+  int32_t id0 = 0, id1 = 0;
+  dt_imgid_t done = NO_IMGID;
+  if(fscanf(f, "%d %d %d %d %d", &mip0, &mip1, &id0, &id1, &done) != 5
+     || mip0 != min_mip || mip1 != max_mip
+     || id0 != min_imgid || id1 != max_imgid)
+    done = NO_IMGID;
+  fclose(f);
+  return done;
+}
+
+static void _checkpoint_write(const dt_generate_cache_t *g,
+                              const dt_imgid_t done)
+{
+  char filename[PATH_MAX] = { 0 };
+  _checkpoint_filename(filename, sizeof(filename));
+  gchar *tmpname = g_strconcat(filename, ".tmp", NULL);
+  FILE *f = g_fopen(tmpname, "w");
+  if(f)
+  {
+    fprintf(f, "%d %d %d %d %d\n", g->min_mip, g->max_mip, g->min_imgid, g->max_imgid, done);
+    if(fclose(f) || g_rename(tmpname, filename)) g_unlink(tmpname);
+  }
+  g_free(tmpname);
+}
+
+// highest image id such that it and all images before it are done
+static dt_imgid_t _completed_imgid(const dt_generate_cache_t *g,
+                                   size_t *first_open)
+{
+  while(*first_open < g->shard_count && g_atomic_int_get(&g->shard_done[*first_open]))
+    (*first_open)++;
+  return *first_open ? g->imgid[MIN(*first_open * SHARD_SIZE, g->image_count) - 1] : NO_IMGID;
+}
+
+static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip,
+                                    const dt_mipmap_size_t max_mip,
+                                    const dt_imgid_t min_imgid,
+                                    const int32_t max_imgid,
+                                    const int jobs,
+                                    const gboolean resume)
 {
   fprintf(stderr, _("creating cache directories\n"));
   for(dt_mipmap_size_t k = min_mip; k <= max_mip; k++)
@@ -60,68 +180,100 @@ static int generate_thumbnail_cache(const dt_mipmap_size_t min_mip, const dt_mip
     }
   }
 
-  // some progress counter
+  // continue after the images finished by an interrupted run
+  dt_imgid_t first_imgid = min_imgid;
+  if(resume)
+  {
+    const dt_imgid_t done = _checkpoint_read(min_mip, max_mip, min_imgid, max_imgid);
+    if(dt_is_valid_imgid(done) && done >= min_imgid && done < max_imgid)
+    {
+      fprintf(stderr, _("resuming after image id %d\n"), done);
+      first_imgid = done + 1;
+    }
+  }
+
+  dt_generate_cache_t g = { 0 };
+  g.min_mip = min_mip;
+  g.max_mip = max_mip;
+  g.min_imgid = min_imgid;
+  g.max_imgid = max_imgid;
+  g.verbose = jobs == 1;
+
+  // collect all images up front, the workers only need the ids
   sqlite3_stmt *stmt;
-  size_t image_count = 0, counter = 0;
+  GArray *ids = g_array_new(FALSE, FALSE, sizeof(dt_imgid_t));
   DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT COUNT(*) FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
+                              "SELECT id FROM main.images WHERE id >= ?1 AND id <= ?2 ORDER BY id",
+                              -1, &stmt, 0);
+  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, first_imgid);
   DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    image_count = sqlite3_column_int(stmt, 0);
-    sqlite3_finalize(stmt);
-  }
-  else
+  while(sqlite3_step(stmt) == SQLITE_ROW)
   {
-    return 1;
+    const dt_imgid_t imgid = sqlite3_column_int(stmt, 0);
+    g_array_append_val(ids, imgid);
   }
+  sqlite3_finalize(stmt);
+
+  g.image_count = ids->len;
+  g.imgid = (dt_imgid_t *)g_array_free(ids, FALSE);
 
-  if(!image_count)
+  if(!g.image_count)
   {
     fprintf(stderr, _("warning: no images are matching the requested image id range\n"));
     if(min_imgid > max_imgid)
     {
       fprintf(stderr, _("warning: did you want to swap these boundaries?\n"));
     }
+    g_free(g.imgid);
+    return 0;
   }
 
-  // go through all images:
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db),
-                              "SELECT id, filename FROM main.images WHERE id >= ?1 AND id <= ?2", -1, &stmt, 0);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 1, min_imgid);
-  DT_DEBUG_SQLITE3_BIND_INT(stmt, 2, max_imgid);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    const dt_imgid_t imgid = sqlite3_column_int(stmt, 0);
-    const char *imgfilename = (const char*)sqlite3_column_text(stmt, 1);
+  g.shard_count = (g.image_count + SHARD_SIZE - 1) / SHARD_SIZE;
+  g.shard_done = g_new0(gint, g.shard_count);
 
-    counter++;
-    fprintf(stderr, "image %zu/%zu (%.02f%%) (id:%d, file=%s)\n", counter, image_count, 100.0 * counter / (float)image_count, imgid, imgfilename);
+  const int workers = MAX(1, MIN(jobs, (int)g.shard_count));
+  fprintf(stderr, _("processing %zu images with %d workers\n"), g.image_count, workers);
 
-    for(int k = max_mip; k >= min_mip && k >= 0; k--)
-    {
-      char filename[PATH_MAX] = { 0 };
-      snprintf(filename, sizeof(filename), "%s.d/%d/%d.jpg", darktable.mipmap_cache->cachedir, k, imgid);
+  // every worker generates through the usual mipmap cache path with its own pipe
+  const double start = dt_get_wtime();
+  GThread **thread = g_new(GThread *, workers);
+  for(int k = 0; k < workers; k++)
+    thread[k] = g_thread_new("generate-cache", _worker, &g);
 
-      // if a valid thumbnail file is already on disc - do nothing
-      if(dt_util_test_image_file(filename)) continue;
+  size_t first_open = 0;
+  double last_report = start;
+  while(g_atomic_int_get(&g.finished_workers) < workers)
+  {
+    g_usleep(G_USEC_PER_SEC / 4);
+    const double now = dt_get_wtime();
+    if(now - last_report < REPORT_INTERVAL) continue;
+    last_report = now;
+
+    const size_t processed = g_atomic_int_get(&g.processed);
+    const double rate = processed / (now - start);
+    fprintf(stderr, _("%zu/%zu images (%.02f%%), %.2f images/s, %.0f s remaining\n"),
+            processed, g.image_count, 100.0 * processed / (float)g.image_count, rate,
+            rate > 0.0 ? (g.image_count - processed) / rate : 0.0);
+
+    const dt_imgid_t done = _completed_imgid(&g, &first_open);
+    if(dt_is_valid_imgid(done)) _checkpoint_write(&g, done);
+  }
 
-      // else, generate thumbnail and store in mipmap cache.
-      dt_mipmap_buffer_t buf;
-      dt_mipmap_cache_get(&buf, imgid, k, DT_MIPMAP_BLOCKING, 'r');
-      dt_mipmap_cache_release(&buf);
-    }
+  for(int k = 0; k < workers; k++)
+    g_thread_join(thread[k]);
+  g_free(thread);
 
-    // and immediately write thumbs to disc and remove from mipmap cache.
-    dt_mipmap_cache_evict(imgid);
-    // thumbnail in sync with image
-    dt_history_hash_set_mipmap(imgid);
-  }
+  const double elapsed = dt_get_wtime() - start;
+  fprintf(stderr, _("done, %zu images in %.1f s (%.2f images/s)\n"),
+          g.image_count, elapsed, g.image_count / MAX(elapsed, 1e-6));
 
-  sqlite3_finalize(stmt);
-  fprintf(stderr, "done\n");
+  // the whole range is finished, a new run starts from scratch
+  char filename[PATH_MAX] = { 0 };
+  _checkpoint_filename(filename, sizeof(filename));
+  g_unlink(filename);
 
+  g_free(g.shard_done);
+  g_free(g.imgid);
   return 0;
 }
 
@@ -131,13 +283,18 @@ static void usage(const char *progname)
           "usage: %s [-h, --help; --version]\n"
           "  [--min-mip <0-8> (default = 0)] [-m, --max-mip <0-8> (default = 2)]\n"
           "  [--min-imgid <N>] [--max-imgid <N>]\n"
+          "  [-j, --jobs <N> (default = 1)] [--no-resume]\n"
           "  [--core <darktable options>]\n"
           "\n"
           "When multiple mipmap sizes are requested, the biggest one is computed\n"
           "while the rest are quickly downsampled.\n"
           "\n"
           "The --min-imgid and --max-imgid specify the range of internal image ID\n"
-          "numbers to work on.\n",
+          "numbers to work on.\n"
+          "\n"
+          "With --jobs N the images are processed by N parallel workers. Progress\n"
+          "is checkpointed, an interrupted run with the same mip and image id\n"
+          "ranges continues where it stopped unless --no-resume is given.\n",
           progname);
 }
 
@@ -163,6 +320,8 @@ int main(int argc, char *arg[])
   dt_mipmap_size_t max_mip = DT_MIPMAP_2;
   dt_imgid_t min_imgid = NO_IMGID;
   int32_t max_imgid = INT32_MAX;
+  int jobs = 1;
+  gboolean resume = TRUE;
 
   int k;
   for(k = 1; k < argc; k++)
@@ -198,6 +357,15 @@ int main(int argc, char *arg[])
       k++;
       max_imgid = (int32_t)MIN(MAX(atoi(arg[k]), 0), INT32_MAX);
     }
+    else if((!strcmp(arg[k], "-j") || !strcmp(arg[k], "--jobs")) && argc > k + 1)
+    {
+      k++;
+      jobs = MIN(MAX(atoi(arg[k]), 1), 256);
+    }
+    else if(!strcmp(arg[k], "--no-resume"))
+    {
+      resume = FALSE;
+    }
     else if(!strcmp(arg[k], "--core"))
     {
       // everything from here on should be passed to the core
@@ -251,7 +419,7 @@ int main(int argc, char *arg[])
 
   fprintf(stderr, _("creating complete lighttable thumbnail cache\n"));
 
-  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid))
+  if(generate_thumbnail_cache(min_mip, max_mip, min_imgid, max_imgid, jobs, resume))
   {
     free(m_arg);
     exit(EXIT_FAILURE);
@@ -1042,6 +1042,249 @@ static double _get_pipescale(dt_dev_pixelpipe_t *pipe,
 
 // internal function: to avoid exif blob reading + 8-bit byteorder
 // flag + high-quality override
+// an export which is ready to be encoded and written
+typedef struct dt_imageio_export_write_t
+{
+  dt_develop_t dev;
+  dt_dev_pixelpipe_t pipe;
+  dt_imgid_t imgid;
+  gchar *filename;
+  dt_imageio_module_format_t *format;
+  dt_imageio_module_data_t *format_params;
+  gboolean own_format_params;
+  dt_colorspaces_color_profile_type_t icc_type;
+  gchar *icc_filename;
+  int width, height;
+  gboolean sRGB, exif, copy_metadata, export_masks, thumbnail_export;
+  dt_export_metadata_t *metadata;
+  dt_imageio_module_storage_t *storage;
+  dt_imageio_module_data_t *storage_params;
+  int num, total;
+} dt_imageio_export_write_t;
+
+struct dt_imageio_write_stage_t
+{
+  dt_pthread_mutex_t lock;
+  pthread_cond_t cond;
+  GQueue queue;
+  int depth;       // writes allowed to wait in the queue
+  gboolean finish;
+  int failed;
+  double busy;     // time spent writing
+  double waited;   // time the producer was blocked on a full queue
+  GThread *thread;
+  dt_imageio_write_done_t done;
+  void *done_data;
+};
+
+// the stage of the export running on this thread, if any
+static __thread dt_imageio_write_stage_t *_write_stage = NULL;
+// the last export of this thread went to the stage
+static __thread gboolean _write_deferred = FALSE;
+
+// encode and write the processed image, then free everything. returns TRUE on failure.
+static gboolean _export_write(dt_imageio_export_write_t *w)
+{
+  dt_imageio_module_format_t *format = w->format;
+  dt_imageio_module_data_t *format_params = w->format_params;
+  dt_develop_t *dev = &w->dev;
+  dt_dev_pixelpipe_t *pipe = &w->pipe;
+  uint8_t *outbuf = pipe->backbuf;
+  gboolean res;
+
+  if(w->exif)
+  {
+    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes
+                                  // max, but if original size is
+                                  // close to that, adding new tags
+                                  // could make it go over that... so
+                                  // let it be and see what happens
+                                  // when we write the image
+    char pathname[PATH_MAX] = { 0 };
+    gboolean from_cache = TRUE;
+    dt_image_full_path(w->imgid, pathname, sizeof(pathname), &from_cache);
+
+    // last param is dng mode, it's false here
+    const int length = dt_exif_read_blob(&exif_profile, pathname, w->imgid, w->sRGB,
+                                         w->width, w->height, FALSE);
+
+    res = (format->write_image(format_params, w->filename, outbuf, w->icc_type,
+                              w->icc_filename, exif_profile, length, w->imgid,
+                              w->num, w->total, pipe, w->export_masks)) != 0;
+
+    free(exif_profile);
+  }
+  else
+  {
+    res = (format->write_image(format_params, w->filename, outbuf, w->icc_type,
+                              w->icc_filename, NULL, 0, w->imgid, w->num, w->total,
+                              pipe, w->export_masks)) != 0;
+  }
+
+  /* now write xmp into that container, if possible */
+  if(!res
+     && w->copy_metadata
+     && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
+  {
+    dt_exif_xmp_attach_export(w->imgid, w->filename, w->metadata, dev, pipe);
+    // no need to cancel the export if this fail
+  }
+
+  dt_dev_pixelpipe_cleanup(pipe);
+  dt_dev_cleanup(dev);
+
+  if(!res
+     && !w->thumbnail_export && strcmp(format->mime(format_params), "memory")
+     && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  {
+    dt_imgid_t imgid = w->imgid;
+#ifdef USE_LUA
+    //Synchronous calling of lua intermediate-export-image events
+    dt_lua_lock();
+
+    lua_State *L = darktable.lua_state.state;
+
+    luaA_push(L, dt_lua_image_t, &imgid);
+
+    lua_pushstring(L, w->filename);
+
+    luaA_push_type(L, format->parameter_lua_type, format_params);
+
+    if(w->storage)
+      luaA_push_type(L, w->storage->parameter_lua_type, w->storage_params);
+    else
+      lua_pushnil(L);
+
+    dt_lua_event_trigger(L, "intermediate-export-image", 4);
+
+    dt_lua_unlock();
+#endif
+
+    DT_CONTROL_SIGNAL_RAISE(DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, w->filename, format,
+                            format_params, w->storage, w->storage_params);
+  }
+
+  if(!w->thumbnail_export)
+    dt_set_backthumb_time(5.0);
+
+  if(w->own_format_params) format->free_params(format, format_params);
+  g_free(w->filename);
+  g_free(w->icc_filename);
+  free(w);
+  return res;
+}
+
+static gpointer _write_stage_run(gpointer data)
+{
+  dt_imageio_write_stage_t *stage = data;
+  dt_pthread_setname("export write");
+
+  dt_pthread_mutex_lock(&stage->lock);
+  while(!stage->finish || !g_queue_is_empty(&stage->queue))
+  {
+    dt_imageio_export_write_t *w = g_queue_pop_head(&stage->queue);
+    if(!w)
+    {
+      dt_pthread_cond_wait(&stage->cond, &stage->lock);
+      continue;
+    }
+    // make room for the next image
+    pthread_cond_broadcast(&stage->cond);
+    dt_pthread_mutex_unlock(&stage->lock);
+
+    const double start = dt_get_wtime();
+    gchar *filename = g_strdup(w->filename);
+    const dt_imgid_t imgid = w->imgid;
+    const int num = w->num;
+    const int total = w->total;
+    const gboolean failed = _export_write(w);
+    if(failed)
+    {
+      dt_print(DT_DEBUG_ALWAYS,
+               "[dt_imageio_export] could not write `%s'!", filename);
+      dt_control_log(_("could not export to file `%s'!"), filename);
+      // no need to leave broken files on disk
+      g_unlink(filename);
+    }
+    else
+    {
+      dt_print(DT_DEBUG_ALWAYS, "[export_job] exported to `%s'", filename);
+      dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
+                     num, total, filename);
+    }
+    if(stage->done)
+      stage->done(imgid, filename, num, total, failed, stage->done_data);
+    g_free(filename);
+
+    dt_pthread_mutex_lock(&stage->lock);
+    stage->busy += dt_get_wtime() - start;
+    if(failed) stage->failed++;
+  }
+  dt_pthread_mutex_unlock(&stage->lock);
+  return NULL;
+}
+
+static void _write_stage_push(dt_imageio_write_stage_t *stage,
+                              dt_imageio_export_write_t *w)
+{
+  const double start = dt_get_wtime();
+  dt_pthread_mutex_lock(&stage->lock);
+  // bounded, every queued write holds a complete pipe
+  while(g_queue_get_length(&stage->queue) >= stage->depth)
+    dt_pthread_cond_wait(&stage->cond, &stage->lock);
+  g_queue_push_tail(&stage->queue, w);
+  stage->waited += dt_get_wtime() - start;
+  pthread_cond_broadcast(&stage->cond);
+  dt_pthread_mutex_unlock(&stage->lock);
+}
+
+dt_imageio_write_stage_t *dt_imageio_write_stage_start(const int depth,
+                                                       dt_imageio_write_done_t done,
+                                                       void *data)
+{
+  if(_write_stage) return NULL; // already running on this thread
+
+  dt_imageio_write_stage_t *stage = calloc(1, sizeof(dt_imageio_write_stage_t));
+  if(!stage) return NULL;
+  dt_pthread_mutex_init(&stage->lock, NULL);
+  pthread_cond_init(&stage->cond, NULL);
+  g_queue_init(&stage->queue);
+  stage->depth = MAX(1, depth);
+  stage->done = done;
+  stage->done_data = data;
+  stage->thread = g_thread_new("export write", _write_stage_run, stage);
+  _write_stage = stage;
+  return stage;
+}
+
+gboolean dt_imageio_write_stage_deferred(void)
+{
+  return _write_deferred;
+}
+
+int dt_imageio_write_stage_finish(dt_imageio_write_stage_t *stage)
+{
+  if(!stage) return 0;
+  if(_write_stage == stage) _write_stage = NULL;
+
+  dt_pthread_mutex_lock(&stage->lock);
+  stage->finish = TRUE;
+  pthread_cond_broadcast(&stage->cond);
+  dt_pthread_mutex_unlock(&stage->lock);
+  g_thread_join(stage->thread);
+
+  // the time spent writing minus the time the pipe had to wait for it is what we gained
+  dt_print(DT_DEBUG_PERF,
+           "[dt_imageio_export] write stage busy %.3fs, pipe waited %.3fs, saved %.3fs",
+           stage->busy, stage->waited, stage->busy - stage->waited);
+
+  const int failed = stage->failed;
+  pthread_cond_destroy(&stage->cond);
+  dt_pthread_mutex_destroy(&stage->lock);
+  free(stage);
+  return failed;
+}
+
 gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
                                       const char *filename,
                                       dt_imageio_module_format_t *format,
@@ -1066,11 +1309,16 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
                                       dt_export_metadata_t *metadata,
                                       const int history_end)
 {
-  dt_develop_t dev;
-  dt_dev_init(&dev, FALSE);
-  dt_dev_load_image(&dev, imgid);
+  _write_deferred = FALSE;
+  // heap allocated, the write stage might finish this export on another thread
+  dt_imageio_export_write_t *w = calloc(1, sizeof(dt_imageio_export_write_t));
+  if(!w) return TRUE;
+  dt_develop_t *dev = &w->dev;
+  dt_dev_pixelpipe_t *pipe = &w->pipe;
+  dt_dev_init(dev, FALSE);
+  dt_dev_load_image(dev, imgid);
   if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, history_end);
+    dt_dev_pop_history_items_ext(dev, history_end);
 
   if(!thumbnail_export)
     dt_set_backthumb_time(600.0); // make sure we don't interfere
@@ -1078,7 +1326,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   dt_mipmap_buffer_t buf;
   dt_mipmap_cache_get(&buf, imgid, DT_MIPMAP_FULL, DT_MIPMAP_BLOCKING, 'r');
 
-  const dt_image_t *img = &dev.image_storage;
+  const dt_image_t *img = &dev->image_storage;
 
   if(!buf.buf || !buf.width || !buf.height)
   {
@@ -1103,10 +1351,9 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
   dt_times_t start;
   dt_get_perf_times(&start);
-  dt_dev_pixelpipe_t pipe;
   gboolean res = thumbnail_export
-    ? dt_dev_pixelpipe_init_thumbnail(&pipe, wd, ht)
-    : dt_dev_pixelpipe_init_export(&pipe, wd, ht,
+    ? dt_dev_pixelpipe_init_thumbnail(pipe, wd, ht)
+    : dt_dev_pixelpipe_init_export(pipe, wd, ht,
                                    format->levels(format_params), export_masks);
   if(!res)
   {
@@ -1117,7 +1364,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     goto error;
   }
 
-  const int final_history_end = history_end == -1 ? dev.history_end : history_end;
+  const int final_history_end = history_end == -1 ? dev->history_end : history_end;
   const gboolean use_style = !thumbnail_export && format_params->style[0] != '\0';
   const gboolean appending = format_params->style_append != FALSE;
   //  If a style is to be applied during export, add the iop params into the history
@@ -1141,9 +1388,9 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
     GList *modules_used = NULL;
 
-    if(!appending) dt_dev_pop_history_items_ext(&dev, 0);
+    if(!appending) dt_dev_pop_history_items_ext(dev, 0);
 
-    dt_ioppr_update_for_style_items(&dev, style_items, appending);
+    dt_ioppr_update_for_style_items(dev, style_items, appending);
 
     for(GList *st_items = style_items; st_items; st_items = g_list_next(st_items))
     {
@@ -1157,7 +1404,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
         // get iop for this operation as we need the corresponding
         // default parameters
         const dt_iop_module_t *module =
-          dt_iop_get_module_from_list(dev.iop, st_item->operation);
+          dt_iop_get_module_from_list(dev->iop, st_item->operation);
         if(module)
         {
           st_item->params_size = module->params_size;
@@ -1176,7 +1423,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
       if(ok)
       {
-        dt_styles_apply_style_item(&dev, st_item, &modules_used, !autoinit && appending);
+        dt_styles_apply_style_item(dev, st_item, &modules_used, !autoinit && appending);
       }
     }
 
@@ -1184,20 +1431,20 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     g_list_free_full(style_items, dt_style_item_free);
   }
   else if(history_end != -1)
-    dt_dev_pop_history_items_ext(&dev, final_history_end);
+    dt_dev_pop_history_items_ext(dev, final_history_end);
 
-  dt_ioppr_resync_modules_order(&dev);
+  dt_ioppr_resync_modules_order(dev);
 
-  dt_dev_pixelpipe_set_icc(&pipe, icc_type, icc_filename, icc_intent);
-  dt_dev_pixelpipe_set_input(&pipe, &dev, (float *)buf.buf,
+  dt_dev_pixelpipe_set_icc(pipe, icc_type, icc_filename, icc_intent);
+  dt_dev_pixelpipe_set_input(pipe, dev, (float *)buf.buf,
                              buf.width, buf.height, buf.iscale);
-  dt_dev_pixelpipe_create_nodes(&pipe, &dev);
-  dt_dev_pixelpipe_synch_all(&pipe, &dev);
+  dt_dev_pixelpipe_create_nodes(pipe, dev);
+  dt_dev_pixelpipe_synch_all(pipe, dev);
 
   if(darktable.unmuted & DT_DEBUG_IMAGEIO)
   {
     char mbuf[2048] = { 0 };
-    for(GList *nodes = pipe.nodes; nodes; nodes = g_list_next(nodes))
+    for(GList *nodes = pipe->nodes; nodes; nodes = g_list_next(nodes))
     {
       dt_dev_pixelpipe_iop_t *piece = nodes->data;
       if(piece->enabled)
@@ -1221,14 +1468,14 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   if(filter)
   {
     if(!strncmp(filter, "pre:", 4))
-      dt_dev_pixelpipe_disable_after(&pipe, filter + 4);
+      dt_dev_pixelpipe_disable_after(pipe, filter + 4);
     if(!strncmp(filter, "post:", 5))
-      dt_dev_pixelpipe_disable_before(&pipe, filter + 5);
+      dt_dev_pixelpipe_disable_before(pipe, filter + 5);
   }
 
-  dt_dev_pixelpipe_get_dimensions(&pipe, &dev, pipe.iwidth, pipe.iheight,
-                                  &pipe.processed_width,
-                                  &pipe.processed_height);
+  dt_dev_pixelpipe_get_dimensions(pipe, dev, pipe->iwidth, pipe->iheight,
+                                  &pipe->processed_width,
+                                  &pipe->processed_height);
 
   dt_show_times(&start, "[export] creating pixelpipe");
 
@@ -1238,7 +1485,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
   else if(icc_type == DT_COLORSPACE_NONE)
   {
     dt_iop_module_t *colorout = NULL;
-    for(GList *modules = dev.iop; modules; modules = g_list_next(modules))
+    for(GList *modules = dev->iop; modules; modules = g_list_next(modules))
     {
       colorout = (dt_iop_module_t *)modules->data;
       if(colorout->get_p && strcmp(colorout->op, "colorout") == 0)
@@ -1261,27 +1508,27 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
 
   if(!thumbnail_export && width == 0 && height == 0)
   {
-    width = pipe.processed_width;
-    height = pipe.processed_height;
+    width = pipe->processed_width;
+    height = pipe->processed_height;
   }
 
   // note: not perfect but a reasonable good guess looking at overall pixelpipe requirements
   // and specific stuff in finalscale.
   const double max_possible_scale = fmin(100.0, fmax(1.0, // keep maximum allowed scale as we had in 4.6
-      (double)dt_get_available_pipe_mem(&pipe) / (double)(1 + 64 * sizeof(float) * pipe.processed_width * pipe.processed_height)));
+      (double)dt_get_available_pipe_mem(pipe) / (double)(1 + 64 * sizeof(float) * pipe->processed_width * pipe->processed_height)));
 
   const gboolean doscale = upscale && ((width > 0 || height > 0) || is_scaling);
   const double max_scale = doscale ? max_possible_scale : 1.00;
 
-  double scale = _get_pipescale(&pipe, width, height, max_scale);
+  double scale = _get_pipescale(pipe, width, height, max_scale);
   float origin[2] = { 0.0f, 0.0f };
 
-  if(dt_dev_distort_backtransform_plus(&dev, &pipe, 0.0,
+  if(dt_dev_distort_backtransform_plus(dev, pipe, 0.0,
                                        DT_DEV_TRANSFORM_DIR_ALL, origin, 1))
   {
-    if(width == 0) width = pipe.processed_width;
-    if(height == 0) height = pipe.processed_height;
-    scale = _get_pipescale(&pipe, width, height, max_scale);
+    if(width == 0) width = pipe->processed_width;
+    if(height == 0) height = pipe->processed_height;
+    scale = _get_pipescale(pipe, width, height, max_scale);
 
     if(is_scaling)
     {
@@ -1292,15 +1539,15 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     }
   }
 
-  const int processed_width = floor(scale * pipe.processed_width);
-  const int processed_height = floor(scale * pipe.processed_height);
+  const int processed_width = floor(scale * pipe->processed_width);
+  const int processed_height = floor(scale * pipe->processed_height);
   const gboolean size_warning = processed_width < 1 || processed_height < 1;
   dt_print(DT_DEBUG_IMAGEIO,
            "[dt_imageio_export] %s%s imgid %d, %ix%i --> %ix%i (scale=%.4f, maxscale=%.4f)."
            " upscale=%s, hq=%s%s",
            size_warning ? "**missing size** " : "",
            thumbnail_export ? "thumbnail" : "export", imgid,
-           pipe.processed_width, pipe.processed_height,
+           pipe->processed_width, pipe->processed_height,
            processed_width, processed_height, scale, max_scale,
            upscale ? "yes" : "no",
            high_quality_processing || scale > 1.0f ? "yes" : "no",
@@ -1316,7 +1563,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
      * if high quality processing was requested, downsampling will be done
      * at the very end of the pipe (just before border and watermark)
      */
-    dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
+    dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0,
                                       processed_width, processed_height, scale);
   }
   else
@@ -1328,7 +1575,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     // find the finalscale module
     dt_dev_pixelpipe_iop_t *finalscale = NULL;
     {
-      for(const GList *nodes = g_list_last(pipe.nodes);
+      for(const GList *nodes = g_list_last(pipe->nodes);
           nodes;
           nodes = g_list_previous(nodes))
       {
@@ -1346,10 +1593,10 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     // do the processing (8-bit with special treatment, to make sure
     // we can use openmp further down):
     if(bpp == 8)
-      dt_dev_pixelpipe_process(&pipe, &dev, 0, 0,
+      dt_dev_pixelpipe_process(pipe, dev, 0, 0,
                                processed_width, processed_height, scale, DT_DEVICE_NONE);
     else
-      dt_dev_pixelpipe_process_no_gamma(&pipe, &dev, 0, 0,
+      dt_dev_pixelpipe_process_no_gamma(pipe, dev, 0, 0,
                                         processed_width, processed_height, scale);
 
     if(finalscale) finalscale->enabled = TRUE;
@@ -1359,7 +1606,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
                   ? "[dev_process_thumbnail] pixel pipeline processing"
                   : "[dev_process_export] pixel pipeline processing");
 
-  uint8_t *outbuf = pipe.backbuf;
+  uint8_t *outbuf = pipe->backbuf;
   if(outbuf == NULL)
   {
     dt_print(DT_DEBUG_IMAGEIO,
@@ -1407,7 +1654,7 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
       }
       else
       { // !display_byteorder, need to swap:
-        uint8_t *const buf8 = pipe.backbuf;
+        uint8_t *const buf8 = pipe->backbuf;
         DT_OMP_FOR()
         // just flip byte order
         for(size_t k = 0; k < (size_t)processed_width * processed_height; k++)
@@ -1460,95 +1707,65 @@ gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid,
     md_flags_set = metadata ? (metadata->flags & meta_all) == meta_all : FALSE;
   }
 
-  if(!ignore_exif && md_flags_set)
-  {
-    uint8_t *exif_profile = NULL; // Exif data should be 65536 bytes
-                                  // max, but if original size is
-                                  // close to that, adding new tags
-                                  // could make it go over that... so
-                                  // let it be and see what happens
-                                  // when we write the image
-    char pathname[PATH_MAX] = { 0 };
-    gboolean from_cache = TRUE;
-    dt_image_full_path(imgid, pathname, sizeof(pathname), &from_cache);
-
-    // last param is dng mode, it's false here
-    const int length = dt_exif_read_blob(&exif_profile, pathname, imgid, sRGB,
-                                         processed_width, processed_height, FALSE);
-
-    res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, exif_profile, length, imgid,
-                              num, total, &pipe, export_masks)) != 0;
-
-    free(exif_profile);
-  }
-  else
-  {
-    res = (format->write_image(format_params, filename, outbuf, icc_type,
-                              icc_filename, NULL, 0, imgid, num, total,
-                              &pipe, export_masks)) != 0;
-  }
-
-  if(res)
-    goto error;
-
-  /* now write xmp into that container, if possible */
-  if(copy_metadata
-     && (format->flags(format_params) & FORMAT_FLAGS_SUPPORT_XMP))
-  {
-    dt_exif_xmp_attach_export(imgid, filename, metadata, &dev, &pipe);
-    // no need to cancel the export if this fail
-  }
-
-  dt_dev_pixelpipe_cleanup(&pipe);
-  dt_dev_cleanup(&dev);
+  w->imgid = imgid;
+  w->filename = g_strdup(filename);
+  w->format = format;
+  w->format_params = format_params;
+  w->icc_type = icc_type;
+  w->icc_filename = g_strdup(icc_filename);
+  w->width = processed_width;
+  w->height = processed_height;
+  w->sRGB = sRGB;
+  w->exif = !ignore_exif && md_flags_set;
+  w->copy_metadata = copy_metadata;
+  w->export_masks = export_masks;
+  w->thumbnail_export = thumbnail_export;
+  w->metadata = metadata;
+  w->storage = storage;
+  w->storage_params = storage_params;
+  w->num = num;
+  w->total = total;
+
+  // the input isn't needed for writing, release it on the thread holding it
   dt_mipmap_cache_release(&buf);
 
-  if(!thumbnail_export && strcmp(format->mime(format_params), "memory")
-    && !(format->flags(format_params) & FORMAT_FLAGS_NO_TMPFILE))
+  // hand encoding and writing to the stage thread and go on with the next image.
+  // only for storages not touching the file after storing it and for formats
+  // whose params can be copied.
+  if(_write_stage
+     && !thumbnail_export
+     && !(format->flags(format_params) & FORMAT_FLAGS_SHARED_PARAMS)
+     && storage && storage->parallel_store && storage->parallel_store(storage))
   {
-#ifdef USE_LUA
-    //Synchronous calling of lua intermediate-export-image events
-    dt_lua_lock();
-
-    lua_State *L = darktable.lua_state.state;
-
-    luaA_push(L, dt_lua_image_t, &imgid);
-
-    lua_pushstring(L, filename);
-
-    luaA_push_type(L, format->parameter_lua_type, format_params);
-
-    if(storage)
-      luaA_push_type(L, storage->parameter_lua_type, storage_params);
-    else
-      lua_pushnil(L);
-
-    dt_lua_event_trigger(L, "intermediate-export-image", 4);
-
-    dt_lua_unlock();
-#endif
-
-    DT_CONTROL_SIGNAL_RAISE(DT_SIGNAL_IMAGE_EXPORT_TMPFILE, imgid, filename, format,
-                            format_params, storage, storage_params);
+    // the caller reuses the format params for the next image
+    dt_imageio_module_data_t *params = format->get_params(format);
+    if(params)
+    {
+      memcpy(params, format_params, format->params_size(format));
+      params->width = format_params->width;
+      params->height = format_params->height;
+      w->format_params = params;
+      w->own_format_params = TRUE;
+      _write_stage_push(_write_stage, w);
+      _write_deferred = TRUE;
+      return FALSE;
+    }
   }
 
-  if(!thumbnail_export)
-    dt_set_backthumb_time(5.0);
-  return FALSE; // success
+  return _export_write(w);
 
 error:
-  dt_dev_pixelpipe_cleanup(&pipe);
+  dt_dev_pixelpipe_cleanup(pipe);
 error_early:
-  dt_dev_cleanup(&dev);
+  dt_dev_cleanup(dev);
   dt_mipmap_cache_release(&buf);
+  free(w);
 
   if(!thumbnail_export)
     dt_set_backthumb_time(5.0);
   return TRUE;
 }
 
-
 // fallback read method in case file could not be opened yet.
 // use GraphicsMagick (if supported) to read exotic LDRs
 dt_imageio_retval_t dt_imageio_open_exotic(dt_image_t *img,
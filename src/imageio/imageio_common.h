@@ -104,6 +104,26 @@ gboolean dt_imageio_export(const dt_imgid_t imgid,
                       const int total,
                       dt_export_metadata_t *metadata);
 
+/** overlap encoding and writing of exported images with processing the next one.
+    exports of the calling thread to storages supporting parallel_store() are handed to a
+    stage thread, at most depth of them wait for it. done is called from the stage thread
+    once an image has been written or failed, a failed file is removed. */
+typedef struct dt_imageio_write_stage_t dt_imageio_write_stage_t;
+typedef void (*dt_imageio_write_done_t)(const dt_imgid_t imgid,
+                                        const char *filename,
+                                        const int num,
+                                        const int total,
+                                        const gboolean failed,
+                                        void *data);
+dt_imageio_write_stage_t *dt_imageio_write_stage_start(const int depth,
+                                                       dt_imageio_write_done_t done,
+                                                       void *data);
+/** TRUE if the last export of the calling thread was handed to its stage, it's not
+    written yet and the stage reports the result */
+gboolean dt_imageio_write_stage_deferred(void);
+/** wait for all pending writes, returns the number of failed ones */
+int dt_imageio_write_stage_finish(dt_imageio_write_stage_t *stage);
+
 gboolean dt_imageio_export_with_flags(const dt_imgid_t imgid, const char *filename,
                                  struct dt_imageio_module_format_t *format,
                                  struct dt_imageio_module_data_t *format_params,
@@ -42,7 +42,8 @@ typedef enum dt_imageio_format_flags_t
 {
   FORMAT_FLAGS_SUPPORT_XMP = 1,
   FORMAT_FLAGS_NO_TMPFILE = 2,
-  FORMAT_FLAGS_SUPPORT_LAYERS = 4
+  FORMAT_FLAGS_SUPPORT_LAYERS = 4,
+  FORMAT_FLAGS_SHARED_PARAMS = 8 // params carry state across the images of an export, never copy them
 } dt_imageio_format_flags_t;
 
 /**
@@ -129,6 +129,18 @@ uint32_t dt_rawspeed_crop_dcraw_filters(const uint32_t filters,
 // CR3 files are for now handled by LibRaw, we do not want RawSpeed to try to open them
 // as this issues a lot of error messages on the console.
 
+// instrumentation of the time spent per image, shown with -d perf
+static void _print_timing(const dt_image_t *img,
+                          const double read,
+                          const double decode,
+                          const double copy)
+{
+  dt_print(DT_DEBUG_PERF,
+           "[rawspeed] `%s' %dx%d: read %.3fs, decode %.3fs, copy to cache %.3fs (%.1f%%)",
+           img->filename, img->width, img->height, read, decode, copy,
+           100.0 * copy / fmax(read + decode + copy, 1e-6));
+}
+
 static gboolean _ignore_image(const gchar *filename)
 {
   gchar *extensions_ignorelist;
@@ -186,9 +198,11 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img,
   {
     dt_rawspeed_load_meta();
 
+    const double start = dt_get_debug_wtime();
     dt_pthread_mutex_lock(&darktable.readFile_mutex);
     auto [storage, storageBuf] = f.readFile();
     dt_pthread_mutex_unlock(&darktable.readFile_mutex);
+    const double read_done = dt_get_debug_wtime();
 
     RawParser t(storageBuf);
     std::unique_ptr<RawDecoder> d = t.getDecoder(meta);
@@ -200,6 +214,7 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img,
     d->decodeRaw();
     d->decodeMetaData(meta);
     RawImage r = d->mRaw;
+    const double decode_done = dt_get_debug_wtime();
 
     const auto errors = r->getErrors();
     for(const auto &error : errors)
@@ -317,6 +332,9 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img,
     if(!r->isCFA)
     {
       const dt_imageio_retval_t ret = dt_imageio_open_rawspeed_sraw(img, r, mbuf);
+      if(mbuf)
+        _print_timing(img, read_done - start, decode_done - read_done,
+                      dt_get_debug_wtime() - decode_done);
       return ret;
     }
 
@@ -391,29 +409,21 @@ dt_imageio_retval_t dt_imageio_open_rawspeed(dt_image_t *img,
     if(!buf) return DT_IMAGEIO_CACHE_FULL;
 
     /*
-     * since we do not want to crop black borders at this stage,
-     * and we do not want to rotate image, we can just use memcpy,
-     * as it is faster than dt_imageio_flip_buffers, but only if
-     * buffer sizes are equal,
-     * (from Klaus: r->pitch may differ from DT pitch (line to line spacing))
-     * else fallback to generic dt_imageio_flip_buffers()
+     * we do not want to crop black borders at this stage and we do not want to
+     * rotate the image, so this is a plain copy of the rows. rawspeed pads its rows
+     * to r->pitch bytes which may differ from our line to line spacing.
+     * Rows are copied in parallel as a single thread can't saturate the memory
+     * bandwidth for large sensors.
      */
-    const size_t bufSize_mipmap = (size_t)img->width * img->height * r->getBpp();
-    const size_t bufSize_rawspeed = (size_t)r->pitch * dimUncropped.y;
-    if(bufSize_mipmap == bufSize_rawspeed)
-    {
-      memcpy(buf, (char *)(&(r->getByteDataAsUncroppedArray2DRef()(0, 0))), bufSize_mipmap);
-    }
-    else
-    {
-      dt_imageio_flip_buffers((char *)buf,
-                              (char *)(&(r->getByteDataAsUncroppedArray2DRef()(0, 0))),
-                              r->getBpp(),
-                              dimUncropped.x, dimUncropped.y,
-                              dimUncropped.x, dimUncropped.y,
-                              r->pitch,
-                              ORIENTATION_NONE);
-    }
+    const size_t row_bytes = (size_t)img->width * r->getBpp();
+    const size_t pitch = r->pitch;
+    const char *const in = (const char *)(&(r->getByteDataAsUncroppedArray2DRef()(0, 0)));
+    DT_OMP_PRAGMA(parallel for schedule(static) shared(buf) firstprivate(in, row_bytes, pitch))
+    for(int j = 0; j < img->height; j++)
+      memcpy((char *)buf + j * row_bytes, in + j * pitch, row_bytes);
+
+    _print_timing(img, read_done - start, decode_done - read_done,
+                  dt_get_debug_wtime() - decode_done);
 
     //  Check if the camera is missing samples
     const Camera *cam = meta->getCamera(r->metadata.make.c_str(),
@@ -40,6 +40,7 @@
 #include "osx/osx.h"
 #endif
 #include <glib.h>
+#include <fcntl.h>
 #include <glib/gstdio.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -340,14 +341,15 @@ int store(dt_imageio_module_storage_t *self,
   char pattern[DT_MAX_PATH_FOR_PARAMS];
   g_strlcpy(pattern, d->filename, sizeof(pattern));
   dt_image_full_path(imgid, input_dir, sizeof(input_dir), NULL);
-  // set variable values to expand them afterwards in darktable variables
-  dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
-  dt_variables_set_upscale(d->vp, upscale);
 
   gboolean fail = FALSE;
+  gboolean claimed = FALSE;
   // we're potentially called in parallel. have sequence number synchronized:
   dt_pthread_mutex_lock(&darktable.plugin_threadsafe);
   {
+    // set variable values to expand them afterwards in darktable variables
+    dt_variables_set_max_width_height(d->vp, fdata->max_width, fdata->max_height);
+    dt_variables_set_upscale(d->vp, upscale);
 try_again:
     // avoid braindead export which is bound to overwrite at random:
     if(total > 1 && !g_strrstr(pattern, "$"))
@@ -430,6 +432,15 @@ try_again:
         snprintf(c, filename_free_space, "_%.2d.%s", seq, ext);
         seq++;
       }
+
+      // claim the name before leaving the critical block, another image
+      // exported in parallel must not end up with the same one
+      const int fd = g_open(filename, O_WRONLY | O_CREAT | O_EXCL, 0644);
+      if(fd >= 0)
+      {
+        g_close(fd, NULL);
+        claimed = TRUE;
+      }
     }
 
     // conflict handling option: skip
@@ -511,15 +522,25 @@ try_again:
              "[imageio_storage_disk] could not export to file: `%s'!",
              filename);
     dt_control_log(_("could not export to file `%s'!"), filename);
+    if(claimed) g_unlink(filename);
     return 1;
   }
 
+  // the write stage reports the result once the file is written
+  if(dt_imageio_write_stage_deferred()) return 0;
+
   dt_print(DT_DEBUG_ALWAYS, "[export_job] exported to `%s'", filename);
   dt_control_log(ngettext("%d/%d exported to `%s'", "%d/%d exported to `%s'", num),
                  num, total, filename);
   return 0;
 }
 
+gboolean parallel_store(dt_imageio_module_storage_t *self)
+{
+  // file names are generated under a lock, everything else is per image
+  return TRUE;
+}
+
 size_t params_size(dt_imageio_module_storage_t *self)
 {
   return sizeof(dt_imageio_disk_t) - sizeof(void *);
@@ -97,6 +97,11 @@ OPTIONAL(gboolean, export_enabled, struct dt_imageio_module_storage_t *self);
 /* for storage modules which require a login */
 OPTIONAL(gboolean, storage_login, struct dt_imageio_module_storage_t *self);
 
+/* store() may be called for several images of the same export concurrently and
+   doesn't access the exported file after dt_imageio_export() returned, so encoding
+   and writing may be deferred to a stage thread */
+OPTIONAL(gboolean, parallel_store, struct dt_imageio_module_storage_t *self);
+
 #ifdef FULL_API_H
 
 #pragma GCC visibility pop
@@ -1073,6 +1073,48 @@ gboolean distort_backtransform(dt_iop_module_t *self,
   return TRUE;
 }
 
+gboolean distort_roi_backtransform(dt_iop_module_t *self,
+                                   dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_roi_t *const roi_out,
+                                   float *const restrict points,
+                                   const size_t points_count)
+{
+  const dt_iop_ashift_data_t *const data = piece->data;
+
+  // process() copies the buffer for neutral parameters
+  if(_isneutral(data)) return TRUE;
+
+  float DT_ALIGNED_ARRAY ihomograph[3][3];
+  _homography((float *)ihomograph, data->rotation, data->lensshift_v, data->lensshift_h,
+              data->shear, data->f_length_kb,
+              data->orthocorr, data->aspect,
+              piece->buf_in.width, piece->buf_in.height, ASHIFT_HOMOGRAPH_INVERTED);
+
+  // clipping offset
+  const float fullwidth = (float)piece->buf_out.width / (data->cr - data->cl);
+  const float fullheight = (float)piece->buf_out.height / (data->cb - data->ct);
+  const float cx = roi_out->scale * fullwidth * data->cl;
+  const float cy = roi_out->scale * fullheight * data->ct;
+
+  float *const pts = DT_IS_ALIGNED(points);
+
+  DT_OMP_FOR(if(points_count > 100) shared(ihomograph))
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    // same coordinate chain as process()
+    const float DT_ALIGNED_PIXEL pout[3] = { (roi_out->x + pts[i] + cx) / roi_out->scale,
+                                             (roi_out->y + pts[i + 1] + cy) / roi_out->scale,
+                                             1.0f };
+    float DT_ALIGNED_PIXEL pin[3];
+    mat3mulv(pin, (float *)ihomograph, pout);
+    pts[i] = pin[0] / pin[2] * roi_in->scale - roi_in->x;
+    pts[i + 1] = pin[1] / pin[2] * roi_in->scale - roi_in->y;
+  }
+
+  return TRUE;
+}
+
 void distort_mask(dt_iop_module_t *self,
                   dt_dev_pixelpipe_iop_t *piece,
                   const float *const in,
@@ -609,6 +609,65 @@ gboolean distort_backtransform(dt_iop_module_t *self,
   return TRUE;
 }
 
+gboolean distort_roi_backtransform(dt_iop_module_t *self,
+                                   dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_roi_t *const roi_out,
+                                   float *const restrict points,
+                                   size_t points_count)
+{
+  const dt_iop_clipping_data_t *d = piece->data;
+
+  // the only crop path of process() copies the buffer
+  if(!d->flags && d->angle == 0.0 && d->all_off && roi_in->width == roi_out->width
+     && roi_in->height == roi_out->height)
+    return TRUE;
+
+  const float rx = piece->buf_in.width * roi_in->scale;
+  const float ry = piece->buf_in.height * roi_in->scale;
+  const dt_boundingbox_t k_space =
+    { d->k_space[0] * rx, d->k_space[1] * ry, d->k_space[2] * rx, d->k_space[3] * ry };
+  const float kxa = d->kxa * rx, kxb = d->kxb * rx, kxc = d->kxc * rx, kxd = d->kxd * rx;
+  const float kya = d->kya * ry, kyb = d->kyb * ry, kyc = d->kyc * ry, kyd = d->kyd * ry;
+  float ma, mb, md, me, mg, mh;
+  if(d->k_apply == 1)
+    keystone_get_matrix(k_space, kxa, kxb, kxc, kxd, kya, kyb, kyc, kyd, &ma, &mb, &md, &me, &mg, &mh);
+
+  // same coordinate chain as process()
+  DT_OMP_FOR(if(points_count > 100) dt_omp_sharedconst(k_space))
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    float pi[2], po[2];
+
+    pi[0] = roi_out->x - roi_out->scale * d->enlarge_x + roi_out->scale * d->cix + points[i] + 0.5f;
+    pi[1] = roi_out->y - roi_out->scale * d->enlarge_y + roi_out->scale * d->ciy + points[i + 1] + 0.5f;
+
+    if(d->flip)
+    {
+      pi[1] -= d->tx * roi_out->scale;
+      pi[0] -= d->ty * roi_out->scale;
+    }
+    else
+    {
+      pi[0] -= d->tx * roi_out->scale;
+      pi[1] -= d->ty * roi_out->scale;
+    }
+    pi[0] /= roi_out->scale;
+    pi[1] /= roi_out->scale;
+    backtransform(pi, po, d->m, d->k_h, d->k_v);
+    po[0] *= roi_in->scale;
+    po[1] *= roi_in->scale;
+    po[0] += d->tx * roi_in->scale;
+    po[1] += d->ty * roi_in->scale;
+    if(d->k_apply == 1) keystone_backtransform(po, k_space, ma, mb, md, me, mg, mh, kxa, kya);
+
+    points[i] = po[0] - (roi_in->x + 0.5f);
+    points[i + 1] = po[1] - (roi_in->y + 0.5f);
+  }
+
+  return TRUE;
+}
+
 void distort_mask(dt_iop_module_t *self,
                   dt_dev_pixelpipe_iop_t *piece,
                   const float *const in,
@@ -43,8 +43,23 @@
 #define DT_IOP_COLOR_ICC_LEN 512
 #define LUT_SAMPLES 0x10000
 
+// baked transforms for profiles we can't handle as matrix: lattice points per Lab axis,
+// accepted deviation from lcms2 in output units and number of unused tables kept around
+#define CLUT_LEVEL 65
+#define CLUT_MAX_ERROR 0.002f
+#define CLUT_CACHED 4
+
 DT_MODULE_INTROSPECTION(5, dt_iop_colorout_params_t)
 
+// lcms2 transform sampled on a regular Lab lattice, shared between pipes
+typedef struct dt_iop_colorout_clut_t
+{
+  dt_hash_t hash;    // output profile, intent and transform flags
+  int users;
+  float max_error;   // measured against lcms2 between the lattice points
+  float *table;      // CLUT_LEVEL^3 RGBA nodes, L varies fastest
+} dt_iop_colorout_clut_t;
+
 typedef struct dt_iop_colorout_data_t
 {
   dt_colorspaces_color_profile_type_t type;
@@ -52,12 +67,15 @@ typedef struct dt_iop_colorout_data_t
   float lut[3][LUT_SAMPLES];
   dt_colormatrix_t cmatrix;
   cmsHTRANSFORM *xform;
+  dt_iop_colorout_clut_t *clut; // replaces xform in process() if set
   float unbounded_coeffs[3][3]; // for extrapolation of shaper curves
 } dt_iop_colorout_data_t;
 
 typedef struct dt_iop_colorout_global_data_t
 {
   int kernel_colorout;
+  dt_pthread_mutex_t clut_lock;
+  GList *cluts; // most recently used first
 } dt_iop_colorout_global_data_t;
 
 typedef struct dt_iop_colorout_params_t
@@ -231,12 +249,23 @@ void init_global(dt_iop_module_so_t *self)
   dt_iop_colorout_global_data_t *gd = malloc(sizeof(dt_iop_colorout_global_data_t));
   self->data = gd;
   gd->kernel_colorout = dt_opencl_create_kernel(program, "colorout");
+  dt_pthread_mutex_init(&gd->clut_lock, NULL);
+  gd->cluts = NULL;
+}
+
+static void _clut_free(gpointer data)
+{
+  dt_iop_colorout_clut_t *clut = data;
+  dt_free_align(clut->table);
+  free(clut);
 }
 
 void cleanup_global(dt_iop_module_so_t *self)
 {
   dt_iop_colorout_global_data_t *gd = self->data;
   dt_opencl_free_kernel(gd->kernel_colorout);
+  g_list_free_full(gd->cluts, _clut_free);
+  dt_pthread_mutex_destroy(&gd->clut_lock);
   free(self->data);
   self->data = NULL;
 }
@@ -520,6 +549,260 @@ static void _transform_lcms(const dt_iop_colorout_data_t *const d,
   dt_omploop_sfence();
 }
 
+/* tetrahedral interpolation in the baked Lab lattice, see _correct_pixel_tetrahedral()
+   in lut3d.c. nodes are 4 floats wide to keep the channel loops vectorized. */
+static inline void _clut_interpolate(const float *const restrict clut,
+                                     const float *const restrict Lab,
+                                     dt_aligned_pixel_t out)
+{
+  const size_t level = CLUT_LEVEL;
+  const float flevel_1 = (float)(level - 1);
+
+  dt_aligned_pixel_t d = { CLIP(Lab[0] * (1.0f / 100.0f)) * flevel_1,
+                           CLIP((Lab[1] + 128.0f) * (1.0f / 256.0f)) * flevel_1,
+                           CLIP((Lab[2] + 128.0f) * (1.0f / 256.0f)) * flevel_1,
+                           0.0f };
+  int i[3];
+  for(int c = 0; c < 3; c++)
+  {
+    i[c] = CLAMP((int)d[c], 0, (int)level - 2);
+    d[c] -= i[c];
+  }
+
+  const size_t i000 = 4 * (i[0] + i[1] * level + i[2] * level * level);
+  const size_t i100 = i000 + 4;
+  const size_t i010 = i000 + 4 * level;
+  const size_t i110 = i010 + 4;
+  const size_t i001 = i000 + 4 * level * level;
+  const size_t i101 = i001 + 4;
+  const size_t i011 = i001 + 4 * level;
+  const size_t i111 = i011 + 4;
+
+  // pick the tetrahedron by the order of the fractional parts
+  size_t p1, p2;
+  float w0, w1, w2, w3;
+  if(d[0] > d[1])
+  {
+    if(d[1] > d[2])
+    { p1 = i100; p2 = i110; w0 = 1.0f - d[0]; w1 = d[0] - d[1]; w2 = d[1] - d[2]; w3 = d[2]; }
+    else if(d[0] > d[2])
+    { p1 = i100; p2 = i101; w0 = 1.0f - d[0]; w1 = d[0] - d[2]; w2 = d[2] - d[1]; w3 = d[1]; }
+    else
+    { p1 = i001; p2 = i101; w0 = 1.0f - d[2]; w1 = d[2] - d[0]; w2 = d[0] - d[1]; w3 = d[1]; }
+  }
+  else
+  {
+    if(d[2] > d[1])
+    { p1 = i001; p2 = i011; w0 = 1.0f - d[2]; w1 = d[2] - d[1]; w2 = d[1] - d[0]; w3 = d[0]; }
+    else if(d[2] > d[0])
+    { p1 = i010; p2 = i011; w0 = 1.0f - d[1]; w1 = d[1] - d[2]; w2 = d[2] - d[0]; w3 = d[0]; }
+    else
+    { p1 = i010; p2 = i110; w0 = 1.0f - d[1]; w1 = d[1] - d[0]; w2 = d[0] - d[2]; w3 = d[2]; }
+  }
+
+  for_four_channels(c, aligned(clut, out))
+    out[c] = w0 * clut[i000 + c] + w1 * clut[p1 + c] + w2 * clut[p2 + c] + w3 * clut[i111 + c];
+}
+
+static void _transform_clut(const dt_iop_colorout_data_t *const d,
+                            float *restrict out,
+                            const float *restrict in,
+                            const size_t npixels)
+{
+  const float *const restrict clut = d->clut->table;
+  DT_OMP_FOR()
+  for(size_t k = 0; k < npixels; k++)
+  {
+    dt_aligned_pixel_t rgb;
+    _clut_interpolate(clut, in + 4*k, rgb);
+    copy_pixel_nontemporal(out + 4*k, rgb);
+  }
+  dt_omploop_sfence();
+}
+
+static void _clut_transform_lcms(cmsHTRANSFORM xform,
+                                 float *const restrict out,
+                                 const float *const restrict in,
+                                 const size_t npixels)
+{
+  const size_t chunksize = dt_cacheline_chunks(npixels, dt_get_num_threads());
+  DT_OMP_FOR()
+  for(size_t chunkstart = 0; chunkstart < npixels; chunkstart += chunksize)
+  {
+    const size_t count = MIN(chunkstart + chunksize, npixels) - chunkstart;
+    cmsDoTransform(xform, in + 4 * chunkstart, out + 4 * chunkstart, count);
+  }
+}
+
+/* sample the transform on the lattice, then compare the interpolation to lcms2 in the
+   centers of a subset of the cells (where tetrahedral interpolation errs most) and beyond the
+   lattice range, where lcms2 might extrapolate while we clamp. */
+static dt_iop_colorout_clut_t *_clut_bake(cmsHTRANSFORM xform, const dt_hash_t hash)
+{
+  const size_t level = CLUT_LEVEL;
+  const size_t nodes = level * level * level;
+  const size_t stride = 4; // test every 4th cell per axis
+  const size_t ncells = (level - 1 + stride - 1) / stride;
+  const size_t nover = 64;
+  const size_t ntests = ncells * ncells * ncells + nover;
+
+  dt_iop_colorout_clut_t *clut = calloc(1, sizeof(dt_iop_colorout_clut_t));
+  float *Lab = dt_alloc_align_float(4 * MAX(nodes, ntests));
+  float *ref = dt_alloc_align_float(4 * ntests);
+  if(clut) clut->table = dt_alloc_align_float(4 * nodes);
+  if(!clut || !clut->table || !Lab || !ref)
+  {
+    if(clut) dt_free_align(clut->table);
+    free(clut);
+    dt_free_align(Lab);
+    dt_free_align(ref);
+    return NULL;
+  }
+  clut->hash = hash;
+
+  const float step = 1.0f / (level - 1);
+  DT_OMP_FOR()
+  for(size_t k = 0; k < nodes; k++)
+  {
+    const size_t L = k % level;
+    const size_t a = (k / level) % level;
+    const size_t b = k / (level * level);
+    Lab[4*k + 0] = 100.0f * L * step;
+    Lab[4*k + 1] = 256.0f * a * step - 128.0f;
+    Lab[4*k + 2] = 256.0f * b * step - 128.0f;
+    Lab[4*k + 3] = 0.0f;
+  }
+  _clut_transform_lcms(xform, clut->table, Lab, nodes);
+  for(size_t k = 0; k < nodes; k++) clut->table[4*k + 3] = 0.0f;
+
+  size_t t = 0;
+  for(size_t b = 0; b < ncells; b++)
+    for(size_t a = 0; a < ncells; a++)
+      for(size_t L = 0; L < ncells; L++, t++)
+      {
+        Lab[4*t + 0] = 100.0f * (L * stride + 0.5f) * step;
+        Lab[4*t + 1] = 256.0f * (a * stride + 0.5f) * step - 128.0f;
+        Lab[4*t + 2] = 256.0f * (b * stride + 0.5f) * step - 128.0f;
+        Lab[4*t + 3] = 0.0f;
+      }
+  for(size_t k = 0; k < nover; k++, t++)
+  {
+    // highlights above L=100 along the neutral axis and saturated colors beyond a,b=128
+    Lab[4*t + 0] = k & 1 ? 100.0f + 50.0f * k / nover : 50.0f;
+    Lab[4*t + 1] = k & 1 ? 0.0f : (k & 2 ? -1.0f : 1.0f) * (128.0f + k);
+    Lab[4*t + 2] = k & 1 ? 0.0f : (k & 4 ? -1.0f : 1.0f) * (128.0f + k);
+    Lab[4*t + 3] = 0.0f;
+  }
+  _clut_transform_lcms(xform, ref, Lab, ntests);
+
+  float max_error = 0.0f;
+  DT_OMP_FOR(reduction(max : max_error))
+  for(size_t k = 0; k < ntests; k++)
+  {
+    dt_aligned_pixel_t rgb;
+    _clut_interpolate(clut->table, Lab + 4*k, rgb);
+    for(int c = 0; c < 3; c++)
+      if(dt_isfinite(ref[4*k + c]))
+        max_error = fmaxf(max_error, fabsf(rgb[c] - ref[4*k + c]));
+  }
+  clut->max_error = max_error;
+
+  dt_free_align(Lab);
+  dt_free_align(ref);
+  return clut;
+}
+
+/* get a baked table for the transform from the cache or bake it, NULL if the table
+   would not be accurate enough */
+static dt_iop_colorout_clut_t *_clut_acquire(dt_iop_colorout_global_data_t *gd,
+                                             cmsHTRANSFORM xform,
+                                             const dt_hash_t hash)
+{
+  dt_iop_colorout_clut_t *clut = NULL;
+
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  for(GList *l = gd->cluts; l; l = g_list_next(l))
+  {
+    dt_iop_colorout_clut_t *c = l->data;
+    if(c->hash == hash)
+    {
+      gd->cluts = g_list_delete_link(gd->cluts, l);
+      clut = c;
+      break;
+    }
+  }
+
+  if(!clut)
+  {
+    const double start = dt_get_debug_wtime();
+    clut = _clut_bake(xform, hash);
+    if(clut)
+      dt_print(DT_DEBUG_PERF,
+               "[colorout] baked transform into %dx%dx%d lattice in %.3fs, max error %.5f%s",
+               CLUT_LEVEL, CLUT_LEVEL, CLUT_LEVEL, dt_get_debug_wtime() - start, clut->max_error,
+               clut->max_error > CLUT_MAX_ERROR ? ", using lcms2" : "");
+  }
+
+  if(clut)
+  {
+    // inaccurate tables stay cached so we don't bake them again
+    gd->cluts = g_list_prepend(gd->cluts, clut);
+    if(clut->max_error <= CLUT_MAX_ERROR)
+      clut->users++;
+    else
+      clut = NULL;
+  }
+
+  // drop unused tables beyond the cache size
+  int cached = 0;
+  for(GList *l = gd->cluts; l;)
+  {
+    GList *next = g_list_next(l);
+    dt_iop_colorout_clut_t *c = l->data;
+    if(c->users == 0 && ++cached > CLUT_CACHED)
+    {
+      _clut_free(c);
+      gd->cluts = g_list_delete_link(gd->cluts, l);
+    }
+    l = next;
+  }
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+
+  return clut;
+}
+
+static void _clut_release(dt_iop_colorout_global_data_t *gd,
+                          dt_iop_colorout_data_t *d)
+{
+  if(!d->clut) return;
+  dt_pthread_mutex_lock(&gd->clut_lock);
+  d->clut->users--;
+  dt_pthread_mutex_unlock(&gd->clut_lock);
+  d->clut = NULL;
+}
+
+static dt_hash_t _clut_hash(cmsHPROFILE output,
+                            const dt_iop_color_intent_t intent,
+                            const cmsUInt32Number format,
+                            const uint32_t flags)
+{
+  cmsUInt32Number size = 0;
+  if(!cmsSaveProfileToMem(output, NULL, &size) || size == 0)
+    return DT_INVALID_HASH;
+
+  void *data = g_malloc(size);
+  dt_hash_t hash = DT_INVALID_HASH;
+  if(cmsSaveProfileToMem(output, data, &size))
+  {
+    hash = dt_hash(DT_INITHASH, data, size);
+    hash = dt_hash(hash, &intent, sizeof(intent));
+    hash = dt_hash(hash, &format, sizeof(format));
+    hash = dt_hash(hash, &flags, sizeof(flags));
+  }
+  g_free(data);
+  return hash;
+}
+
 void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *const ivoid,
              void *const ovoid, const dt_iop_roi_t *const roi_in, const dt_iop_roi_t *const roi_out)
 {
@@ -541,6 +824,10 @@ void process(dt_iop_module_t *self, dt_dev_pixelpipe_iop_t *piece, const void *c
     if(!_transform_cmatrix(d, out, (float*)ivoid, npixels))
       process_fastpath_apply_tonecurves(self, piece, ovoid, roi_out);
   }
+  else if(d->clut)
+  {
+    _transform_clut(d, out, (float*)ivoid, npixels);
+  }
   else
   {
     _transform_lcms(d, out, (float*)ivoid, npixels);
@@ -574,6 +861,7 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  _clut_release(self->global_data, d);
   dt_mark_colormatrix_invalid(&d->cmatrix[0][0]);
   d->lut[0][0] = -1.0f;
   d->lut[1][0] = -1.0f;
@@ -730,9 +1018,18 @@ void commit_params(dt_iop_module_t *self, dt_iop_params_t *p1, dt_dev_pixelpipe_
     }
   }
 
+  // profile data might change once we release the lock
+  const dt_hash_t clut_hash = d->xform && d->mode == DT_PROFILE_NORMAL && !force_lcms2
+    ? _clut_hash(output, out_intent, output_format, transformFlags)
+    : DT_INVALID_HASH;
+
   if(out_type == DT_COLORSPACE_DISPLAY || out_type == DT_COLORSPACE_DISPLAY2)
     pthread_rwlock_unlock(&darktable.color_profiles->xprofile_lock);
 
+  // lcms2 float transforms of non-matrix profiles are slow, bake them into a lattice
+  if(clut_hash != DT_INVALID_HASH)
+    d->clut = _clut_acquire(self->global_data, d->xform, clut_hash);
+
   // now try to initialize unbounded mode:
   // we do extrapolation for input values above 1.0f.
   // unfortunately we can only do this if we got the computation
@@ -764,6 +1061,7 @@ void init_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe
   piece->data = calloc(1, sizeof(dt_iop_colorout_data_t));
   dt_iop_colorout_data_t *d = piece->data;
   d->xform = NULL;
+  d->clut = NULL;
 }
 
 void cleanup_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
@@ -774,6 +1072,7 @@ void cleanup_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelp
     cmsDeleteTransform(d->xform);
     d->xform = NULL;
   }
+  _clut_release(self->global_data, d);
 
   free(piece->data);
   piece->data = NULL;
@@ -491,6 +491,32 @@ gboolean distort_backtransform(dt_iop_module_t *self,
   return TRUE;
 }
 
+gboolean distort_roi_backtransform(dt_iop_module_t *self,
+                                   dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_roi_t *const roi_out,
+                                   float *const restrict points,
+                                   size_t points_count)
+{
+  // follow dt_iop_copy_image_roi(), equally sized buffers are copied as a whole
+  if(roi_in->width == roi_out->width && roi_in->height == roi_out->height)
+    return TRUE;
+
+  const float dx = roi_out->x - roi_in->x;
+  const float dy = roi_out->y - roi_in->y;
+
+  float *const pts = DT_IS_ALIGNED(points);
+
+  DT_OMP_FOR(if(points_count > 100))
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    pts[i] += dx;
+    pts[i + 1] += dy;
+  }
+
+  return TRUE;
+}
+
 void distort_mask(dt_iop_module_t *self,
                   dt_dev_pixelpipe_iop_t *piece,
                   const float *const in,
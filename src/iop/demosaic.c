@@ -57,6 +57,9 @@ DT_MODULE_INTROSPECTION(6, dt_iop_demosaic_params_t)
 #define DT_RCD_TILESIZE 112
 #define DT_LMMSE_TILESIZE 136
 
+// exports below this scale use the binned demosaic
+#define DEMOSAIC_BINNED_EXPORT_SCALE (1.0f / 3.0f)
+
 typedef enum dt_iop_demosaic_method_t
 {
   // methods for Bayer images
@@ -267,6 +270,11 @@ typedef struct dt_iop_demosaic_data_t
   int cs_iter;
   float cs_center;
   gboolean cs_enabled;
+  // whole demosaiced image kept for the darkroom pipe, see _keep_full_image()
+  gboolean keep_full;
+  size_t keep_limit;
+  float *kept;
+  dt_hash_t kept_hash;
 } dt_iop_demosaic_data_t;
 
 static gboolean _get_thumb_quality(const int width, const int height)
@@ -280,9 +288,11 @@ static gboolean _get_thumb_quality(const int width, const int height)
 }
 
 // can we avoid full demosaicing and use a fast interpolator instead?
+// binned tells whether the caller has the binned demosaic, only the cpu path does.
 static gboolean _demosaic_full(const dt_dev_pixelpipe_iop_t *const piece,
                                const dt_image_t *const img,
-                               const dt_iop_roi_t *const roi_out)
+                               const dt_iop_roi_t *const roi_out,
+                               const gboolean binned)
 {
   if((img->flags & DT_IMAGE_4BAYER)   // half_size_f doesn't support 4bayer images
       || dt_image_is_mono_sraw(img)
@@ -295,9 +305,46 @@ static gboolean _demosaic_full(const dt_dev_pixelpipe_iop_t *const piece,
   if(piece->pipe->type & DT_DEV_PIXELPIPE_PREVIEW)
     return roi_out->scale > (piece->pipe->dsc.filters == 9u ? 0.667f : 0.5f);
 
+  // small exports get the binned demosaic, closer to full size the
+  // demosaicers keep more detail than resampling can show. the half and
+  // third size zoom of the opencl path is no match for either.
+  if(binned && (piece->pipe->type & DT_DEV_PIXELPIPE_EXPORT))
+    return roi_out->scale > DEMOSAIC_BINNED_EXPORT_SCALE;
+
   return TRUE;
 }
 
+// The slow X-Trans demosaicers can keep the whole image in the darkroom pipe so
+// zooming and panning only crops from it instead of demosaicing the new region
+static gboolean _keep_full_image(const dt_dev_pixelpipe_iop_t *const piece)
+{
+  const dt_iop_demosaic_data_t *d = piece->data;
+  const int method = d->demosaicing_method & ~DT_DEMOSAIC_DUAL;
+  return d->keep_full
+    && (piece->pipe->type & DT_DEV_PIXELPIPE_FULL)
+    && piece->pipe->dsc.filters == 9u
+    && !piece->pipe->want_detail_mask
+    && (method == DT_IOP_DEMOSAIC_MARKESTEIJN
+        || method == DT_IOP_DEMOSAIC_MARKESTEIJN_3
+        || method == DT_IOP_DEMOSAIC_FDC)
+    && (size_t)piece->buf_in.width * piece->buf_in.height * 4 * sizeof(float) <= d->keep_limit;
+}
+
+// The kept image is the whole input, unlike a demosaiced region the output roi is
+// positioned within it so its offsets have to be taken into account
+static void _kept_to_output(float *const out,
+                            const float *const kept,
+                            const dt_iop_roi_t *const roi_out,
+                            const dt_iop_roi_t *const roi_in)
+{
+  if(roi_out->x == 0 && roi_out->y == 0
+     && roi_out->width == roi_in->width && roi_out->height == roi_in->height
+     && feqf(roi_in->scale, roi_out->scale, 1e-8f))
+    dt_iop_image_copy_by_size(out, kept, roi_in->width, roi_in->height, 4);
+  else
+    dt_iop_clip_and_zoom(out, kept, roi_out, roi_in);
+}
+
 // Implemented in demosaicing/amaze.cc
 void amaze_demosaic(const float *const in,
                     float *out,
@@ -310,6 +357,7 @@ void amaze_demosaic(const float *const in,
 #include "iop/demosaicing/vng.c"
 #include "iop/demosaicing/xtrans.c"
 #include "iop/demosaicing/passthrough.c"
+#include "iop/demosaicing/binned.c"
 #include "iop/demosaicing/ppg.c"
 #include "iop/demosaicing/rcd.c"
 #include "iop/demosaicing/lmmse.c"
@@ -527,6 +575,16 @@ void modify_roi_in(dt_iop_module_t *self,
                    dt_iop_roi_t *roi_in)
 {
   *roi_in = *roi_out;
+  if(_keep_full_image(piece))
+  {
+    // the full input stays the same while zooming and panning so upstream cachelines stay valid
+    roi_in->x = roi_in->y = 0;
+    roi_in->width = piece->buf_in.width;
+    roi_in->height = piece->buf_in.height;
+    roi_in->scale = 1.0f;
+    return;
+  }
+
   // always set position to closest top/left sensor pattern snap
   const uint32_t filters = piece->pipe->dsc.filters;
   roi_in->x = MAX(0, _snap_to_cfa(roi_in->x / roi_out->scale, filters));
@@ -670,11 +728,11 @@ void process(dt_iop_module_t *self,
   }
 
   const uint8_t(*const xtrans)[6] = xtrans_new;
-  const dt_iop_demosaic_data_t *d = piece->data;
+  dt_iop_demosaic_data_t *d = piece->data;
   const dt_iop_demosaic_gui_data_t *g = self->gui_data;
   const uint32_t filters = dt_rawspeed_crop_dcraw_filters(pipe->dsc.filters, roi_in->x, roi_in->y);
 
-  const gboolean fullscale = _demosaic_full(piece, img, roi_out);
+  const gboolean fullscale = _demosaic_full(piece, img, roi_out, TRUE);
   const gboolean is_xtrans = filters == 9u;
   const gboolean is_4bayer = img->flags & DT_IMAGE_4BAYER;
   const gboolean is_bayer = !is_4bayer && !is_xtrans && filters != 0;
@@ -715,8 +773,21 @@ void process(dt_iop_module_t *self,
   if(!fullscale)
   {
     dt_print_pipe(DT_DEBUG_PIPE, "demosaic approx zoom", pipe, self, DT_DEVICE_CPU, roi_in, roi_out);
+    const int factor = _binned_factor(roi_out->scale);
+    float *binned = NULL;
     if(method == DT_IOP_DEMOSAIC_PASSTHROUGH_MONOCHROME || method == DT_IOP_DEMOSAIC_PASSTHROUGH_COLOR)
       dt_iop_clip_and_zoom_demosaic_passthrough_monochrome_f((float *)o, in, roi_out, roi_in, roi_out->width, width);
+    else if(factor > 1 && (binned = dt_iop_image_alloc(width / factor, height / factor, 4)))
+    {
+      // bin to 1/factor and resample the remaining way from there
+      dt_iop_roi_t roi_binned = *roi_in;
+      roi_binned.width = width / factor;
+      roi_binned.height = height / factor;
+      roi_binned.scale = roi_in->scale / factor;
+      demosaic_binned(binned, in, width, height, filters, xtrans, factor);
+      dt_iop_clip_and_zoom_roi((float *)o, binned, roi_out, &roi_binned);
+      dt_free_align(binned);
+    }
     else if(is_xtrans)
       dt_iop_clip_and_zoom_demosaic_third_size_xtrans_f((float *)o, in, roi_out, roi_in, roi_out->width, width, xtrans);
     else
@@ -734,6 +805,24 @@ void process(dt_iop_module_t *self,
   const gboolean do_capture = !passthru &&  !is_4bayer && !show_dual && !run_fast && d->cs_enabled;
   const gboolean greens = is_bayer && d->green_eq != DT_IOP_GREEN_EQ_NO && no_masking && !run_fast && !true_monochrome;
 
+  const gboolean keep = _keep_full_image(piece) && no_masking && !run_fast
+                        && roi_in->x == 0 && roi_in->y == 0
+                        && width == piece->buf_in.width && height == piece->buf_in.height;
+  const dt_hash_t keep_hash = keep ? dt_dev_pixelpipe_piece_hash(piece, roi_in, TRUE) : DT_INVALID_HASH;
+  if(keep && d->kept && d->kept_hash == keep_hash)
+  {
+    dt_print_pipe(DT_DEBUG_PIPE, "demosaic kept image", pipe, self, DT_DEVICE_CPU, roi_in, roi_out);
+    _kept_to_output((float *)o, d->kept, roi_out, roi_in);
+    return;
+  }
+  if(keep)
+  {
+    dt_free_align(d->kept);
+    d->kept = NULL;
+  }
+  // the output is kept for the next run so it can't be the pipe buffer
+  const gboolean own_out = !direct || keep;
+
   const float procmax = dt_iop_get_processed_maximum(piece);
   const float procmin = dt_iop_get_processed_minimum(piece);
   const int exif_iso = img->exif_iso;
@@ -775,7 +864,7 @@ void process(dt_iop_module_t *self,
       bad_tiling ? ", high memory" : "",
       num_tiles, tile_height, overlap);
 
-  float *out = direct ? (float *)o : dt_iop_image_alloc(width, height, 4);
+  float *out = own_out ? dt_iop_image_alloc(width, height, 4) : (float *)o;
   if(!out)
   {
     dt_print(DT_DEBUG_ALWAYS, "can't create output buffer for demosaic");
@@ -824,7 +913,7 @@ void process(dt_iop_module_t *self,
   if(!t_out)
   {
     dt_free_align(green_in);
-    if(!direct) dt_free_align(out);
+    if(own_out) dt_free_align(out);
     dt_print(DT_DEBUG_ALWAYS, "can't create output buffer for demosaic");
     dt_control_log(_("can't allocate demosaic buffer"));
     return;
@@ -907,11 +996,18 @@ void process(dt_iop_module_t *self,
   if(d->color_smoothing != DT_DEMOSAIC_SMOOTH_OFF && no_masking && !run_fast)
     color_smoothing(out, width, height, d->color_smoothing);
 
-  if(!direct)
-  {
+  if(keep)
+    _kept_to_output((float *)o, out, roi_out, roi_in);
+  else if(!direct)
     dt_iop_clip_and_zoom_roi((float *)o, out, roi_out, roi_in);
-    dt_free_align(out);
+
+  if(keep)
+  {
+    d->kept = out;
+    d->kept_hash = keep_hash;
   }
+  else if(!direct)
+    dt_free_align(out);
 }
 
 #ifdef HAVE_OPENCL
@@ -939,7 +1035,7 @@ int process_cl(dt_iop_module_t *self,
   cl_mem dev_xtrans = NULL;
 
   const uint32_t filters = dt_rawspeed_crop_dcraw_filters(pipe->dsc.filters, roi_in->x, roi_in->y);
-  const gboolean fullscale = _demosaic_full(piece, img, roi_out);
+  const gboolean fullscale = _demosaic_full(piece, img, roi_out, FALSE);
   const gboolean is_xtrans = filters == 9u;
   const gboolean is_bayer = !is_xtrans && filters != 0 && !true_monochrome;
 
@@ -1472,6 +1568,16 @@ void commit_params(dt_iop_module_t *self,
       piece->process_cl_ready = TRUE;
   }
 
+  d->keep_full = dt_conf_get_bool("plugins/darkroom/demosaic/keep_full_image");
+  d->keep_limit = (size_t)dt_conf_get_int("plugins/darkroom/demosaic/keep_full_image_limit") * DT_MEGA;
+  if(_keep_full_image(piece))
+    piece->process_cl_ready = FALSE;
+  else
+  {
+    dt_free_align(d->kept);
+    d->kept = NULL;
+  }
+
   if(bayer4)
   {
     // 4Bayer images not implemented in OpenCL yet
@@ -1491,11 +1597,13 @@ void commit_params(dt_iop_module_t *self,
 
 void init_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
-  piece->data = malloc(sizeof(dt_iop_demosaic_data_t));
+  piece->data = calloc(1, sizeof(dt_iop_demosaic_data_t));
 }
 
 void cleanup_pipe(dt_iop_module_t *self, dt_dev_pixelpipe_t *pipe, dt_dev_pixelpipe_iop_t *piece)
 {
+  dt_iop_demosaic_data_t *d = piece->data;
+  dt_free_align(d->kept);
   free(piece->data);
   piece->data = NULL;
 }
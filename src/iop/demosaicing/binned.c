@@ -0,0 +1,97 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Binned demosaic for strongly downscaled pipes.
+
+   Every output pixel covers a block of factor x factor photosites. Each photosite
+   is taken to represent the cell of its colour sub-lattice (2 photosites wide for
+   bayer) and is weighted by the overlap of that cell with the block. For bayer this
+   puts the centroid of all three colours exactly at the block centre so there is no
+   chroma shift between the channels, the 1-pixel rim around the block gets the
+   fractional weights. X-Trans uses the same weights and per-colour normalisation,
+   there the colour centroids stay within a third of a photosite of the centre.
+*/
+
+#define BINNED_MAX_FACTOR 4
+
+// keep the cfa colour while mirroring indices at the image borders
+static inline int _binned_clamp(const int p, const int size, const int period)
+{
+  return p < 0 ? p + period : (p >= size ? p - period : p);
+}
+
+// the largest binning that still leaves a downscale for the final resampling
+static int _binned_factor(const float scale)
+{
+  for(int factor = BINNED_MAX_FACTOR; factor > 1; factor--)
+    if(factor * scale <= 1.0f) return factor;
+  return 1;
+}
+
+__DT_CLONE_TARGETS__
+static void demosaic_binned(float *const restrict out,
+                            const float *const restrict in,
+                            const int width,
+                            const int height,
+                            const uint32_t filters,
+                            const uint8_t (*const xtrans)[6],
+                            const int factor)
+{
+  const int bwidth = width / factor;
+  const int bheight = height / factor;
+  const int period = filters == 9u ? 6 : 2;
+  // center the blocks on the binned pixel position, exact for odd factors
+  const int shift = (factor - 1) / 2;
+
+  float weight[BINNED_MAX_FACTOR + 2];
+  for(int k = -1; k <= factor; k++)
+    weight[k + 1] = fmaxf(0.0f, fminf(k + 1.0f, factor - 0.5f) - fmaxf(k - 1.0f, -0.5f));
+
+  DT_OMP_FOR()
+  for(int row = 0; row < bheight; row++)
+  {
+    float *o = out + (size_t)4 * bwidth * row;
+    const int y0 = row * factor - shift;
+    for(int col = 0; col < bwidth; col++, o += 4)
+    {
+      const int x0 = col * factor - shift;
+      dt_aligned_pixel_t sum = { 0.0f, 0.0f, 0.0f, 0.0f };
+      dt_aligned_pixel_t wsum = { 0.0f, 0.0f, 0.0f, 0.0f };
+      for(int j = -1; j <= factor; j++)
+      {
+        const int y = _binned_clamp(y0 + j, height, period);
+        for(int i = -1; i <= factor; i++)
+        {
+          const int x = _binned_clamp(x0 + i, width, period);
+          const int c = filters == 9u ? FCxtrans(y, x, NULL, xtrans) : FC(y, x, filters);
+          const float w = weight[j + 1] * weight[i + 1];
+          sum[c] += w * fmaxf(0.0f, in[(size_t)y * width + x]);
+          wsum[c] += w;
+        }
+      }
+      for_each_channel(c)
+        o[c] = wsum[c] > 0.0f ? sum[c] / wsum[c] : 0.0f;
+    }
+  }
+}
+
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -280,6 +280,43 @@ gboolean distort_backtransform(dt_iop_module_t *self,
   return TRUE;
 }
 
+gboolean distort_roi_backtransform(dt_iop_module_t *self,
+                                   dt_dev_pixelpipe_iop_t *piece,
+                                   const dt_iop_roi_t *const roi_in,
+                                   const dt_iop_roi_t *const roi_out,
+                                   float *const restrict points,
+                                   size_t points_count)
+{
+  const dt_iop_flip_data_t *d = piece->data;
+
+  if(d->orientation == 0) return TRUE;
+
+  // the inverse of dt_imageio_flip_buffers() on the whole roi_in buffer
+  const float wd = roi_in->width - 1;
+  const float ht = roi_in->height - 1;
+  const gboolean swap = d->orientation & ORIENTATION_SWAP_XY;
+
+  float *const pts = DT_IS_ALIGNED(points);
+
+  DT_OMP_FOR(if(points_count > 500))
+  for(size_t i = 0; i < points_count * 2; i += 2)
+  {
+    float x = swap ? pts[i + 1] : pts[i];
+    float y = swap ? pts[i] : pts[i + 1];
+
+    if(d->orientation & ORIENTATION_FLIP_X)
+      x = wd - x;
+
+    if(d->orientation & ORIENTATION_FLIP_Y)
+      y = ht - y;
+
+    pts[i] = x;
+    pts[i + 1] = y;
+  }
+
+  return TRUE;
+}
+
 void distort_mask(dt_iop_module_t *self,
                   dt_dev_pixelpipe_iop_t *piece,
                   const float *const in,
@@ -138,6 +138,17 @@ typedef struct dt_iop_highlights_gui_data_t
 
 typedef dt_iop_highlights_params_t dt_iop_highlights_data_t;
 
+// the segmentation based reconstruction of the whole image for the last pipes, see segbased.c
+#define HL_SEGCACHE_ENTRIES 2
+
+typedef struct dt_iop_highlights_segcache_t
+{
+  dt_hash_t hash;
+  size_t size;
+  double used;
+  float *data;
+} dt_iop_highlights_segcache_t;
+
 typedef struct dt_iop_highlights_global_data_t
 {
   int kernel_highlights_1f_clip;
@@ -162,6 +173,9 @@ typedef struct dt_iop_highlights_global_data_t
   int kernel_filmic_wavelets_detail;
 
   int kernel_interpolate_bilinear;
+
+  dt_pthread_mutex_t seg_lock;
+  dt_iop_highlights_segcache_t segcache[HL_SEGCACHE_ENTRIES];
 } dt_iop_highlights_global_data_t;
 
 
@@ -982,10 +996,19 @@ void process(dt_iop_module_t *self,
     {
       const dt_highlights_mask_t vmode = ((g != NULL) && fullpipe && (g->hlr_mask_mode != DT_HIGHLIGHTS_MASK_CLIPPED)) ? g->hlr_mask_mode : DT_HIGHLIGHTS_MASK_OFF;
 
+      // the reconstruction only depends on the raw data and our parameters, zooming and panning
+      // just crops from the full image result of a previous run.
+      const gboolean cached = vmode == DT_HIGHLIGHTS_MASK_OFF;
+      if(cached && _segments_cache_get(piece, ovoid, roi_in, roi_out))
+        break;
+
       float *tmp = _process_opposed(self, piece, ivoid, ovoid, roi_in, roi_out, TRUE, TRUE);
       if(tmp)
         _process_segmentation(piece, ivoid, ovoid, roi_in, roi_out, d, vmode, tmp);
-      dt_free_align(tmp);
+      if(tmp && cached)
+        _segments_cache_store(piece, tmp, roi_in);
+      else
+        dt_free_align(tmp);
       break;
     }
 
@@ -1091,6 +1114,9 @@ void init_global(dt_iop_module_so_t *self)
   gd->kernel_filmic_bspline_horizontal = dt_opencl_create_kernel(wavelets, "blur_2D_Bspline_horizontal");
   gd->kernel_filmic_bspline_vertical = dt_opencl_create_kernel(wavelets, "blur_2D_Bspline_vertical");
   gd->kernel_filmic_wavelets_detail = dt_opencl_create_kernel(wavelets, "wavelets_detail_level");
+
+  dt_pthread_mutex_init(&gd->seg_lock, NULL);
+  memset(gd->segcache, 0, sizeof(gd->segcache));
 }
 
 void cleanup_global(dt_iop_module_so_t *self)
@@ -1119,6 +1145,10 @@ void cleanup_global(dt_iop_module_so_t *self)
 
   dt_opencl_free_kernel(gd->kernel_interpolate_bilinear);
 
+  for(int k = 0; k < HL_SEGCACHE_ENTRIES; k++)
+    dt_free_align(gd->segcache[k].data);
+  dt_pthread_mutex_destroy(&gd->seg_lock);
+
   free(self->data);
   self->data = NULL;
 }
@@ -1295,6 +1325,12 @@ void gui_focus(dt_iop_module_t *self, gboolean in)
   }
 }
 
+void gui_cleanup(dt_iop_module_t *self)
+{
+  // leaving darkroom or removing the instance
+  _segments_cache_flush(self->global_data);
+}
+
 void gui_init(dt_iop_module_t *self)
 {
   dt_iop_highlights_gui_data_t *g = IOP_GUI_ALLOC(highlights);
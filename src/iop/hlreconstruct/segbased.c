@@ -758,3 +758,138 @@ static void _process_segmentation(dt_dev_pixelpipe_iop_t *piece,
   dt_free_align(fbuffer);
 }
 
+/* The reconstructed raw data of the whole image is kept in a small module wide cache.
+   The key holds the parameters used by opposed and segmentation, it is combined with the
+   hash of the upstream pipe in memory and with the persistent pipe hash by the disk tier.
+*/
+static dt_hash_t _segments_key(dt_dev_pixelpipe_iop_t *piece,
+                               const dt_iop_roi_t *const roi_in)
+{
+  const dt_iop_highlights_data_t *d = piece->data;
+  const int late = piece->module->dev->chroma.late_correction;
+  const float params[6] = { d->clip, d->combine, d->candidating, d->strength, d->noise_level, piece->pipe->iscale };
+  const int dims[3] = { roi_in->width, roi_in->height, d->recovery };
+  dt_hash_t key = dt_hash(DT_INITHASH, params, sizeof(params));
+  key = dt_hash(key, dims, sizeof(dims));
+  return dt_hash(key, &late, sizeof(late));
+}
+
+static dt_hash_t _segments_hash(dt_dev_pixelpipe_iop_t *piece,
+                                const dt_hash_t key)
+{
+  return dt_hash(dt_dev_pixelpipe_piece_hash(piece, NULL, FALSE), &key, sizeof(key));
+}
+
+// takes ownership of data
+static void _segments_cache_store(dt_dev_pixelpipe_iop_t *piece,
+                                  float *data,
+                                  const dt_iop_roi_t *const roi_in)
+{
+  dt_iop_highlights_global_data_t *gd = piece->module->global_data;
+  const dt_hash_t key = _segments_key(piece, roi_in);
+  const dt_hash_t hash = _segments_hash(piece, key);
+  const size_t size = sizeof(float) * roi_in->width * roi_in->height;
+
+  dt_dev_pixelpipe_cache_disk_store_aux(piece->pipe, piece->module, piece->module->position - 1, key, data, size);
+
+  // all entries together stay within a share of the memory we may use
+  const size_t budget = dt_get_available_mem() / 4;
+  if(size > budget)
+  {
+    dt_free_align(data);
+    return;
+  }
+
+  dt_pthread_mutex_lock(&gd->seg_lock);
+  // replace the same result or else the least recently used one
+  int slot = 0;
+  for(int k = 0; k < HL_SEGCACHE_ENTRIES; k++)
+  {
+    const dt_iop_highlights_segcache_t *c = &gd->segcache[k];
+    if(c->data && c->hash == hash)
+    {
+      slot = k;
+      break;
+    }
+    if(!c->data || c->used < gd->segcache[slot].used)
+      slot = k;
+  }
+  dt_iop_highlights_segcache_t *c = &gd->segcache[slot];
+  dt_free_align(c->data);
+  c->data = data;
+  c->hash = hash;
+  c->size = size;
+  c->used = dt_get_wtime();
+
+  // make room by dropping the least recently used others
+  for(;;)
+  {
+    size_t total = 0;
+    int lru = -1;
+    for(int k = 0; k < HL_SEGCACHE_ENTRIES; k++)
+    {
+      const dt_iop_highlights_segcache_t *o = &gd->segcache[k];
+      if(!o->data) continue;
+      total += o->size;
+      if(k != slot && (lru < 0 || o->used < gd->segcache[lru].used))
+        lru = k;
+    }
+    if(total <= budget || lru < 0) break;
+    dt_free_align(gd->segcache[lru].data);
+    memset(&gd->segcache[lru], 0, sizeof(dt_iop_highlights_segcache_t));
+  }
+  dt_pthread_mutex_unlock(&gd->seg_lock);
+}
+
+// drop the whole image results, they are only worth keeping while in darkroom
+static void _segments_cache_flush(dt_iop_highlights_global_data_t *gd)
+{
+  dt_pthread_mutex_lock(&gd->seg_lock);
+  for(int k = 0; k < HL_SEGCACHE_ENTRIES; k++)
+    dt_free_align(gd->segcache[k].data);
+  memset(gd->segcache, 0, sizeof(gd->segcache));
+  dt_pthread_mutex_unlock(&gd->seg_lock);
+}
+
+static gboolean _segments_cache_get(dt_dev_pixelpipe_iop_t *piece,
+                                    float *const output,
+                                    const dt_iop_roi_t *const roi_in,
+                                    const dt_iop_roi_t *const roi_out)
+{
+  dt_iop_highlights_global_data_t *gd = piece->module->global_data;
+  const dt_hash_t key = _segments_key(piece, roi_in);
+  const dt_hash_t hash = _segments_hash(piece, key);
+  const size_t size = sizeof(float) * roi_in->width * roi_in->height;
+
+  gboolean found = FALSE;
+  dt_pthread_mutex_lock(&gd->seg_lock);
+  for(int k = 0; k < HL_SEGCACHE_ENTRIES && !found; k++)
+  {
+    dt_iop_highlights_segcache_t *c = &gd->segcache[k];
+    if(c->data && c->hash == hash && c->size == size)
+    {
+      dt_iop_copy_image_roi(output, c->data, 1, roi_in, roi_out);
+      c->used = dt_get_wtime();
+      found = TRUE;
+    }
+  }
+  dt_pthread_mutex_unlock(&gd->seg_lock);
+
+  if(found)
+  {
+    dt_print_pipe(DT_DEBUG_PIPE, "segmentation cached", piece->pipe, piece->module, DT_DEVICE_CPU, roi_in, roi_out);
+    return TRUE;
+  }
+
+  // possibly written by an earlier session
+  float *data = dt_alloc_align_float((size_t)roi_in->width * roi_in->height);
+  if(data && dt_dev_pixelpipe_cache_disk_load_aux(piece->pipe, piece->module, piece->module->position - 1, key, data, size))
+  {
+    dt_print_pipe(DT_DEBUG_PIPE, "segmentation from disk", piece->pipe, piece->module, DT_DEVICE_CPU, roi_in, roi_out);
+    dt_iop_copy_image_roi(output, data, 1, roi_in, roi_out);
+    _segments_cache_store(piece, data, roi_in);
+    return TRUE;
+  }
+  dt_free_align(data);
+  return FALSE;
+}
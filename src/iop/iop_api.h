@@ -310,6 +310,17 @@ OPTIONAL(void, distort_mask, struct dt_iop_module_t *self,
                              float *const out,
                              const struct dt_iop_roi_t *const roi_in,
                              const struct dt_iop_roi_t *const roi_out);
+/** map points given in pixel coordinates of the roi_out buffer to the position in the
+ *  roi_in buffer process() samples them from. Modules providing it promise that process()
+ *  does nothing but interpolating its input at these positions, this allows the pixelpipe
+ *  to compose consecutive warps into a single resampling pass. Returns FALSE if this
+ *  doesn't hold for the current parameters. */
+OPTIONAL(gboolean, distort_roi_backtransform, struct dt_iop_module_t *self,
+                                             struct dt_dev_pixelpipe_iop_t *piece,
+                                             const struct dt_iop_roi_t *const roi_in,
+                                             const struct dt_iop_roi_t *const roi_out,
+                                             float *points,
+                                             size_t points_count);
 
 // introspection related callbacks, will be auto-implemented if
 // DT_MODULE_INTROSPECTION() is used,
@@ -27,6 +27,7 @@
 #endif
 
 #include "bauhaus/bauhaus.h"
+#include "common/distortion_map.h"
 #include "common/interpolation.h"
 #include "common/file_location.h"
 #include "common/imagebuf.h"
@@ -53,6 +54,8 @@
 
 #define MAXKNOTS 16
 #define VIGSPLINES 512
+// grid spacing of the lensfun coordinate map in pixels
+#define LF_MAP_STEP 8
 
 G_BEGIN_DECLS
 
@@ -244,6 +247,9 @@ typedef struct dt_iop_lens_data_t
   float reserved[2];
   float vigspline[VIGSPLINES];
   dt_hash_t vighash;
+
+  // lensfun coordinates of the last processed roi
+  dt_distortion_map_t *map;
 } dt_iop_lens_data_t;
 
 
@@ -1041,6 +1047,69 @@ static float _get_autoscale_lf(dt_iop_module_t *self,
   return scale;
 }
 
+static void _distortion_map_eval_lf(const float x,
+                                    const float y,
+                                    float *out,
+                                    const void *data)
+{
+  const lfModifier *modifier = (const lfModifier *)data;
+  modifier->ApplySubpixelGeometryDistortion(x, y, 1, 1, out);
+}
+
+// Evaluating lensfun for every output pixel dominates the module, the
+// distortion is smooth so it's sampled on a grid. The grid covers the
+// whole output at the current scale and is kept in the piece until the
+// parameters or the scale change, panning only reads it at another offset.
+// When zoomed in far on a large image the grid only covers the roi.
+// NULL if the roi isn't covered, the caller evaluates per pixel then.
+static const dt_distortion_map_t *_get_distortion_map_lf(dt_dev_pixelpipe_iop_t *piece,
+                                                         const lfModifier *modifier,
+                                                         const dt_iop_roi_t *const roi_in,
+                                                         const dt_iop_roi_t *const roi_out,
+                                                         const int used_lf_mask)
+{
+  dt_iop_lens_data_t *d = (dt_iop_lens_data_t *)piece->data;
+
+  const dt_iop_roi_t full = { .x = 0, .y = 0,
+                              .width = (int)ceilf(piece->buf_out.width * roi_out->scale),
+                              .height = (int)ceilf(piece->buf_out.height * roi_out->scale),
+                              .scale = roi_out->scale };
+  const size_t full_size = sizeof(float) * 6
+    * ((size_t)full.width / LF_MAP_STEP + 2) * (full.height / LF_MAP_STEP + 2);
+  const dt_iop_roi_t *area = full_size > dt_get_available_mem() / 16 ? roi_out : &full;
+  if(roi_out->x < area->x || roi_out->y < area->y
+     || roi_out->x + roi_out->width > area->x + area->width
+     || roi_out->y + roi_out->height > area->y + area->height)
+    return NULL;
+
+  dt_hash_t hash = dt_hash(DT_INITHASH, &piece->hash, sizeof(piece->hash));
+  hash = dt_hash(hash, area, sizeof(dt_iop_roi_t));
+  hash = dt_hash(hash, &roi_in->scale, sizeof(roi_in->scale));
+  hash = dt_hash(hash, &piece->buf_in, sizeof(piece->buf_in));
+  hash = dt_hash(hash, &used_lf_mask, sizeof(used_lf_mask));
+  if(d->map && d->map->hash == hash) return d->map;
+
+  dt_distortion_map_free(d->map);
+  d->map = dt_distortion_map_new(area, LF_MAP_STEP, 6, _distortion_map_eval_lf, modifier);
+  if(d->map) d->map->hash = hash;
+  return d->map;
+}
+
+// lensfun coordinates of an output row, 6 floats per pixel
+static inline void _coords_row_lf(const dt_distortion_map_t *const map,
+                                  const lfModifier *modifier,
+                                  const dt_iop_roi_t *const roi_out,
+                                  const int y,
+                                  float *const out)
+{
+  if(map)
+    dt_distortion_map_row(map, roi_out->x - map->roi.x, roi_out->y - map->roi.y + y,
+                          roi_out->width, out);
+  else
+    modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y,
+                                              roi_out->width, 1, out);
+}
+
 static void _process_lf(dt_iop_module_t *self,
                         dt_dev_pixelpipe_iop_t *piece,
                         const void *const ivoid,
@@ -1098,13 +1167,14 @@ static void _process_lf(dt_iop_module_t *self,
 
       size_t padded_bufsize;
       float *const buf = dt_alloc_perthread_float(bufsize, &padded_bufsize);
+      const dt_distortion_map_t *map =
+        _get_distortion_map_lf(piece, modifier, roi_in, roi_out, used_lf_mask);
 
-      DT_OMP_FOR(dt_omp_sharedconst(buf) shared(modifier))
+      DT_OMP_FOR(dt_omp_sharedconst(buf) shared(modifier, map))
       for(int y = 0; y < roi_out->height; y++)
       {
         float *bufptr = (float*)dt_get_perthread(buf, padded_bufsize);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x, roi_out->y + y,
-                                                  roi_out->width, 1, bufptr);
+        _coords_row_lf(map, modifier, roi_out, y, bufptr);
 
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
@@ -1208,15 +1278,14 @@ static void _process_lf(dt_iop_module_t *self,
       const size_t buf2size = (size_t)roi_out->width * 2 * 3;
       size_t padded_buf2size;
       float *const buf2 = dt_alloc_perthread_float(buf2size, &padded_buf2size);
+      const dt_distortion_map_t *map =
+        _get_distortion_map_lf(piece, modifier, roi_in, roi_out, used_lf_mask);
 
-      DT_OMP_FOR(dt_omp_sharedconst(buf2) shared(buf, modifier))
+      DT_OMP_FOR(dt_omp_sharedconst(buf2) shared(buf, modifier, map))
       for(int y = 0; y < roi_out->height; y++)
       {
         float *buf2ptr = (float*)dt_get_perthread(buf2, padded_buf2size);
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x,
-                                                  roi_out->y + y,
-                                                  roi_out->width,
-                                                  1, buf2ptr);
+        _coords_row_lf(map, modifier, roi_out, y, buf2ptr);
         // reverse transform the global coords from lf to our buffer
         float *out = ((float *)ovoid) + (size_t)y * roi_out->width * ch;
         for(int x = 0; x < roi_out->width; x++, buf2ptr += 6, out += ch)
@@ -1376,13 +1445,13 @@ static int _process_cl_lf(dt_iop_module_t *self,
                    | LF_MODIFY_GEOMETRY
                    | LF_MODIFY_SCALE))
     {
-      DT_OMP_FOR(dt_omp_sharedconst(raw_monochrome) shared(tmpbuf, d, modifier))
+      const dt_distortion_map_t *map =
+        _get_distortion_map_lf(piece, modifier, roi_in, roi_out, used_lf_mask);
+      DT_OMP_FOR(dt_omp_sharedconst(raw_monochrome) shared(tmpbuf, d, modifier, map))
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x,
-                                                  roi_out->y + y,
-                                                  roi_out->width, 1, pi);
+        _coords_row_lf(map, modifier, roi_out, y, pi);
       }
 
       err = dt_opencl_write_buffer_to_device(devid, tmpbuf,
@@ -1487,13 +1556,13 @@ static int _process_cl_lf(dt_iop_module_t *self,
                    | LF_MODIFY_GEOMETRY
                    | LF_MODIFY_SCALE))
     {
-      DT_OMP_FOR(dt_omp_sharedconst(raw_monochrome) shared(tmpbuf, d, modifier))
+      const dt_distortion_map_t *map =
+        _get_distortion_map_lf(piece, modifier, roi_in, roi_out, used_lf_mask);
+      DT_OMP_FOR(dt_omp_sharedconst(raw_monochrome) shared(tmpbuf, d, modifier, map))
       for(int y = 0; y < roi_out->height; y++)
       {
         float *pi = tmpbuf + (size_t)y * tmpbufwidth;
-        modifier->ApplySubpixelGeometryDistortion(roi_out->x,
-                                                  roi_out->y + y,
-                                                  roi_out->width, 1, pi);
+        _coords_row_lf(map, modifier, roi_out, y, pi);
       }
 
       err = dt_opencl_write_buffer_to_device(devid, tmpbuf,
@@ -3320,6 +3389,7 @@ void cleanup_pipe(dt_iop_module_t *self,
     delete d->lens;
     d->lens = NULL;
   }
+  dt_distortion_map_free(d->map);
 
   free(piece->data);
   piece->data = NULL;
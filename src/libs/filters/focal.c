@@ -33,27 +33,19 @@ static gboolean _focal_update(dt_lib_filtering_rule_t *rule)
 
   rule->manual_widget_set++;
   // first, we update the graph
-  char query[1024] = { 0 };
-  // clang-format off
-  g_snprintf(query, sizeof(query),
-             "SELECT ROUND(focal_length,0), COUNT(*) AS count"
-             " FROM main.images AS mi"
-             " WHERE %s"
-             " GROUP BY ROUND(focal_length,0)",
-             d->last_where_ext);
-  // clang-format on
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
+  dt_collection_index_bin_t *bins = NULL;
+  const int nb_bins = dt_collection_index_histogram(d->last_where_ext, DT_COLLECTION_INDEX_FOCAL_LENGTH,
+                                                    0, &bins);
   dtgtk_range_select_reset_blocks(range);
   if(rangetop) dtgtk_range_select_reset_blocks(rangetop);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  for(int k = 0; k < nb_bins; k++)
   {
-    const double val = sqlite3_column_double(stmt, 0);
-    const int count = sqlite3_column_int(stmt, 1);
+    const double val = bins[k].value;
+    const int count = bins[k].count;
     dtgtk_range_select_add_block(range, val, count);
     if(rangetop) dtgtk_range_select_add_block(rangetop, val, count);
   }
-  sqlite3_finalize(stmt);
+  g_free(bins);
 
   // and setup the selection
   dtgtk_range_select_set_selection_from_raw_text(range, rule->raw_text, FALSE);
@@ -89,22 +81,8 @@ static void _focal_widget_init(dt_lib_filtering_rule_t *rule, const dt_collectio
   dtgtk_range_select_set_selection_from_raw_text(range, text, FALSE);
   range->print = _focal_print_func;
 
-  char query[1024] = { 0 };
-  // clang-format off
-  g_snprintf(query, sizeof(query),
-             "SELECT MIN(focal_length), MAX(focal_length)"
-             " FROM main.images");
-  // clang-format on
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  double min = 0.0;
-  double max = 400.0;
-  if(sqlite3_step(stmt) == SQLITE_ROW)
-  {
-    min = sqlite3_column_double(stmt, 0);
-    max = sqlite3_column_double(stmt, 1);
-  }
-  sqlite3_finalize(stmt);
+  double min, max;
+  dt_collection_index_range(DT_COLLECTION_INDEX_FOCAL_LENGTH, &min, &max);
   range->min_r = floor(min);
   range->max_r = floor(max) + 1.0;
 
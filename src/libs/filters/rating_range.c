@@ -31,28 +31,18 @@ static gboolean _rating_range_update(dt_lib_filtering_rule_t *rule)
                                       : NULL;
 
   rule->manual_widget_set++;
-  char query[1024] = { 0 };
-  // clang-format off
-  g_snprintf(query, sizeof(query),
-             "SELECT CASE WHEN (flags & 8) == 8 THEN -1 ELSE (flags & 7) END AS rating,"
-             " COUNT(*) AS count"
-             " FROM main.images AS mi"
-             " WHERE %s"
-             " GROUP BY rating"
-             " ORDER BY rating",
-             rule->lib->last_where_ext);
-  // clang-format on
   int nb[7] = { 0 };
-  sqlite3_stmt *stmt;
-  DT_DEBUG_SQLITE3_PREPARE_V2(dt_database_get(darktable.db), query, -1, &stmt, NULL);
-  while(sqlite3_step(stmt) == SQLITE_ROW)
+  dt_collection_index_bin_t *bins = NULL;
+  const int nb_bins = dt_collection_index_histogram(rule->lib->last_where_ext,
+                                                    DT_COLLECTION_INDEX_RATING, 0, &bins);
+  for(int k = 0; k < nb_bins; k++)
   {
-    const int val = sqlite3_column_int(stmt, 0);
-    const int count = sqlite3_column_int(stmt, 1);
+    const int val = (int)bins[k].value;
+    const int count = bins[k].count;
 
     if(val < 6 && val >= -1) nb[val + 1] += count;
   }
-  sqlite3_finalize(stmt);
+  g_free(bins);
 
   dtgtk_range_select_reset_blocks(range);
   dtgtk_range_select_add_range_block(range, 1.0, 1.0, DT_RANGE_BOUND_MIN | DT_RANGE_BOUND_MAX,
@@ -2121,6 +2121,12 @@ static void _import_from_dialog_new(dt_lib_module_t* self)
   gtk_widget_set_hexpand(gtk_grid_get_child_at(grid, col++, line++), TRUE);
   g_signal_connect(G_OBJECT(ignore_nonraws), "toggled",
                    G_CALLBACK(_ignore_nonraws_toggled), self);
+  if(d->import_case == DT_IMPORT_INPLACE)
+  {
+    col = 0;
+    dt_gui_preferences_bool(grid, "ui_last/import_bulk", col++, line, TRUE);
+    gtk_widget_set_hexpand(gtk_grid_get_child_at(grid, col++, line++), TRUE);
+  }
   gtk_box_pack_start(GTK_BOX(rbox), GTK_WIDGET(grid), FALSE, FALSE, 8);
 
   // files list
@@ -0,0 +1,130 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// microbenchmark for dt_cache_t: get/release throughput with a growing number of threads.
+//
+//   darktable-bench-cache [max threads] [keys] [quota]
+//
+// with a quota below the number of keys the benchmark also exercises allocation and
+// garbage collection, otherwise it's a pure lookup & lru bubbling test.
+
+#include "common/cache.h"
+#include "common/darktable.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+#define ITERATIONS 1000000
+
+typedef struct bench_thread_t
+{
+  dt_cache_t *cache;
+  uint32_t keys;
+  uint32_t seed;
+  int writers; // every n-th access takes a write lock, 0 for none
+} bench_thread_t;
+
+static void _alloc_dummy(void *data, dt_cache_entry_t *entry)
+{
+  entry->cost = 1;
+  entry->data_size = sizeof(uint32_t);
+  entry->data = dt_alloc_aligned(entry->data_size);
+  *(uint32_t *)entry->data = entry->key;
+}
+
+static gpointer _bench_run(gpointer data)
+{
+  bench_thread_t *t = (bench_thread_t *)data;
+  uint32_t state = t->seed;
+  for(int k = 0; k < ITERATIONS; k++)
+  {
+    // xorshift, good enough to spread the keys
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    const uint32_t key = state % t->keys;
+    const char mode = (t->writers && (k % t->writers) == 0) ? 'w' : 'r';
+    dt_cache_entry_t *entry = dt_cache_get(t->cache, key, mode);
+    if(*(uint32_t *)entry->data != key)
+    {
+      fprintf(stderr, "[FAIL] got wrong data for key %" PRIu32 "\n", key);
+      exit(1);
+    }
+    dt_cache_release(t->cache, entry);
+  }
+  return NULL;
+}
+
+static double _bench(const int threads,
+                     const uint32_t keys,
+                     const size_t quota,
+                     const int writers)
+{
+  dt_cache_t cache;
+  dt_cache_init(&cache, 0, quota);
+  dt_cache_set_allocate_callback(&cache, _alloc_dummy, NULL);
+
+  bench_thread_t *t = calloc(threads, sizeof(bench_thread_t));
+  GThread **thread = calloc(threads, sizeof(GThread *));
+
+  const double start = dt_get_wtime();
+  for(int k = 0; k < threads; k++)
+  {
+    t[k].cache = &cache;
+    t[k].keys = keys;
+    t[k].seed = 2463534242u + 7919u * k;
+    t[k].writers = writers;
+    thread[k] = g_thread_new("cache bench", _bench_run, &t[k]);
+  }
+  for(int k = 0; k < threads; k++)
+    g_thread_join(thread[k]);
+  const double elapsed = dt_get_wtime() - start;
+
+  dt_cache_cleanup(&cache);
+  free(thread);
+  free(t);
+  return (double)threads * ITERATIONS / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+  const int max_threads = argc > 1 ? atoi(argv[1]) : g_get_num_processors();
+  const uint32_t keys = argc > 2 ? atoi(argv[2]) : 10000;
+  const size_t quota = argc > 3 ? atoll(argv[3]) : 2 * keys;
+
+  printf("dt_cache_t get/release throughput, %d shards, %" PRIu32 " keys, quota %zu\n",
+         DT_CACHE_SHARDS, keys, quota);
+  printf("%8s %16s %16s\n", "threads", "read Mops/s", "1:16 write Mops/s");
+
+  for(int threads = 1; threads <= MAX(1, max_threads); threads *= 2)
+  {
+    const double reads = _bench(threads, keys, quota, 0);
+    const double mixed = _bench(threads, keys, quota, 16);
+    printf("%8d %16.3f %16.3f\n", threads, reads * 1e-6, mixed * 1e-6);
+  }
+  return 0;
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,208 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for common/distortion_map.c with the lensfun
+ * coordinates the lens module maps.
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+#include <lensfun.h>
+
+#include "../util/tracing.h"
+
+#include "common/distortion_map.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 1200
+#define HEIGHT 800
+#define STEP 8 // as LF_MAP_STEP of the lens module
+#define FOCAL 24.0f
+
+// lensfun changed the modifier api with 0.3.95, as in the lens module
+#if LF_VERSION >= ((0 << 24) | (3 << 16) | (95 << 8) | 0)
+#define LF_0395
+#endif
+
+// largest difference to the exact coordinates in pixels
+#define E 0.1f
+
+typedef struct test_lens_t
+{
+  lfLens *lens;
+  lfModifier *modifier;
+} test_lens_t;
+
+/*
+ * HELPER FUNCTIONS
+ */
+
+static void eval_lf(const float x,
+                    const float y,
+                    float *out,
+                    const void *data)
+{
+  lfModifier *modifier = (lfModifier *)data;
+  lf_modifier_apply_subpixel_geometry_distortion(modifier, x, y, 1, 1, out);
+}
+
+// strong barrel distortion and some lateral chromatic aberration
+static int setup(void **state)
+{
+  lfLens *lens = lf_lens_new();
+  lens->Type = LF_RECTILINEAR;
+  lens->MinFocal = lens->MaxFocal = FOCAL;
+  lens->CropFactor = 1.0f;
+  lens->AspectRatio = 1.5f;
+
+  lfLensCalibDistortion dist = { 0 };
+  dist.Model = LF_DIST_MODEL_PTLENS;
+  dist.Focal = FOCAL;
+  dist.Terms[0] = 0.02f;
+  dist.Terms[1] = -0.12f;
+  dist.Terms[2] = 0.03f;
+  lf_lens_add_calib_distortion(lens, &dist);
+
+  lfLensCalibTCA tca = { 0 };
+  tca.Model = LF_TCA_MODEL_LINEAR;
+  tca.Focal = FOCAL;
+  tca.Terms[0] = 1.0004f;
+  tca.Terms[1] = 0.9995f;
+  lf_lens_add_calib_tca(lens, &tca);
+
+#ifdef LF_0395
+  lfModifier *modifier = lf_modifier_new(1.0f, WIDTH, HEIGHT, LF_PF_F32, 0);
+  int done = lf_modifier_enable_distortion_correction(modifier, lens, FOCAL);
+  done |= lf_modifier_enable_tca_correction(modifier, lens, FOCAL);
+#else
+  lfModifier *modifier = lf_modifier_new(lens, 1.0f, WIDTH, HEIGHT);
+  const int done = lf_modifier_initialize(modifier, lens, LF_PF_F32, FOCAL, 4.0f, 1000.0f, 1.0f,
+                                          LF_RECTILINEAR, LF_MODIFY_DISTORTION | LF_MODIFY_TCA, 0);
+#endif
+  assert_true(done & LF_MODIFY_DISTORTION);
+
+  test_lens_t *t = calloc(1, sizeof(test_lens_t));
+  t->lens = lens;
+  t->modifier = modifier;
+  *state = t;
+  return 0;
+}
+
+static int teardown(void **state)
+{
+  test_lens_t *t = *state;
+  lf_modifier_destroy(t->modifier);
+  lf_lens_destroy(t->lens);
+  free(t);
+  return 0;
+}
+
+// compare rows read from the map at several offsets with lensfun
+static void check_map(lfModifier *modifier,
+                      const dt_distortion_map_t *map,
+                      const int x0,
+                      const int y0,
+                      const int width,
+                      const int height)
+{
+  float *exact = calloc((size_t)6 * width, sizeof(float));
+  float *mapped = calloc((size_t)6 * width, sizeof(float));
+  float max_err = 0.0f;
+  for(int y = y0; y < y0 + height; y++)
+  {
+    lf_modifier_apply_subpixel_geometry_distortion(modifier, map->roi.x + x0, map->roi.y + y,
+                                                   width, 1, exact);
+    dt_distortion_map_row(map, x0, y, width, mapped);
+    for(int k = 0; k < 6 * width; k++)
+      max_err = fmaxf(max_err, fabsf(mapped[k] - exact[k]));
+  }
+  TR_DEBUG("largest difference %f px", max_err);
+  assert_true(max_err < E);
+  free(mapped);
+  free(exact);
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_map_vs_lensfun(void **state)
+{
+  lfModifier *modifier = ((test_lens_t *)*state)->modifier;
+
+  // the distortion has to be strong for the test to mean anything
+  float corner[6];
+  lf_modifier_apply_subpixel_geometry_distortion(modifier, 0.0f, 0.0f, 1, 1, corner);
+  TR_DEBUG("corner maps to %f, %f", corner[0], corner[1]);
+  assert_true(fabsf(corner[0]) > 10.0f || fabsf(corner[1]) > 10.0f);
+
+  const dt_iop_roi_t full = { .x = 0, .y = 0, .width = WIDTH, .height = HEIGHT, .scale = 1.0f };
+  dt_distortion_map_t *map = dt_distortion_map_new(&full, STEP, 6, eval_lf, modifier);
+  assert_non_null(map);
+
+  TR_STEP("whole map");
+  check_map(modifier, map, 0, 0, WIDTH, HEIGHT);
+  TR_STEP("panned rois read by offset");
+  check_map(modifier, map, 333, 217, 400, 300);
+  check_map(modifier, map, WIDTH - 101, HEIGHT - 77, 101, 77);
+  check_map(modifier, map, 5, HEIGHT - 1, 17, 1);
+
+  dt_distortion_map_free(map);
+}
+
+static void test_map_of_roi(void **state)
+{
+  lfModifier *modifier = ((test_lens_t *)*state)->modifier;
+
+  TR_STEP("map covering an roi in the corner of the image");
+  const dt_iop_roi_t roi = { .x = 850, .y = 530, .width = 350, .height = 270, .scale = 1.0f };
+  dt_distortion_map_t *map = dt_distortion_map_new(&roi, STEP, 6, eval_lf, modifier);
+  assert_non_null(map);
+
+  check_map(modifier, map, 0, 0, roi.width, roi.height);
+  check_map(modifier, map, 41, 13, 200, 100);
+
+  dt_distortion_map_free(map);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_map_vs_lensfun, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_map_of_roi, setup, teardown)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,244 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the job dependencies of control/jobs.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <cmocka.h>
+
+#include "../util/tracing.h"
+
+#include "common/darktable.h"
+#include "control/control.h"
+#include "control/jobs.h"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// what happened to a job, its params outlive it
+typedef struct test_job_t
+{
+  int32_t result; // returned by the job
+  int runs;
+  int disposed;
+} test_job_t;
+
+/*
+ * HELPER FUNCTIONS
+ */
+
+static int32_t test_job_run(dt_job_t *job)
+{
+  test_job_t *t = dt_control_job_get_params(job);
+  t->runs++;
+  return t->result;
+}
+
+static void test_job_destroy(void *data)
+{
+  test_job_t *t = data;
+  t->disposed++;
+}
+
+static dt_job_t *test_job_create(test_job_t *t, const char *name)
+{
+  dt_job_t *job = dt_control_job_create(&test_job_run, "%s", name);
+  assert_non_null(job);
+  dt_control_job_set_params(job, t, test_job_destroy);
+  return job;
+}
+
+static int pending_jobs(void)
+{
+  return dt_atomic_get_int(&darktable.control->pending_jobs);
+}
+
+// a scheduler which is running but without any workers: synchronous jobs are
+// executed on the spot, everything else stays in the queues.
+static int setup(void **state)
+{
+  dt_control_t *control = calloc(1, sizeof(dt_control_t));
+  control->num_threads = 0;
+  control->deque = g_new0(GQueue, 1);
+  control->deque_mutex = g_new(dt_pthread_mutex_t, 1);
+  dt_pthread_mutex_init(&control->deque_mutex[0], NULL);
+  dt_pthread_mutex_init(&control->dependency_mutex, NULL);
+  dt_pthread_mutex_init(&control->queue_mutex, NULL);
+  dt_pthread_mutex_init(&control->cond_mutex, NULL);
+  pthread_cond_init(&control->cond, NULL);
+  dt_atomic_set_int(&control->running, DT_CONTROL_STATE_RUNNING);
+  darktable.control = control;
+  return 0;
+}
+
+static int teardown(void **state)
+{
+  dt_control_t *control = darktable.control;
+  for(int k = 0; k < DT_JOB_QUEUE_MAX; k++)
+    g_list_free(control->queues[k]);
+  pthread_cond_destroy(&control->cond);
+  dt_pthread_mutex_destroy(&control->cond_mutex);
+  dt_pthread_mutex_destroy(&control->queue_mutex);
+  dt_pthread_mutex_destroy(&control->dependency_mutex);
+  dt_pthread_mutex_destroy(&control->deque_mutex[0]);
+  g_free(control->deque_mutex);
+  g_free(control->deque);
+  free(control);
+  darktable.control = NULL;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_dependency_succeeded(void **state)
+{
+  test_job_t a = { 0 }, b = { 0 };
+  dt_job_t *ja = test_job_create(&a, "a");
+  dt_job_t *jb = test_job_create(&b, "b");
+  dt_control_job_add_dependency(jb, ja);
+
+  TR_STEP("run the dependency, then queue the dependent");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja));
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, jb));
+  assert_int_equal(a.runs, 1);
+  assert_int_equal(b.runs, 1);
+  assert_int_equal(b.disposed, 1);
+}
+
+static void test_dependency_failed_before_queued(void **state)
+{
+  test_job_t a = { .result = 1 }, b = { 0 };
+  dt_job_t *ja = test_job_create(&a, "a");
+  dt_job_t *jb = test_job_create(&b, "b");
+  dt_control_job_add_dependency(jb, ja);
+
+  TR_STEP("a dependency returning an error discards the dependent queued later");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja));
+  assert_int_equal(a.runs, 1);
+  assert_true(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, jb));
+  assert_int_equal(b.runs, 0);
+  assert_int_equal(b.disposed, 1);
+}
+
+static void test_dependency_failed_parked(void **state)
+{
+  test_job_t a = { .result = 1 }, b = { 0 }, c = { 0 };
+  dt_job_t *ja = test_job_create(&a, "a");
+  dt_job_t *jb = test_job_create(&b, "b");
+  dt_job_t *jc = test_job_create(&c, "c");
+  dt_control_job_add_dependency(jb, ja);
+  dt_control_job_add_dependency(jc, jb);
+
+  TR_STEP("dependents waiting for their dependencies are parked");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_USER_BG, jb));
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_USER_BG, jc));
+  assert_int_equal(pending_jobs(), 2);
+  assert_null(darktable.control->queues[DT_JOB_QUEUE_USER_BG]);
+
+  TR_STEP("the failure takes down the whole chain");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja));
+  assert_int_equal(b.runs, 0);
+  assert_int_equal(b.disposed, 1);
+  assert_int_equal(c.runs, 0);
+  assert_int_equal(c.disposed, 1);
+  assert_int_equal(pending_jobs(), 0);
+  assert_null(darktable.control->queues[DT_JOB_QUEUE_USER_BG]);
+}
+
+static void test_dependency_failed_other_pending(void **state)
+{
+  test_job_t a1 = { .result = 1 }, a2 = { 0 }, b = { 0 };
+  dt_job_t *ja1 = test_job_create(&a1, "a1");
+  dt_job_t *ja2 = test_job_create(&a2, "a2");
+  dt_job_t *jb = test_job_create(&b, "b");
+  dt_control_job_add_dependency(jb, ja1);
+  dt_control_job_add_dependency(jb, ja2);
+
+  TR_STEP("one dependency fails before the dependent is queued");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja1));
+
+  TR_STEP("the dependent is parked until the other one is done");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_USER_BG, jb));
+  assert_int_equal(b.disposed, 0);
+  assert_int_equal(pending_jobs(), 1);
+
+  TR_STEP("and discarded even though the last dependency succeeded");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja2));
+  assert_int_equal(a2.runs, 1);
+  assert_int_equal(b.runs, 0);
+  assert_int_equal(b.disposed, 1);
+  assert_int_equal(pending_jobs(), 0);
+  assert_null(darktable.control->queues[DT_JOB_QUEUE_USER_BG]);
+}
+
+static void test_dependency_releases_parked(void **state)
+{
+  test_job_t a = { 0 }, b = { 0 };
+  dt_job_t *ja = test_job_create(&a, "a");
+  dt_job_t *jb = test_job_create(&b, "b");
+  dt_control_job_add_dependency(jb, ja);
+
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_USER_BG, jb));
+  assert_null(darktable.control->queues[DT_JOB_QUEUE_USER_BG]);
+
+  TR_STEP("a successful dependency moves the dependent into its queue");
+  assert_false(dt_control_add_job(DT_JOB_QUEUE_SYNCHRONOUS, ja));
+  GList *queue = darktable.control->queues[DT_JOB_QUEUE_USER_BG];
+  assert_non_null(queue);
+  assert_ptr_equal(queue->data, jb);
+  assert_int_equal(dt_control_job_get_state(jb), DT_JOB_STATE_QUEUED);
+  assert_int_equal(pending_jobs(), 1);
+
+  // no workers here, take it back out
+  darktable.control->queues[DT_JOB_QUEUE_USER_BG] = g_list_delete_link(queue, queue);
+  darktable.control->queue_length[DT_JOB_QUEUE_USER_BG] = 0;
+  dt_atomic_sub_int(&darktable.control->pending_jobs, 1);
+  dt_control_job_dispose(jb);
+  assert_int_equal(b.runs, 0);
+  assert_int_equal(b.disposed, 1);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test_setup_teardown(test_dependency_succeeded, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_dependency_failed_before_queued, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_dependency_failed_parked, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_dependency_failed_other_pending, setup, teardown),
+    cmocka_unit_test_setup_teardown(test_dependency_releases_parked, setup, teardown)
+  };
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,224 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/ashift.c, comparing two instances
+ * processed one after the other with the single resampling pass the
+ * pixelpipe composes from distort_roi_backtransform().
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/ashift.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+#define WIDTH 400
+#define HEIGHT 300
+
+// largest difference between sequential and composed processing, the test
+// image is smooth enough for the second bilinear pass to stay well below
+#define E 2e-3f
+
+// positions closer than this to the buffer borders are clamped differently
+#define BORDER 2.0f
+
+/*
+ * HELPER FUNCTIONS
+ */
+
+static int setup_conf(void **state)
+{
+  darktable.conf = calloc(1, sizeof(dt_conf_t));
+  dt_pthread_mutex_init(&darktable.conf->mutex, NULL);
+  darktable.conf->table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  darktable.conf->override_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_insert(darktable.conf->table,
+                      g_strdup("plugins/lighttable/export/pixel_interpolator_warp"),
+                      g_strdup("bilinear"));
+  return 0;
+}
+
+static int teardown_conf(void **state)
+{
+  g_hash_table_destroy(darktable.conf->override_entries);
+  g_hash_table_destroy(darktable.conf->table);
+  dt_pthread_mutex_destroy(&darktable.conf->mutex);
+  free(darktable.conf);
+  darktable.conf = NULL;
+  return 0;
+}
+
+static inline float image_value(const float x, const float y, const int c)
+{
+  return 0.5f + 0.4f * sinf(x / (23.0f + 4.0f * c)) * cosf(y / 31.0f);
+}
+
+static void init_piece(dt_dev_pixelpipe_iop_t *piece, dt_iop_ashift_data_t *data)
+{
+  memset(piece, 0, sizeof(dt_dev_pixelpipe_iop_t));
+  piece->data = data;
+  piece->colors = 4;
+  piece->buf_in = (dt_iop_roi_t){ 0, 0, WIDTH, HEIGHT, 1.0f };
+  piece->buf_out = piece->buf_in;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_neutral_is_identity(void **state)
+{
+  dt_iop_ashift_data_t data = { .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f,
+                                .cl = 0.0f, .cr = 1.0f, .ct = 0.0f, .cb = 1.0f };
+  dt_dev_pixelpipe_iop_t piece;
+  init_piece(&piece, &data);
+  const dt_iop_roi_t roi = { 20, 10, 200, 100, 1.0f };
+
+  float DT_ALIGNED_ARRAY points[8] = { 0.0f, 0.0f, 199.0f, 0.0f, 17.0f, 43.0f, 199.0f, 99.0f };
+  float expected[8];
+  memcpy(expected, points, sizeof(points));
+
+  TR_STEP("neutral parameters map pixels onto themselves");
+  assert_true(distort_roi_backtransform(NULL, &piece, &roi, &roi, points, 4));
+  for(int k = 0; k < 8; k++)
+    assert_float_equal(points[k], expected[k], 0.0f);
+}
+
+static void test_composed_vs_sequential(void **state)
+{
+  dt_iop_module_t self = { 0 };
+
+  // a rotation followed by a perspective correction with some cropping
+  dt_iop_ashift_data_t data_a = { .rotation = 3.0f, .lensshift_v = 0.1f,
+                                  .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f,
+                                  .cl = 0.0f, .cr = 1.0f, .ct = 0.0f, .cb = 1.0f };
+  dt_iop_ashift_data_t data_b = { .rotation = -1.5f, .lensshift_h = -0.05f, .shear = 0.02f,
+                                  .f_length_kb = DEFAULT_F_LENGTH, .aspect = 1.0f,
+                                  .cl = 0.05f, .cr = 0.95f, .ct = 0.04f, .cb = 0.97f };
+  dt_dev_pixelpipe_iop_t piece_a, piece_b;
+  init_piece(&piece_a, &data_a);
+  init_piece(&piece_b, &data_b);
+
+  // rois as the pixelpipe derives them, from the output back to the input
+  const dt_iop_roi_t roi_out = { 10, 8, WIDTH - 60, HEIGHT - 50, 1.0f };
+  dt_iop_roi_t roi_mid, roi_in;
+  modify_roi_in(&self, &piece_b, &roi_out, &roi_mid);
+  modify_roi_in(&self, &piece_a, &roi_mid, &roi_in);
+  TR_DEBUG("roi_in %d %d %dx%d, roi_mid %d %d %dx%d",
+           roi_in.x, roi_in.y, roi_in.width, roi_in.height,
+           roi_mid.x, roi_mid.y, roi_mid.width, roi_mid.height);
+
+  float *in = dt_alloc_align_float((size_t)4 * roi_in.width * roi_in.height);
+  float *mid = dt_alloc_align_float((size_t)4 * roi_mid.width * roi_mid.height);
+  float *seq = dt_alloc_align_float((size_t)4 * roi_out.width * roi_out.height);
+  float *points = dt_alloc_align_float((size_t)2 * roi_out.width * roi_out.height);
+  float *points_mid = dt_alloc_align_float((size_t)2 * roi_out.width * roi_out.height);
+
+  for(int j = 0; j < roi_in.height; j++)
+    for(int i = 0; i < roi_in.width; i++)
+      for(int c = 0; c < 4; c++)
+        in[4 * ((size_t)j * roi_in.width + i) + c] =
+          image_value(roi_in.x + i, roi_in.y + j, c);
+
+  TR_STEP("process both instances one after the other");
+  process(&self, &piece_a, in, mid, &roi_in, &roi_mid);
+  process(&self, &piece_b, mid, seq, &roi_mid, &roi_out);
+
+  TR_STEP("map the output positions back through both instances");
+  const size_t count = (size_t)roi_out.width * roi_out.height;
+  for(int j = 0; j < roi_out.height; j++)
+    for(int i = 0; i < roi_out.width; i++)
+    {
+      float *pt = points + 2 * ((size_t)j * roi_out.width + i);
+      pt[0] = i;
+      pt[1] = j;
+    }
+  assert_true(distort_roi_backtransform(&self, &piece_b, &roi_mid, &roi_out, points, count));
+  memcpy(points_mid, points, sizeof(float) * 2 * count);
+  assert_true(distort_roi_backtransform(&self, &piece_a, &roi_in, &roi_mid, points, count));
+
+  TR_STEP("compare the single resampling pass with the sequential result");
+  const dt_interpolation_t *interpolation = dt_interpolation_new(DT_INTERPOLATION_USERPREF_WARP);
+  float max_err = 0.0f;
+  size_t compared = 0;
+  for(size_t k = 0; k < count; k++)
+  {
+    const float *pm = points_mid + 2 * k;
+    const float *pt = points + 2 * k;
+    if(pm[0] < BORDER || pm[0] > roi_mid.width - 1 - BORDER
+       || pm[1] < BORDER || pm[1] > roi_mid.height - 1 - BORDER
+       || pt[0] < BORDER || pt[0] > roi_in.width - 1 - BORDER
+       || pt[1] < BORDER || pt[1] > roi_in.height - 1 - BORDER)
+      continue;
+
+    dt_aligned_pixel_t composed;
+    dt_interpolation_compute_pixel4c(interpolation, in, composed, pt[0], pt[1],
+                                     roi_in.width, roi_in.height, 4 * roi_in.width);
+    for(int c = 0; c < 4; c++)
+      max_err = fmaxf(max_err, fabsf(composed[c] - seq[4 * k + c]));
+    compared++;
+  }
+  TR_DEBUG("compared %zu of %zu pixels, max error %e", compared, count, max_err);
+
+  assert_true(compared > count / 2);
+  assert_true(max_err < E);
+
+  dt_free_align(points_mid);
+  dt_free_align(points);
+  dt_free_align(seq);
+  dt_free_align(mid);
+  dt_free_align(in);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] =
+  {
+    cmocka_unit_test_setup_teardown(test_neutral_is_identity, setup_conf, teardown_conf),
+    cmocka_unit_test_setup_teardown(test_composed_vs_sequential, setup_conf, teardown_conf)
+  };
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on
@@ -0,0 +1,297 @@
+/*
+    This file is part of darktable,
+    Copyright (C) 2025 darktable developers.
+
+    darktable is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    darktable is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with darktable.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/*
+ * cmocka unit tests for the module iop/demosaic.c
+ *
+ * Please see README.md for more detailed documentation.
+ */
+#include <limits.h>
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <cmocka.h>
+
+#include "../util/assert.h"
+#include "../util/tracing.h"
+
+#include "iop/demosaic.c"
+
+#ifdef _WIN32
+#include "win/main_wrapper.h"
+#endif
+
+/*
+ * DEFINITIONS
+ */
+
+// tolerances between the multiversioned and the baseline rcd kernel. fused
+// multiply-add in the wider clones changes the last bits, and the ratio
+// corrected estimates amplify that next to clipped or negative photosites.
+#define E 1e-2f
+#define E_MEAN 1e-6
+
+// the four bayer layouts
+static const uint32_t bayer_filters[] =
+  { 0x94949494, 0x16161616, 0x61616161, 0x49494949 };
+
+// sizes below the rcd border, with partial tiles and with several full tiles
+static const int sizes[][2] = { { 17, 15 }, { 250, 190 }, { 531, 302 } };
+
+/*
+ * HELPER FUNCTIONS
+ */
+
+// deterministic mosaic with smooth gradients, hard edges and some clipped
+// and negative photosites
+static float *mosaic_alloc(const int width, const int height)
+{
+  float *in = dt_alloc_align_float((size_t)width * height);
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      float v = 0.5f + 0.4f * sinf(i * 0.05f + j * 0.013f) * cosf(j * 0.07f);
+      if(((i / 37) + (j / 23)) & 1) v += 0.2f;
+      if((i * 7 + j * 13) % 101 == 0) v = -0.01f;
+      in[(size_t)j * width + i] = v;
+    }
+  return in;
+}
+
+// low frequency colour field sampled through the cfa, both demosaicers
+// should reproduce it closely
+static void smooth_color(const int x, const int y, dt_aligned_pixel_t rgb)
+{
+  rgb[0] = 0.5f + 0.3f * sinf(x * 0.02f);
+  rgb[1] = 0.4f + 0.2f * cosf(y * 0.03f);
+  rgb[2] = 0.3f + 0.2f * sinf((x + y) * 0.015f);
+  rgb[3] = 0.0f;
+}
+
+static float *smooth_mosaic_alloc(const int width, const int height, const uint32_t filters)
+{
+  float *in = dt_alloc_align_float((size_t)width * height);
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      dt_aligned_pixel_t rgb;
+      smooth_color(i, j, rgb);
+      in[(size_t)j * width + i] = rgb[FC(j, i, filters)];
+    }
+  return in;
+}
+
+// the resampling looks up the interpolator in the config
+static int setup_conf(void **state)
+{
+  darktable.conf = calloc(1, sizeof(dt_conf_t));
+  dt_pthread_mutex_init(&darktable.conf->mutex, NULL);
+  darktable.conf->table = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  darktable.conf->override_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+  g_hash_table_insert(darktable.conf->table,
+                      g_strdup("plugins/lighttable/export/pixel_interpolator"),
+                      g_strdup("bilinear"));
+  return 0;
+}
+
+static int teardown_conf(void **state)
+{
+  g_hash_table_destroy(darktable.conf->override_entries);
+  g_hash_table_destroy(darktable.conf->table);
+  dt_pthread_mutex_destroy(&darktable.conf->mutex);
+  free(darktable.conf);
+  darktable.conf = NULL;
+  return 0;
+}
+
+/*
+ * TEST FUNCTIONS
+ */
+
+static void test_rcd_dispatch(void **state)
+{
+  for(int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+  {
+    const int width = sizes[s][0];
+    const int height = sizes[s][1];
+    const size_t npixels = (size_t)width * height;
+    float *in = mosaic_alloc(width, height);
+    float *ref = dt_calloc_align_float(4 * npixels);
+    float *out = dt_calloc_align_float(4 * npixels);
+
+    for(int f = 0; f < (int)(sizeof(bayer_filters) / sizeof(bayer_filters[0])); f++)
+    {
+      TR_STEP("verify rcd against the baseline kernel for %dx%d, filters %08x",
+        width, height, bayer_filters[f]);
+      _rcd_demosaic_run(ref, in, width, height, bayer_filters[f], 1.2f, TRUE);
+      rcd_demosaic(out, in, width, height, bayer_filters[f], 1.2f);
+      double err = 0.0;
+      for(size_t k = 0; k < 4 * npixels; k++)
+      {
+        assert_float_equal(out[k], ref[k], E * fmaxf(1.0f, fabsf(ref[k])));
+        err += fabsf(out[k] - ref[k]);
+      }
+      TR_DEBUG("mean difference %e", err / (4 * npixels));
+      assert_true(err / (4 * npixels) < E_MEAN);
+    }
+
+    dt_free_align(out);
+    dt_free_align(ref);
+    dt_free_align(in);
+  }
+}
+
+static void test_rcd_non_negative(void **state)
+{
+  const int width = sizes[2][0];
+  const int height = sizes[2][1];
+  const size_t npixels = (size_t)width * height;
+  float *in = mosaic_alloc(width, height);
+  float *out = dt_calloc_align_float(4 * npixels);
+
+  TR_STEP("verify that rcd output is finite and not negative");
+  rcd_demosaic(out, in, width, height, bayer_filters[0], 1.2f);
+  for(size_t k = 0; k < npixels; k++)
+    for(int c = 0; c < 3; c++)
+    {
+      assert_true(isfinite(out[4 * k + c]));
+      assert_true(out[4 * k + c] >= 0.0f);
+    }
+
+  dt_free_align(out);
+  dt_free_align(in);
+}
+
+static void test_binned_vs_full(void **state)
+{
+  const int width = 480;
+  const int height = 360;
+  const size_t npixels = (size_t)width * height;
+  float *full = dt_calloc_align_float(4 * npixels);
+
+  for(int f = 0; f < (int)(sizeof(bayer_filters) / sizeof(bayer_filters[0])); f++)
+  {
+    float *in = smooth_mosaic_alloc(width, height, bayer_filters[f]);
+    rcd_demosaic(full, in, width, height, bayer_filters[f], 1.2f);
+
+    for(int factor = 2; factor <= BINNED_MAX_FACTOR; factor++)
+    {
+      TR_STEP("compare binning by %d to rcd and downscaling, filters %08x",
+        factor, bayer_filters[f]);
+      const int bwidth = width / factor;
+      const int bheight = height / factor;
+      float *binned = dt_calloc_align_float((size_t)4 * bwidth * bheight);
+      float *ref = dt_calloc_align_float((size_t)4 * bwidth * bheight);
+      demosaic_binned(binned, in, width, height, bayer_filters[f], NULL, factor);
+
+      const dt_iop_roi_t roi_in = { .width = width, .height = height, .scale = 1.0f };
+      const dt_iop_roi_t roi_out = { .width = bwidth, .height = bheight, .scale = 1.0f / factor };
+      dt_iop_clip_and_zoom(ref, full, &roi_out, &roi_in);
+
+      // the borders differ in how they are extended
+      double err = 0.0;
+      size_t count = 0;
+      for(int j = 2; j < bheight - 2; j++)
+        for(int i = 2; i < bwidth - 2; i++)
+          for(int c = 0; c < 3; c++)
+          {
+            const size_t k = 4 * ((size_t)j * bwidth + i) + c;
+            assert_float_equal(binned[k], ref[k], 0.02f);
+            err += fabsf(binned[k] - ref[k]);
+            count++;
+          }
+      TR_DEBUG("mean difference %e", err / count);
+      assert_true(err / count < 5e-3);
+
+      dt_free_align(ref);
+      dt_free_align(binned);
+    }
+    dt_free_align(in);
+  }
+
+  dt_free_align(full);
+}
+
+static void test_kept_roi_offset(void **state)
+{
+  // the kept image holds its own coordinates in the first two channels
+  const int width = 400;
+  const int height = 300;
+  float *kept = dt_alloc_align_float((size_t)4 * width * height);
+  for(int j = 0; j < height; j++)
+    for(int i = 0; i < width; i++)
+    {
+      float *px = kept + 4 * ((size_t)j * width + i);
+      px[0] = i;
+      px[1] = j;
+      px[2] = px[3] = 0.0f;
+    }
+
+  const dt_iop_roi_t roi_in = { .x = 0, .y = 0, .width = width, .height = height, .scale = 1.0f };
+  const dt_iop_roi_t rois_out[] = {
+    { .x = 0, .y = 0, .width = width, .height = height, .scale = 1.0f },
+    { .x = 120, .y = 90, .width = 150, .height = 110, .scale = 1.0f },
+    { .x = 60, .y = 40, .width = 100, .height = 80, .scale = 0.5f },
+    { .x = 17, .y = 33, .width = 50, .height = 40, .scale = 0.25f }
+  };
+
+  for(int r = 0; r < (int)(sizeof(rois_out) / sizeof(rois_out[0])); r++)
+  {
+    const dt_iop_roi_t *roi_out = &rois_out[r];
+    TR_STEP("crop %dx%d at %d,%d scale %.2f from the kept image",
+      roi_out->width, roi_out->height, roi_out->x, roi_out->y, roi_out->scale);
+    float *out = dt_calloc_align_float((size_t)4 * roi_out->width * roi_out->height);
+    _kept_to_output(out, kept, roi_out, &roi_in);
+
+    // every output pixel has to show the input position it's taken from
+    for(int j = 0; j < roi_out->height; j++)
+      for(int i = 0; i < roi_out->width; i++)
+      {
+        const float *px = out + 4 * ((size_t)j * roi_out->width + i);
+        assert_float_equal(px[0], (roi_out->x + i) / roi_out->scale, 2.0f / roi_out->scale);
+        assert_float_equal(px[1], (roi_out->y + j) / roi_out->scale, 2.0f / roi_out->scale);
+      }
+    dt_free_align(out);
+  }
+
+  dt_free_align(kept);
+}
+
+/*
+ * MAIN FUNCTION
+ */
+int main(int argc, char* argv[])
+{
+  const struct CMUnitTest tests[] = {
+    cmocka_unit_test(test_rcd_dispatch),
+    cmocka_unit_test(test_rcd_non_negative),
+    cmocka_unit_test_setup_teardown(test_binned_vs_full, setup_conf, teardown_conf),
+    cmocka_unit_test_setup_teardown(test_kept_roi_offset, setup_conf, teardown_conf)
+  };
+
+  TR_DEBUG("epsilon = %e", E);
+
+  return cmocka_run_group_tests(tests, NULL, NULL);
+}
+// clang-format off
+// modelines: These editor modelines have been set for all relevant files by tools/update_modelines.py
+// vim: shiftwidth=2 expandtab tabstop=2 cindent
+// kate: tab-indents: off; indent-width 2; replace-tabs on; indent-mode cstyle; remove-trailing-spaces modified;
+// clang-format on